@@ -0,0 +1,6215 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <sqlite3.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <math.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <pthread.h>
+#include <errno.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "stock_data.h"
+
+/*Where library messages are sent, NULL until the application sets a handler*/
+static stockMessageHandler messageHandler = NULL;
+
+/*Sets where library messages go*/
+void setStockMessageHandler(stockMessageHandler handler){
+
+    messageHandler = handler;
+}
+
+/*Formats a message and passes it to the handler, used in place of printf everywhere in the library*/
+void stockMessage(enum stockMessageLevel level, const char *format, ...){
+
+    char message[512];
+    va_list args;
+
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+
+    if(messageHandler != NULL){
+        messageHandler(level, message);
+    } else if(level != STOCK_STATUS){
+        fputs(message, stderr);
+    }
+}
+
+/*Defaults suit a write heavy shift, WAL lets readers carry on while stock is being edited and NORMAL sync is safe with WAL*/
+static struct databaseSettings settings = {
+    "stock_data.db",
+    "WAL",
+    "NORMAL",
+    /*A negative cache size is in KiB, so this is a 64MiB page cache*/
+    "-65536",
+    "268435456",
+    "MEMORY",
+    "5000",
+    /*The product cache is off by default, it is only safe while this process is the only one changing the database*/
+    "OFF",
+    "20",
+    "backups",
+    /*Seven backups are kept, a week of them when the server takes one a day*/
+    "7",
+    /*The server takes no backups of its own unless an interval in minutes is set*/
+    "0"
+};
+
+/*Returns 1 if value matches one of the allowed words, ignoring case*/
+int isOneOf(const char *value, const char *allowed[]){
+
+    int i;
+
+    for(i=0; allowed[i] != NULL; i++){
+        if(strcasecmp(value, allowed[i]) == 0){
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/*Returns 1 if value is a whole number, a leading minus sign is allowed*/
+int isWholeNumber(const char *value){
+
+    if(*value == '-'){
+        value++;
+    }
+
+    if(*value == 0){
+        return 0;
+    }
+
+    while(*value){
+        if(!isdigit((unsigned char) *value)){
+            return 0;
+        }
+        value++;
+    }
+
+    return 1;
+}
+
+/*Reads an environment variable into a setting, invalid values are reported and the default is kept, returns 1 if the value was rejected*/
+int readSetting(const char *variable, const char **setting, const char *allowed[]){
+
+    const char *value = getenv(variable);
+
+    if(value == NULL || *value == 0){
+        return 0;
+    }
+
+    /*Settings are formatted into PRAGMA statements so anything other than a known word or a number is refused*/
+    if((allowed != NULL && !isOneOf(value, allowed)) || (allowed == NULL && !isWholeNumber(value))){
+        stockMessage(STOCK_NOTICE, "Ignoring %s=%s, keeping %s\n", variable, value, *setting);
+        return 1;
+    }
+
+    *setting = value;
+
+    return 0;
+}
+
+/*Takes any overrides for the database settings from the environment*/
+void loadDatabaseSettings(){
+
+    static const char *journalModes[] = {"DELETE", "TRUNCATE", "PERSIST", "MEMORY", "WAL", "OFF", NULL};
+    static const char *syncModes[] = {"OFF", "NORMAL", "FULL", "EXTRA", NULL};
+    static const char *tempStores[] = {"DEFAULT", "FILE", "MEMORY", NULL};
+    static const char *switches[] = {"ON", "OFF", NULL};
+
+    const char *path = getenv("STOCK_DB_PATH");
+
+    if(path != NULL && *path != 0){
+        settings.path = path;
+    }
+
+    readSetting("STOCK_JOURNAL_MODE", &settings.journalMode, journalModes);
+    readSetting("STOCK_SYNCHRONOUS", &settings.synchronous, syncModes);
+    readSetting("STOCK_CACHE_SIZE", &settings.cacheSize, NULL);
+    readSetting("STOCK_MMAP_SIZE", &settings.mmapSize, NULL);
+    readSetting("STOCK_TEMP_STORE", &settings.tempStore, tempStores);
+    readSetting("STOCK_BUSY_TIMEOUT", &settings.busyTimeout, NULL);
+    readSetting("STOCK_PRODUCT_CACHE", &settings.productCache, switches);
+    readSetting("STOCK_PAGE_SIZE", &settings.pageSize, NULL);
+
+    const char *backupDirectory = getenv("STOCK_BACKUP_DIR");
+
+    if(backupDirectory != NULL && *backupDirectory != 0){
+        settings.backupDirectory = backupDirectory;
+    }
+
+    readSetting("STOCK_BACKUP_KEEP", &settings.backupKeep, NULL);
+    readSetting("STOCK_BACKUP_INTERVAL", &settings.backupInterval, NULL);
+}
+
+/*Applies the tuning settings to an open connection, the busy timeout comes first so the journal mode change can wait for other connections*/
+int applyDatabaseSettings(sqlite3 *db, int readOnly){
+
+    char query[128];
+    char *errMsg = 0;
+    int failed = 0;
+    int i;
+
+    sqlite3_busy_timeout(db, atoi(settings.busyTimeout));
+
+    const char *names[] = {"journal_mode", "synchronous", "cache_size", "mmap_size", "temp_store"};
+    const char *values[] = {settings.journalMode, settings.synchronous, settings.cacheSize, settings.mmapSize, settings.tempStore};
+
+    /*A read only connection cannot change the journal mode, it follows whatever the writer has set*/
+    for(i = readOnly ? 1 : 0; i<5; i++){
+
+        snprintf(query, sizeof(query), "PRAGMA %s = %s", names[i], values[i]);
+
+        if(sqlite3_exec(db, query, 0, 0, &errMsg) != SQLITE_OK){
+            stockMessage(STOCK_ERROR, "SQL error: %s\n", errMsg);
+            sqlite3_free(errMsg);
+            failed = 1;
+        }
+    }
+
+    return failed;
+}
+
+/*Returns the settings in effect*/
+const struct databaseSettings *getDatabaseSettings(){
+
+    return &settings;
+}
+
+/*Used to initially open the database for the rest of the program, will create the db file if the file does not exist*/
+sqlite3 *initialiseDatabase(){
+
+    sqlite3 *db;
+
+    loadDatabaseSettings();
+
+    int rc = sqlite3_open(settings.path, &db);
+    if (rc != SQLITE_OK) {
+        /*SQLITE_OK is an integer variable that is held as part of the sqlite library this represents a successful sqlite execution*/
+        stockMessage(STOCK_ERROR, "\n\nThe database has not been initialised successfully\n\n");
+        stockMessage(STOCK_ERROR, "\n%s\n", sqlite3_errmsg(db));
+        sqlite3_close(db);
+
+        return NULL;
+    } else {
+        applyDatabaseSettings(db, 0);
+
+        stockMessage(STOCK_STATUS, "\n\nThe database has been initialised successfully\n\n");
+
+        return db;
+    }
+}
+
+/*Time a stock movement is recorded at, in seconds since the epoch*/
+#define LEDGER_NOW "CAST(strftime('%s', 'now') AS INTEGER)"
+
+/*Every categoryID of the product in the row in ascending order with commas between them, NULL without a category link. A product in several categories stays one row, and reading the column as a number gives its lowest categoryID*/
+#define PRODUCT_CATEGORIES "(SELECT group_concat(categoryID) FROM (SELECT categoryID FROM PRODUCT_CAT WHERE PRODUCT_CAT.productID = PRODUCT.productID ORDER BY categoryID))"
+/*The reorder level a product without its own level takes, the highest of its categories' levels so it counts as low in any of them*/
+#define PRODUCT_LEVEL_CATEGORY "(SELECT max(CATEGORY.reorderLevel) FROM PRODUCT_CAT JOIN CATEGORY ON CATEGORY.categoryID = PRODUCT_CAT.categoryID WHERE PRODUCT_CAT.productID = PRODUCT.productID)"
+
+/*Identifiers for each query held in the prepared statement registry*/
+enum statementID {
+    STMT_READ_BY_NAME,
+    STMT_READ_BY_CATEGORY,
+    STMT_READ_BY_ID,
+    STMT_CHECK_BY_ID,
+    STMT_LOAD_CATEGORIES,
+    STMT_GET_LAST_ID,
+    STMT_READ_ALL,
+    STMT_INSERT_PRODUCT,
+    STMT_INSERT_PRODUCT_CAT,
+    STMT_UPDATE_NAME,
+    STMT_UPDATE_PRICE,
+    STMT_UPDATE_QUANTITY,
+    STMT_LINK_CATEGORY,
+    STMT_UNLINK_CATEGORY,
+    STMT_DELETE_PRODUCT,
+    STMT_DELETE_PRODUCT_CAT,
+    STMT_CATEGORY_REPORT,
+    STMT_SEARCH_NAME,
+    STMT_SEARCH_FUZZY,
+    STMT_INDEX_NAME,
+    STMT_UNINDEX_NAME,
+    STMT_PAGE_ALL,
+    STMT_PAGE_CATEGORY,
+    STMT_PAGE_ALL_START,
+    STMT_PAGE_CATEGORY_START,
+    STMT_ADJUST_QUANTITY,
+    STMT_RECORD_MOVEMENT,
+    STMT_RECORD_SET_MOVEMENT,
+    STMT_DELETE_MOVEMENTS,
+    STMT_DELETE_SNAPSHOT,
+    STMT_READ_MOVEMENTS,
+    STMT_READ_SNAPSHOT,
+    STMT_SET_PRODUCT_REORDER,
+    STMT_SET_CATEGORY_REORDER,
+    STMT_APPLY_CATEGORY_REORDER,
+    STMT_INHERIT_REORDER,
+    STMT_LOW_STOCK,
+    STMT_READ_LINKS,
+    STMT_READ_CATEGORY_LINKS,
+    STMT_COUNT
+};
+
+/*The SQL for each statement, indexed by its statementID*/
+static const char *statementQueries[STMT_COUNT] = {
+    "SELECT PRODUCT.productID, PRODUCT.name, PRODUCT.quantity, PRODUCT.price, " PRODUCT_CATEGORIES " AS categories FROM PRODUCT WHERE PRODUCT.name = ? AND categories IS NOT NULL",
+    "SELECT PRODUCT.productID, PRODUCT.name, PRODUCT.quantity, PRODUCT.price, " PRODUCT_CATEGORIES " FROM PRODUCT, PRODUCT_CAT WHERE PRODUCT.productID = PRODUCT_CAT.productID AND PRODUCT_CAT.categoryID = ?",
+    "SELECT PRODUCT.productID, PRODUCT.name, PRODUCT.quantity, PRODUCT.price, " PRODUCT_CATEGORIES " AS categories FROM PRODUCT WHERE PRODUCT.productID = ? AND categories IS NOT NULL",
+    /*Only whether the product exists is wanted, so sqlite can stop at the first link instead of reading the product*/
+    "SELECT EXISTS (SELECT 1 FROM PRODUCT_CAT JOIN PRODUCT ON PRODUCT.productID = PRODUCT_CAT.productID WHERE PRODUCT_CAT.productID = ?)",
+    "SELECT categoryID, name FROM CATEGORY",
+    "SELECT max(productID) FROM PRODUCT",
+    /*Read in full far more than any other listing, so it joins the links directly instead of gathering them per product, and the iterator merges the rows of a product in several categories*/
+    "SELECT PRODUCT.productID, PRODUCT.name, PRODUCT.quantity, PRODUCT.price, PRODUCT_CAT.categoryID FROM PRODUCT LEFT JOIN PRODUCT_CAT ON PRODUCT.productID = PRODUCT_CAT.productID ORDER BY PRODUCT.productID",
+    /*A new product starts with the reorder level of its category*/
+    "INSERT INTO PRODUCT(productID, name, price, quantity, reorderLevel) VALUES(?1, ?2, ?3, ?4, (SELECT reorderLevel FROM CATEGORY WHERE categoryID = ?5))",
+    "INSERT INTO PRODUCT_CAT VALUES(?, ?)",
+    "UPDATE PRODUCT SET name = ? WHERE productID = ?",
+    "UPDATE PRODUCT SET price = ? WHERE productID = ?",
+    "UPDATE PRODUCT SET quantity = ? WHERE productID = ?",
+    "INSERT OR IGNORE INTO PRODUCT_CAT(productID, categoryID) VALUES(?1, ?2)",
+    /*The last link of a product is never removed, so it cannot drop out of every listing*/
+    "DELETE FROM PRODUCT_CAT WHERE productID = ?1 AND categoryID = ?2 AND EXISTS (SELECT 1 FROM PRODUCT_CAT AS OTHER WHERE OTHER.productID = ?1 AND OTHER.categoryID <> ?2)",
+    "DELETE FROM PRODUCT WHERE productID = ?",
+    "DELETE FROM PRODUCT_CAT WHERE productID = ?",
+    /*A product in several categories is counted once, under its lowest categoryID, so the totals still add up to the whole stock*/
+    "SELECT (SELECT min(categoryID) FROM PRODUCT_CAT WHERE PRODUCT_CAT.productID = PRODUCT.productID), count(*), total(PRODUCT.quantity), total(PRODUCT.price * PRODUCT.quantity), min(PRODUCT.price), max(PRODUCT.price) FROM PRODUCT GROUP BY 1",
+    "SELECT PRODUCT.productID, PRODUCT.name, PRODUCT.quantity, PRODUCT.price, " PRODUCT_CATEGORIES " FROM PRODUCT_NAME_SEARCH JOIN PRODUCT ON PRODUCT.productID = PRODUCT_NAME_SEARCH.rowid WHERE PRODUCT_NAME_SEARCH MATCH ?1 AND (?2 = 0 OR instr(lower(PRODUCT.name), lower(?3)) = 1) ORDER BY instr(lower(PRODUCT.name), lower(?3)), length(PRODUCT.name), PRODUCT.productID LIMIT ?4",
+    "SELECT PRODUCT.productID, PRODUCT.name, PRODUCT.quantity, PRODUCT.price, " PRODUCT_CATEGORIES " FROM (SELECT rowid, rank FROM PRODUCT_NAME_SEARCH WHERE PRODUCT_NAME_SEARCH MATCH ?1 ORDER BY rank LIMIT ?2) AS CANDIDATES JOIN PRODUCT ON PRODUCT.productID = CANDIDATES.rowid ORDER BY CANDIDATES.rank",
+    "INSERT INTO PRODUCT_NAME_SEARCH(rowid, name) VALUES(?, ?)",
+    /*The text index has to be given the name it holds now, so it is read from PRODUCT before that row changes*/
+    "INSERT INTO PRODUCT_NAME_SEARCH(PRODUCT_NAME_SEARCH, rowid, name) SELECT 'delete', productID, name FROM PRODUCT WHERE productID = ?",
+    /*Pages are read in productID order from a cursor, so each page costs the same however far into the listing it is*/
+    "SELECT PRODUCT.productID, PRODUCT.name, PRODUCT.quantity, PRODUCT.price, " PRODUCT_CATEGORIES " FROM PRODUCT WHERE PRODUCT.productID > ?1 ORDER BY PRODUCT.productID LIMIT ?2",
+    "SELECT PRODUCT.productID, PRODUCT.name, PRODUCT.quantity, PRODUCT.price, " PRODUCT_CATEGORIES " FROM PRODUCT_CAT JOIN PRODUCT ON PRODUCT.productID = PRODUCT_CAT.productID WHERE PRODUCT_CAT.categoryID = ?3 AND PRODUCT_CAT.productID > ?1 ORDER BY PRODUCT_CAT.productID LIMIT ?2",
+    /*One row more than a page is read, when it is there it is the row just before the page*/
+    "SELECT min(productID), count(*) FROM (SELECT productID FROM PRODUCT WHERE productID < ?1 ORDER BY productID DESC LIMIT ?2 + 1)",
+    "SELECT min(productID), count(*) FROM (SELECT productID FROM PRODUCT_CAT WHERE categoryID = ?3 AND productID < ?1 ORDER BY productID DESC LIMIT ?2 + 1)",
+    /*The quantity is changed by the delta inside sqlite, so two writers adjusting the same product never lose each other's change*/
+    "UPDATE PRODUCT SET quantity = quantity + ?1 WHERE productID = ?2 AND quantity + ?1 >= 0 RETURNING quantity, reorderLevel",
+    "INSERT INTO STOCK_MOVEMENT(productID, delta, reason, createdAt) VALUES(?1, ?2, ?3, " LEDGER_NOW ")",
+    /*A quantity that is set outright is recorded as the difference from the quantity it replaces*/
+    "INSERT INTO STOCK_MOVEMENT(productID, delta, reason, createdAt) SELECT productID, ?2 - quantity, 'set', " LEDGER_NOW " FROM PRODUCT WHERE productID = ?1 AND quantity <> ?2",
+    "DELETE FROM STOCK_MOVEMENT WHERE productID = ?",
+    "DELETE FROM STOCK_SNAPSHOT WHERE productID = ?",
+    "SELECT movementID, delta, reason, createdAt FROM STOCK_MOVEMENT WHERE productID = ?1 ORDER BY movementID DESC LIMIT ?2",
+    "SELECT quantity, movementID, createdAt FROM STOCK_SNAPSHOT WHERE productID = ?",
+    /*Without a level of its own a product goes back to its category's level*/
+    "UPDATE PRODUCT SET reorderLevel = coalesce(?1, " PRODUCT_LEVEL_CATEGORY "), ownReorderLevel = ?1 IS NOT NULL WHERE productID = ?2",
+    "UPDATE CATEGORY SET reorderLevel = ?1 WHERE categoryID = ?2",
+    /*Products in several categories are worked out again from all of them*/
+    "UPDATE PRODUCT SET reorderLevel = " PRODUCT_LEVEL_CATEGORY " WHERE ownReorderLevel = 0 AND productID IN (SELECT productID FROM PRODUCT_CAT WHERE categoryID = ?1)",
+    /*Run once the links of a product have changed*/
+    "UPDATE PRODUCT SET reorderLevel = " PRODUCT_LEVEL_CATEGORY " WHERE productID = ?1 AND ownReorderLevel = 0",
+    /*The condition matches PRODUCT_LOW_STOCK_INDEX, which only holds products at or below their level, so the table is never scanned*/
+    "SELECT PRODUCT.productID, PRODUCT.name, PRODUCT.quantity, PRODUCT.price, " PRODUCT_CATEGORIES " FROM PRODUCT WHERE PRODUCT.quantity <= PRODUCT.reorderLevel AND (?1 IS NULL OR EXISTS (SELECT 1 FROM PRODUCT_CAT WHERE PRODUCT_CAT.productID = PRODUCT.productID AND PRODUCT_CAT.categoryID = ?1)) ORDER BY PRODUCT.productID",
+    /*Both read the category index in order, so the productIDs of each category arrive ascending*/
+    "SELECT categoryID, productID FROM PRODUCT_CAT ORDER BY categoryID, productID",
+    "SELECT productID FROM PRODUCT_CAT WHERE categoryID = ? ORDER BY productID"
+};
+
+/*Short names for each statement, used when statement statistics are shown*/
+static const char *statementNames[STMT_COUNT] = {
+    "read by name",
+    "read by category",
+    "read by id",
+    "check by id",
+    "load categories",
+    "last id",
+    "read all",
+    "insert product",
+    "insert product link",
+    "update name",
+    "update price",
+    "update quantity",
+    "link category",
+    "unlink category",
+    "delete product",
+    "delete product link",
+    "category report",
+    "search name",
+    "search fuzzy",
+    "index name",
+    "unindex name",
+    "page all",
+    "page category",
+    "page all start",
+    "page category start",
+    "adjust quantity",
+    "record movement",
+    "record set movement",
+    "delete movements",
+    "delete snapshot",
+    "read movements",
+    "read snapshot",
+    "set product reorder level",
+    "set category reorder level",
+    "apply category reorder level",
+    "inherit reorder level",
+    "low stock",
+    "read links",
+    "read category links"
+};
+
+/*Holds the prepared statements belonging to a single database connection*/
+struct statementRegistry {
+    sqlite3 *db;
+    sqlite3_stmt *statements[STMT_COUNT];
+    struct statementRegistry *next;
+};
+
+/*List of registries, one for each open connection*/
+static struct statementRegistry *registries = NULL;
+/*Server threads open and close connections while others look up statements or print the metrics, so the list is only walked or changed under a lock*/
+static pthread_mutex_t registriesLock = PTHREAD_MUTEX_INITIALIZER;
+
+/*Prepares every query once for the given connection so that it can be reused for the rest of the program*/
+int prepareStatements(sqlite3 *db){
+
+    struct statementRegistry *registry = calloc(1, sizeof(struct statementRegistry));
+
+    if(registry == NULL){
+        stockMessage(STOCK_ERROR, "Statement registry could not be allocated\n");
+        return 1;
+    }
+
+    registry->db = db;
+
+    int i;
+
+    for(i=0; i<STMT_COUNT; i++){
+
+        /*SQLITE_PREPARE_PERSISTENT tells sqlite that the statement will be kept and reused many times*/
+        int rc = sqlite3_prepare_v3(db, statementQueries[i], -1, SQLITE_PREPARE_PERSISTENT, &registry->statements[i], 0);
+
+        if(rc != SQLITE_OK){
+            stockMessage(STOCK_ERROR, "SQL error: %s\n", sqlite3_errmsg(db));
+
+            /*Finalizing a NULL statement is harmless so every slot can be finalized*/
+            int j;
+            for(j=0; j<STMT_COUNT; j++){
+                sqlite3_finalize(registry->statements[j]);
+            }
+            free(registry);
+
+            return 1;
+        }
+    }
+
+    pthread_mutex_lock(&registriesLock);
+    registry->next = registries;
+    registries = registry;
+    pthread_mutex_unlock(&registriesLock);
+
+    return 0;
+}
+
+/*Returns the prepared statement for a query, reset and with its previous bindings cleared*/
+sqlite3_stmt *getStatement(sqlite3 *db, enum statementID id){
+
+    struct statementRegistry *registry;
+
+    pthread_mutex_lock(&registriesLock);
+
+    for(registry = registries; registry != NULL; registry = registry->next){
+        if(registry->db == db){
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&registriesLock);
+
+    /*A registry is only freed once nothing uses its connection any more, so it stays valid after the lock is released*/
+    if(registry == NULL){
+        return NULL;
+    }
+
+    sqlite3_stmt *res = registry->statements[id];
+    sqlite3_reset(res);
+    sqlite3_clear_bindings(res);
+
+    return res;
+}
+
+/*Resets a statement once the caller has finished with it so it no longer holds the database open*/
+void releaseStatement(sqlite3_stmt *res){
+
+    if(res != NULL){
+        sqlite3_reset(res);
+    }
+}
+
+/*Finalizes every prepared statement belonging to a connection and removes its registry*/
+void finalizeStatements(sqlite3 *db){
+
+    struct statementRegistry **link = &registries;
+
+    pthread_mutex_lock(&registriesLock);
+
+    while(*link != NULL){
+
+        struct statementRegistry *registry = *link;
+
+        if(registry->db == db){
+
+            int i;
+            for(i=0; i<STMT_COUNT; i++){
+                sqlite3_finalize(registry->statements[i]);
+            }
+
+            *link = registry->next;
+            free(registry);
+
+        } else {
+            link = &registry->next;
+        }
+    }
+
+    pthread_mutex_unlock(&registriesLock);
+}
+
+/*Closes the database when the function is called*/
+void closeDB(sqlite3 *db){
+
+    /*Statements must be finalized before the connection can close*/
+    finalizeStatements(db);
+    sqlite3_close(db);
+}
+
+static const char *metricNames[METRIC_COUNT] = {
+    "insert",
+    "find by name",
+    "find by category",
+    "read by id",
+    "list",
+    "change name",
+    "change price",
+    "change quantity",
+    "change category",
+    "delete",
+    "import",
+    "report",
+    "search",
+    "page",
+    "bulk modify",
+    "adjust quantity",
+    "compact ledger",
+    "set reorder level",
+    "low stock",
+    "backup",
+    "export snapshot",
+    "category filter"
+};
+
+/*Latency buckets double in width, bucket b holds calls that took less than 2^b microseconds, the last one holds everything slower*/
+#define LATENCY_BUCKETS 28
+
+/*Counters for one data operation*/
+struct operationMetrics{
+
+    unsigned long calls;
+    unsigned long failures;
+    unsigned long rows;
+    double totalMicros;
+    double maxMicros;
+    unsigned long buckets[LATENCY_BUCKETS];
+};
+
+static struct operationMetrics metrics[METRIC_COUNT];
+/*Server threads record metrics at the same time, so updates are made under a lock*/
+static pthread_mutex_t metricsLock = PTHREAD_MUTEX_INITIALIZER;
+
+/*Reads the clock at the start of an operation*/
+struct timespec startMetric(){
+
+    struct timespec started;
+    clock_gettime(CLOCK_MONOTONIC, &started);
+
+    return started;
+}
+
+/*Records a finished operation and passes its result straight back, so it can wrap each return statement*/
+int endMetric(enum metricID id, struct timespec *started, long rows, int result){
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    double micros = (now.tv_sec - started->tv_sec) * 1e6 + (now.tv_nsec - started->tv_nsec) / 1e3;
+    int bucket = 0;
+
+    while(bucket < LATENCY_BUCKETS - 1 && micros >= (double) (1UL << bucket)){
+        bucket++;
+    }
+
+    pthread_mutex_lock(&metricsLock);
+
+    struct operationMetrics *metric = &metrics[id];
+
+    metric->calls += 1;
+    metric->rows += rows > 0 ? rows : 0;
+    metric->totalMicros += micros;
+    metric->buckets[bucket] += 1;
+
+    if(result != 0){
+        metric->failures += 1;
+    }
+    if(micros > metric->maxMicros){
+        metric->maxMicros = micros;
+    }
+
+    pthread_mutex_unlock(&metricsLock);
+
+    return result;
+}
+
+/*Estimates a latency percentile from the histogram, the answer is the upper edge of the bucket it falls in*/
+double metricPercentile(struct operationMetrics *metric, double fraction){
+
+    unsigned long target = (unsigned long) (fraction * metric->calls + 0.999999);
+    unsigned long seen = 0;
+    int bucket;
+
+    for(bucket=0; bucket<LATENCY_BUCKETS; bucket++){
+
+        seen += metric->buckets[bucket];
+
+        if(seen >= target){
+            return bucket < LATENCY_BUCKETS - 1 ? (double) (1UL << bucket) : metric->maxMicros;
+        }
+    }
+
+    return metric->maxMicros;
+}
+
+/*Prints the operation counters followed by sqlite's cache and statement statistics for every open connection*/
+void printMetrics(FILE *out){
+
+    int i;
+
+    fprintf(out, "Operation metrics (latency in microseconds, percentiles are bucket upper bounds)\n");
+    fprintf(out, "  %-18s %10s %8s %12s %10s %10s %10s %10s\n", "operation", "calls", "failed", "rows", "mean", "p50", "p99", "max");
+
+    pthread_mutex_lock(&metricsLock);
+
+    for(i=0; i<METRIC_COUNT; i++){
+
+        struct operationMetrics *metric = &metrics[i];
+
+        if(metric->calls == 0){
+            continue;
+        }
+
+        fprintf(out, "  %-18s %10lu %8lu %12lu %10.1f %10.0f %10.0f %10.1f\n", metricNames[i], metric->calls, metric->failures, metric->rows,
+            metric->totalMicros / metric->calls, metricPercentile(metric, 0.5), metricPercentile(metric, 0.99), metric->maxMicros);
+    }
+
+    pthread_mutex_unlock(&metricsLock);
+
+    struct statementRegistry *registry;
+    int connection = 0;
+
+    /*The lock keeps a connection from being closed while its statements are read*/
+    pthread_mutex_lock(&registriesLock);
+
+    for(registry = registries; registry != NULL; registry = registry->next){
+
+        int hits, misses, used, writes, spills, highwater;
+
+        sqlite3_db_status(registry->db, SQLITE_DBSTATUS_CACHE_HIT, &hits, &highwater, 0);
+        sqlite3_db_status(registry->db, SQLITE_DBSTATUS_CACHE_MISS, &misses, &highwater, 0);
+        sqlite3_db_status(registry->db, SQLITE_DBSTATUS_CACHE_USED, &used, &highwater, 0);
+        sqlite3_db_status(registry->db, SQLITE_DBSTATUS_CACHE_WRITE, &writes, &highwater, 0);
+        sqlite3_db_status(registry->db, SQLITE_DBSTATUS_CACHE_SPILL, &spills, &highwater, 0);
+
+        fprintf(out, "\nConnection %d%s\n", connection++, sqlite3_db_readonly(registry->db, "main") == 1 ? " (read only)" : "");
+        fprintf(out, "  page cache: %d hits, %d misses, %d writes, %d spills, %d bytes used\n", hits, misses, writes, spills, used);
+        fprintf(out, "  %-20s %10s %14s %10s %10s %14s\n", "statement", "runs", "fullscan steps", "sorts", "autoindex", "vm steps");
+
+        for(i=0; i<STMT_COUNT; i++){
+
+            sqlite3_stmt *res = registry->statements[i];
+            int runs = sqlite3_stmt_status(res, SQLITE_STMTSTATUS_RUN, 0);
+
+            if(runs == 0){
+                continue;
+            }
+
+            fprintf(out, "  %-20s %10d %14d %10d %10d %14d\n", statementNames[i], runs,
+                sqlite3_stmt_status(res, SQLITE_STMTSTATUS_FULLSCAN_STEP, 0),
+                sqlite3_stmt_status(res, SQLITE_STMTSTATUS_SORT, 0),
+                sqlite3_stmt_status(res, SQLITE_STMTSTATUS_AUTOINDEX, 0),
+                sqlite3_stmt_status(res, SQLITE_STMTSTATUS_VM_STEP, 0));
+        }
+    }
+
+    pthread_mutex_unlock(&registriesLock);
+
+    fflush(out);
+}
+
+/*Creates the tables for the database*/
+int createTable(sqlite3 *db){
+
+    /*Product table to hold the product productID, name, price and quantity*/
+    char *errMsg = 0;
+    char *data = "CREATE TABLE IF NOT EXISTS PRODUCT(productID INTEGER PRIMARY KEY, name TEXT, price REAL, quantity REAL);";
+
+    int rc = sqlite3_exec(db, data, 0, 0, &errMsg);
+   /*follows the structure of database, sqlite command, callback function (optional), pointer variable (optional), error message variable pointer (optional)*/
+
+    if(rc != SQLITE_OK) {
+
+        stockMessage(STOCK_ERROR, "\n%s\n", sqlite3_errmsg(db));
+        sqlite3_free(errMsg);/*sqlite library command to free up the error message from dynamic memory*/
+
+        return 1;
+    }
+    
+    /*Product Category table to link the productID to the categoryID*/
+    errMsg = 0;
+    char productCatData[100] = "CREATE TABLE IF NOT EXISTS PRODUCT_CAT(productID INTEGER, categoryID INTEGER);";
+    data = productCatData;
+    
+    rc = sqlite3_exec(db, data, 0, 0, &errMsg);
+    
+
+    if(rc != SQLITE_OK) {
+        stockMessage(STOCK_ERROR, "\n%s\n", sqlite3_errmsg(db));
+        sqlite3_free(errMsg);
+
+        return 1;
+    }
+
+    /*Category table to link the categoryID to the category name*/
+    errMsg = 0;
+    char catData[100] = "CREATE TABLE IF NOT EXISTS CATEGORY(categoryID INTEGER PRIMARY KEY, name TEXT);";
+    data = catData;
+
+    rc = sqlite3_exec(db, data, 0, 0, &errMsg);
+
+    if(rc != SQLITE_OK) {
+        stockMessage(STOCK_ERROR, "\n%s\n", sqlite3_errmsg(db));
+        sqlite3_free(errMsg);
+
+        return 1;
+    }
+    
+
+    stockMessage(STOCK_STATUS, "\nTables configured successfully\n");
+
+    return 0;
+}
+
+
+/*A single schema upgrade, applied once when the database user_version is below its version*/
+struct migration{
+
+    int version;
+    const char *description;
+    const char *sql;
+};
+
+/*Schema upgrades in the order they must be applied, new migrations are only ever appended with the next version number*/
+static const struct migration migrations[] = {
+    {1, "Index product names",
+        "CREATE INDEX IF NOT EXISTS PRODUCT_NAME_INDEX ON PRODUCT(name);"},
+    /*Duplicate links have to be removed before the unique index can be created, the unique index also serves lookups by productID*/
+    {2, "Make product category links unique",
+        "DELETE FROM PRODUCT_CAT WHERE rowid NOT IN (SELECT min(rowid) FROM PRODUCT_CAT GROUP BY productID, categoryID);"
+        "CREATE UNIQUE INDEX IF NOT EXISTS PRODUCT_CAT_PRODUCT_INDEX ON PRODUCT_CAT(productID, categoryID);"},
+    {3, "Index product category links by category",
+        "CREATE INDEX IF NOT EXISTS PRODUCT_CAT_CATEGORY_INDEX ON PRODUCT_CAT(categoryID, productID);"},
+    /*The trigram index reads names from PRODUCT rather than keeping its own copy, the functions that add, rename and delete products keep it up to date*/
+    {4, "Add a trigram text index on product names",
+        "CREATE VIRTUAL TABLE IF NOT EXISTS PRODUCT_NAME_SEARCH USING fts5(name, tokenize = 'trigram', content = 'PRODUCT', content_rowid = 'productID');"
+        "INSERT INTO PRODUCT_NAME_SEARCH(PRODUCT_NAME_SEARCH) VALUES ('rebuild');"},
+    /*Holds values the program keeps between runs, such as the hash of the category file last applied*/
+    {5, "Add a table of stored settings",
+        "CREATE TABLE IF NOT EXISTS SETTING(name TEXT PRIMARY KEY, value TEXT);"},
+    /*Every quantity change is appended to STOCK_MOVEMENT, compaction folds old movements into one STOCK_SNAPSHOT row per product. AUTOINCREMENT keeps movementIDs rising after the newest movements have been folded away*/
+    {6, "Add the stock movement ledger",
+        "CREATE TABLE IF NOT EXISTS STOCK_MOVEMENT(movementID INTEGER PRIMARY KEY AUTOINCREMENT, productID INTEGER NOT NULL, delta REAL NOT NULL, reason TEXT NOT NULL, createdAt INTEGER NOT NULL);"
+        "CREATE INDEX IF NOT EXISTS STOCK_MOVEMENT_PRODUCT_INDEX ON STOCK_MOVEMENT(productID, movementID);"
+        "CREATE TABLE IF NOT EXISTS STOCK_SNAPSHOT(productID INTEGER PRIMARY KEY, quantity REAL NOT NULL, movementID INTEGER NOT NULL, createdAt INTEGER NOT NULL);"},
+    /*PRODUCT.reorderLevel is the level in force, either the product's own (ownReorderLevel = 1) or a copy of its category's, so the partial index can compare two columns of the same row and only holds the products that are low on stock*/
+    {7, "Add reorder levels and the low stock index",
+        "ALTER TABLE PRODUCT ADD COLUMN reorderLevel REAL;"
+        "ALTER TABLE PRODUCT ADD COLUMN ownReorderLevel INTEGER NOT NULL DEFAULT 0;"
+        "ALTER TABLE CATEGORY ADD COLUMN reorderLevel REAL;"
+        "CREATE INDEX IF NOT EXISTS PRODUCT_LOW_STOCK_INDEX ON PRODUCT(productID) WHERE quantity <= reorderLevel;"}
+};
+
+/*Reads the schema version stored in the database header*/
+int getSchemaVersion(sqlite3 *db){
+
+    sqlite3_stmt *res;
+    int version = -1;
+
+    int rc = sqlite3_prepare_v2(db, "PRAGMA user_version", -1, &res, 0);
+
+    if(rc != SQLITE_OK){
+        stockMessage(STOCK_ERROR, "SQL error: %s\n", sqlite3_errmsg(db));
+        return -1;
+    }
+
+    if(sqlite3_step(res) == SQLITE_ROW){
+        version = sqlite3_column_int(res, 0);
+    }
+
+    sqlite3_finalize(res);
+
+    return version;
+}
+
+/*Upgrades an existing database in place, each migration and its version bump are committed together so a failure leaves the previous version intact*/
+int migrateDatabase(sqlite3 *db){
+
+    int version = getSchemaVersion(db);
+
+    if(version < 0){
+        return 1;
+    }
+
+    int count = sizeof(migrations) / sizeof(migrations[0]);
+    int i;
+
+    for(i=0; i<count; i++){
+
+        if(migrations[i].version <= version){
+            continue;
+        }
+
+        char *errMsg = 0;
+        char data[64];
+
+        int rc = sqlite3_exec(db, "BEGIN IMMEDIATE", 0, 0, &errMsg);
+
+        if(rc == SQLITE_OK){
+            rc = sqlite3_exec(db, migrations[i].sql, 0, 0, &errMsg);
+        }
+
+        if(rc == SQLITE_OK){
+            /*PRAGMA does not accept bound parameters so the version is formatted into the statement*/
+            sprintf(data, "PRAGMA user_version = %d", migrations[i].version);
+            rc = sqlite3_exec(db, data, 0, 0, &errMsg);
+        }
+
+        if(rc == SQLITE_OK){
+            rc = sqlite3_exec(db, "COMMIT", 0, 0, &errMsg);
+        }
+
+        if(rc != SQLITE_OK){
+            stockMessage(STOCK_ERROR, "Migration %d (%s) failed: %s\n", migrations[i].version, migrations[i].description, errMsg);
+            sqlite3_free(errMsg);
+            sqlite3_exec(db, "ROLLBACK", 0, 0, 0);
+
+            return 1;
+        }
+
+        stockMessage(STOCK_NOTICE, "Applied migration %d: %s\n", migrations[i].version, migrations[i].description);
+        version = migrations[i].version;
+    }
+
+    return 0;
+}
+
+/*Fetches the last primary key for the Product table so only unique productID's will be added to the database*/
+int getLastID(sqlite3 *db){
+
+    /*Variable to hold the result of the query*/
+    sqlite3_stmt *res = getStatement(db, STMT_GET_LAST_ID);
+
+    if(res == NULL){
+        stockMessage(STOCK_ERROR, "SQL error: %s\n", sqlite3_errmsg(db));
+        
+        return -1;
+
+    } else {
+        /*lastID set to -1 variable to hold the last identifier*/
+        int lastID = -1;
+
+        /*max() on the primary key is answered from the end of the table's b-tree so no rows are scanned, an empty table gives NULL*/
+        if(sqlite3_step(res) == SQLITE_ROW && sqlite3_column_type(res, 0) != SQLITE_NULL){
+            lastID = sqlite3_column_int(res, 0);
+        }
+
+        releaseStatement(res);
+
+        return lastID;
+    }
+
+}
+
+/*In-process counter used to hand out productIDs to a batch of inserts without a query for each one*/
+static int nextProductID = 0;
+
+/*Reserves count consecutive productIDs and returns the first one, must be called inside the write transaction that inserts them*/
+int reserveProductIDs(sqlite3 *db, int count){
+
+    /*The counter is checked against the table once per batch so IDs added by other processes are never reused*/
+    int lastID = getLastID(db);
+
+    if(nextProductID <= lastID){
+        nextProductID = lastID + 1;
+    }
+
+    int firstID = nextProductID;
+    nextProductID += count;
+
+    return firstID;
+}
+
+/*Hands back the IDs from firstUnused to the end of the last reservation, so a batch that used only part of its range leaves no gap before the next one*/
+void releaseProductIDs(int firstUnused, int end){
+
+    /*A later reservation has already moved the counter on, so the range is no longer the last one*/
+    if(nextProductID == end){
+        nextProductID = firstUnused;
+    }
+}
+
+/*Function to convert a string into a long integer*/
+long int strToInt(char *string){
+
+    long int temp;
+
+    /*strcspn removes the newline character from any inputted string*/
+    string[strcspn(string, "\n")] = 0;
+    /*strtol function to return long integer from string*/
+    temp = strtol(string, NULL, 10); /*Follows the structure of string_input, pointer (optional), base value for integer*/
+
+    return temp;
+}
+
+/*Function to check that the user has inputted an integer, takes in a string*/
+int intCheck(char *string){
+
+    /*variable to hold counter for for loop*/
+    int i;
+    /*Variable to hold result from function*/
+    int success = 0;
+    /*variable to hold the length of the string (result of strlen function)*/
+    int length = strlen(string);
+
+    for(i=0; i<length; i++){
+
+        /*isDigit inbuilt function, executed for each digit inside the string, returns positive integer if the string character is an integer*/
+        if(isdigit(string[i]) > 0){
+
+            success = 1;
+        } else {
+            return 0;
+        }
+    }
+
+    return success;
+}
+
+/*Function to return a long double value from a string*/
+long double strToDbl(char *string){
+
+    /*Temporary variable to hold double value*/
+    long double temp;
+
+    /*Removes newline character from string*/
+    string[strcspn(string, "\n")] = 0;
+    /*Converts string to double value with inbuilt function*/
+    temp = strtod(string, NULL);
+
+    return temp;
+}
+
+/*Function to check that a string is a double*/
+int doubleCheck(char *string){
+
+    /*Temporary variable to hold counter for for loop*/
+    int i;
+    /*Variable to hold the result of the function*/
+    int success = 0;
+    /*Variable to hold the length of the inputted string*/
+    int length = strlen(string);
+
+    /*A counter used to keep track of the amount of decimal points in the string*/
+    int stopCount = 0;
+
+    /*Iterates over the string*/
+    for(i=0; i<length; i++){
+    
+        /*Checks that character is a digit or a decimal point*/
+        if((isdigit(string[i]) > 0) || (string[i] == '.')){
+
+            success = 1;
+            if(string[i] == '.'){
+                /*Increments decimal point counter when detected*/
+                stopCount += 1;
+            }
+
+            /*Checks that no more than one decimal point exists*/
+            if(stopCount > 1){
+                return 0;
+            }
+        } else {
+            return 0;
+        }
+    }
+
+    return success;
+}
+
+/*Slot in the hashed name to categoryID lookup, an empty slot has a NULL name*/
+struct categorySlot{
+
+    const char *name;
+    int categoryID;
+};
+
+/*In-memory index of the category table, names are held in an array indexed by categoryID and hashed for lookups by name*/
+struct categoryIndex{
+
+    char **names;
+    int size;
+    struct categorySlot *slots;
+    /*Always a power of two so the hash can be masked rather than divided*/
+    unsigned int slotCount;
+};
+
+static struct categoryIndex categories = {NULL, 0, NULL, 0};
+
+/*FNV-1a hash of a category name*/
+unsigned int hashCategoryName(const char *name){
+
+    unsigned int hash = 2166136261u;
+
+    while(*name){
+        hash ^= (unsigned char) *name++;
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+/*Frees the in-memory category index*/
+void freeCategoryIndex(){
+
+    int i;
+
+    for(i=0; i<categories.size; i++){
+        free(categories.names[i]);
+    }
+    free(categories.names);
+    free(categories.slots);
+
+    categories.names = NULL;
+    categories.size = 0;
+    categories.slots = NULL;
+    categories.slotCount = 0;
+}
+
+/*Builds the hashed name lookup from the names array, the table is kept at most half full so probes stay short*/
+int buildCategoryHash(){
+
+    unsigned int slotCount = 8;
+    int i;
+
+    while(slotCount < (unsigned int) categories.size * 2){
+        slotCount *= 2;
+    }
+
+    categories.slots = calloc(slotCount, sizeof(struct categorySlot));
+
+    if(categories.slots == NULL){
+        stockMessage(STOCK_ERROR, "Category index could not be allocated\n");
+        return 1;
+    }
+
+    categories.slotCount = slotCount;
+
+    for(i=0; i<categories.size; i++){
+
+        if(categories.names[i] == NULL){
+            continue;
+        }
+
+        /*Linear probing, steps to the next slot until an empty one is found*/
+        unsigned int slot = hashCategoryName(categories.names[i]) & (slotCount - 1);
+
+        while(categories.slots[slot].name != NULL){
+
+            /*Duplicate names keep the lowest categoryID, matching the first line of the category file*/
+            if(strcmp(categories.slots[slot].name, categories.names[i]) == 0){
+                break;
+            }
+            slot = (slot + 1) & (slotCount - 1);
+        }
+
+        if(categories.slots[slot].name == NULL){
+            categories.slots[slot].name = categories.names[i];
+            categories.slots[slot].categoryID = i;
+        }
+    }
+
+    return 0;
+}
+
+/*Stores the name of a category in the index, the hash is built once every name is in*/
+int setCategoryName(int categoryID, const char *name){
+
+    /*Grows the array so that the categoryID can be used directly as the index*/
+    if(categoryID >= categories.size){
+
+        int newSize = categoryID + 1;
+        char **names = realloc(categories.names, sizeof(char *) * newSize);
+
+        if(names == NULL){
+            stockMessage(STOCK_ERROR, "Category index could not be allocated\n");
+            return 1;
+        }
+
+        memset(names + categories.size, 0, sizeof(char *) * (newSize - categories.size));
+        categories.names = names;
+        categories.size = newSize;
+    }
+
+    free(categories.names[categoryID]);
+    categories.names[categoryID] = strdup(name);
+
+    return 0;
+}
+
+/*Loads every category into memory once, giving constant time lookups from name to categoryID and from categoryID to name*/
+int loadCategoryIndex(sqlite3 *db){
+
+    freeCategoryIndex();
+
+    sqlite3_stmt *res = getStatement(db, STMT_LOAD_CATEGORIES);
+
+    if(res == NULL){
+        stockMessage(STOCK_ERROR, "SQL error: %s\n", sqlite3_errmsg(db));
+        return 1;
+    }
+
+    int done = 0;
+
+    while(!done){
+
+        int step = sqlite3_step(res);
+
+        if(step == SQLITE_ROW){
+
+            int categoryID = sqlite3_column_int(res, 0);
+            const char *name = (const char *) sqlite3_column_text(res, 1);
+
+            if(categoryID < 0 || name == NULL){
+                continue;
+            }
+
+            if(setCategoryName(categoryID, name) != 0){
+                releaseStatement(res);
+                return 1;
+            }
+
+        } else {
+            done = 1;
+        }
+    }
+
+    releaseStatement(res);
+
+    return buildCategoryHash();
+}
+
+/*Gets the category id associated with a specific category name, returns CATEGORY_NOT_FOUND if there is no match*/
+int getCategoryID(const char *categoryName){
+
+    if(categories.slotCount == 0){
+        return CATEGORY_NOT_FOUND;
+    }
+
+    unsigned int slot = hashCategoryName(categoryName) & (categories.slotCount - 1);
+
+    while(categories.slots[slot].name != NULL){
+
+        if(strcmp(categories.slots[slot].name, categoryName) == 0){
+            return categories.slots[slot].categoryID;
+        }
+        slot = (slot + 1) & (categories.slotCount - 1);
+    }
+
+    return CATEGORY_NOT_FOUND;
+}
+
+/*Returns the category name for a categoryID from the in-memory index*/
+const char *getCategoryName(int categoryID){
+
+    if(categoryID < 0 || categoryID >= categories.size || categories.names[categoryID] == NULL){
+        return "None";
+    }
+
+    return categories.names[categoryID];
+}
+
+/*Returns one more than the highest categoryID*/
+int getCategoryCount(){
+
+    return categories.size;
+}
+
+/*Returns 1 if categoryID belongs to a category*/
+int hasCategory(int categoryID){
+
+    return categoryID >= 0 && categoryID < categories.size && categories.names[categoryID] != NULL;
+}
+
+/*Reads the categoryID column of a listing row, products without a category link give -1*/
+int columnCategoryID(sqlite3_stmt *res, int column){
+
+    if(sqlite3_column_type(res, column) == SQLITE_NULL){
+        return -1;
+    }
+
+    return sqlite3_column_int(res, column);
+}
+
+/*The low 16 bits of a productID pick its place within a block and the bits above them pick the block*/
+#define BITMAP_BLOCK_BITS 16
+/*A block keeps its values as a sorted array up to this many, past that a bit set of the whole block takes less room*/
+#define BITMAP_ARRAY_LIMIT 4096
+#define BITMAP_WORDS ((1 << BITMAP_BLOCK_BITS) / 64)
+
+/*The productIDs of a bitmap that share their high bits, held in values while there are few of them and in words once there are more*/
+struct bitmapBlock{
+
+    int key;
+    int count;
+    int capacity;
+    uint16_t *values;
+    uint64_t *words;
+};
+
+/*A compressed set of productIDs, blocks are kept in key order so the block of a productID is found with a binary search*/
+struct productBitmap{
+
+    int count;
+    int capacity;
+    struct bitmapBlock *blocks;
+};
+
+/*Ways two bitmaps are combined*/
+enum bitmapOperation{
+    BITMAP_AND,
+    BITMAP_OR,
+    BITMAP_AND_NOT
+};
+
+/*Releases every block of a bitmap and leaves it empty*/
+void freeBitmap(struct productBitmap *bitmap){
+
+    int i;
+
+    for(i=0; i<bitmap->count; i++){
+        free(bitmap->blocks[i].values);
+        free(bitmap->blocks[i].words);
+    }
+
+    free(bitmap->blocks);
+    memset(bitmap, 0, sizeof(struct productBitmap));
+}
+
+/*Returns the position of the block holding key, or where it would be inserted when found is not set*/
+int findBitmapBlock(const struct productBitmap *bitmap, int key, int *found){
+
+    int low = 0;
+    int high = bitmap->count;
+
+    /*Bitmaps are filled in ascending order, so the key usually belongs at the end*/
+    if(high > 0 && bitmap->blocks[high - 1].key < key){
+        *found = 0;
+        return high;
+    }
+
+    while(low < high){
+
+        int middle = low + (high - low) / 2;
+
+        if(bitmap->blocks[middle].key < key){
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    *found = low < bitmap->count && bitmap->blocks[low].key == key;
+
+    return low;
+}
+
+/*Returns the position of value in a block's array, or where it would be inserted when found is not set*/
+int findBlockValue(const struct bitmapBlock *block, uint16_t value, int *found){
+
+    int low = 0;
+    int high = block->count;
+
+    if(high > 0 && block->values[high - 1] < value){
+        *found = 0;
+        return high;
+    }
+
+    while(low < high){
+
+        int middle = low + (high - low) / 2;
+
+        if(block->values[middle] < value){
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    *found = low < block->count && block->values[low] == value;
+
+    return low;
+}
+
+/*Returns 1 if the block holds value*/
+int blockContains(const struct bitmapBlock *block, uint16_t value){
+
+    if(block->words != NULL){
+        return (block->words[value >> 6] >> (value & 63)) & 1;
+    }
+
+    int found;
+
+    findBlockValue(block, value, &found);
+
+    return found;
+}
+
+/*Returns 1 if productID is in the bitmap*/
+int bitmapContains(const struct productBitmap *bitmap, int productID){
+
+    int found;
+
+    if(productID < 0){
+        return 0;
+    }
+
+    int index = findBitmapBlock(bitmap, productID >> BITMAP_BLOCK_BITS, &found);
+
+    return found && blockContains(&bitmap->blocks[index], productID & 0xFFFF);
+}
+
+/*Returns the lowest productID in the bitmap at or above productID, or -1 if there is none*/
+int nextBitmapProduct(const struct productBitmap *bitmap, int productID){
+
+    int found;
+
+    if(productID < 0){
+        productID = 0;
+    }
+
+    int index = findBitmapBlock(bitmap, productID >> BITMAP_BLOCK_BITS, &found);
+    /*A later block is read from its start*/
+    int low = found ? productID & 0xFFFF : 0;
+
+    for(; index < bitmap->count; index++, low = 0){
+
+        const struct bitmapBlock *block = &bitmap->blocks[index];
+        int high = block->key << BITMAP_BLOCK_BITS;
+        int j;
+
+        if(block->words == NULL){
+
+            j = findBlockValue(block, low, &found);
+
+            if(j < block->count){
+                return high | block->values[j];
+            }
+            continue;
+        }
+
+        for(j = low >> 6; j < BITMAP_WORDS; j++){
+
+            uint64_t word = block->words[j];
+
+            if(j == low >> 6){
+                word &= ~0ULL << (low & 63);
+            }
+
+            if(word != 0){
+                return high | (j * 64 + __builtin_ctzll(word));
+            }
+        }
+    }
+
+    return -1;
+}
+
+/*Turns a block's array into a bit set, returns 1 if memory ran out*/
+int convertBlockToWords(struct bitmapBlock *block){
+
+    uint64_t *words = calloc(BITMAP_WORDS, sizeof(uint64_t));
+
+    if(words == NULL){
+        return 1;
+    }
+
+    int i;
+
+    for(i=0; i<block->count; i++){
+        words[block->values[i] >> 6] |= (uint64_t) 1 << (block->values[i] & 63);
+    }
+
+    free(block->values);
+    block->values = NULL;
+    block->capacity = 0;
+    block->words = words;
+
+    return 0;
+}
+
+/*Turns a block's bit set back into an array once it holds few enough values, returns 1 if memory ran out*/
+int convertBlockToValues(struct bitmapBlock *block){
+
+    uint16_t *values = malloc((block->count > 0 ? block->count : 1) * sizeof(uint16_t));
+
+    if(values == NULL){
+        return 1;
+    }
+
+    int used = 0;
+    int i;
+
+    for(i=0; i<BITMAP_WORDS; i++){
+
+        uint64_t word = block->words[i];
+
+        while(word != 0){
+            values[used++] = i * 64 + __builtin_ctzll(word);
+            word &= word - 1;
+        }
+    }
+
+    free(block->words);
+    block->words = NULL;
+    block->values = values;
+    block->capacity = block->count;
+
+    return 0;
+}
+
+/*Appends a block after the last one, the bitmap takes over its memory, returns 1 if memory ran out*/
+int appendBitmapBlock(struct productBitmap *bitmap, struct bitmapBlock *block){
+
+    if(bitmap->count == bitmap->capacity){
+
+        int capacity = bitmap->capacity > 0 ? bitmap->capacity * 2 : 8;
+        struct bitmapBlock *blocks = realloc(bitmap->blocks, capacity * sizeof(struct bitmapBlock));
+
+        if(blocks == NULL){
+            return 1;
+        }
+
+        bitmap->blocks = blocks;
+        bitmap->capacity = capacity;
+    }
+
+    bitmap->blocks[bitmap->count++] = *block;
+
+    return 0;
+}
+
+/*Adds productID to the bitmap, returns 1 if memory ran out*/
+int bitmapAdd(struct productBitmap *bitmap, int productID){
+
+    int found;
+
+    if(productID < 0){
+        return 0;
+    }
+
+    int key = productID >> BITMAP_BLOCK_BITS;
+    uint16_t value = productID & 0xFFFF;
+    int index = findBitmapBlock(bitmap, key, &found);
+
+    if(!found){
+
+        struct bitmapBlock block = {key, 0, 0, NULL, NULL};
+
+        if(appendBitmapBlock(bitmap, &block) != 0){
+            return 1;
+        }
+
+        /*Blocks after the new one move up to keep the keys in order*/
+        memmove(bitmap->blocks + index + 1, bitmap->blocks + index, (bitmap->count - 1 - index) * sizeof(struct bitmapBlock));
+        bitmap->blocks[index] = block;
+    }
+
+    struct bitmapBlock *block = &bitmap->blocks[index];
+
+    if(block->words == NULL && block->count == BITMAP_ARRAY_LIMIT && !blockContains(block, value) && convertBlockToWords(block) != 0){
+        return 1;
+    }
+
+    if(block->words != NULL){
+
+        uint64_t bit = (uint64_t) 1 << (value & 63);
+
+        if(!(block->words[value >> 6] & bit)){
+            block->words[value >> 6] |= bit;
+            block->count += 1;
+        }
+
+        return 0;
+    }
+
+    int position = findBlockValue(block, value, &found);
+
+    if(found){
+        return 0;
+    }
+
+    if(block->count == block->capacity){
+
+        int capacity = block->capacity > 0 ? block->capacity * 2 : 4;
+        uint16_t *values = realloc(block->values, (capacity < BITMAP_ARRAY_LIMIT ? capacity : BITMAP_ARRAY_LIMIT) * sizeof(uint16_t));
+
+        if(values == NULL){
+            return 1;
+        }
+
+        block->values = values;
+        block->capacity = capacity < BITMAP_ARRAY_LIMIT ? capacity : BITMAP_ARRAY_LIMIT;
+    }
+
+    memmove(block->values + position + 1, block->values + position, (block->count - position) * sizeof(uint16_t));
+    block->values[position] = value;
+    block->count += 1;
+
+    return 0;
+}
+
+/*Takes productID out of the bitmap, a block left empty is dropped*/
+void bitmapRemove(struct productBitmap *bitmap, int productID){
+
+    int found;
+
+    if(productID < 0){
+        return;
+    }
+
+    int index = findBitmapBlock(bitmap, productID >> BITMAP_BLOCK_BITS, &found);
+
+    if(!found){
+        return;
+    }
+
+    struct bitmapBlock *block = &bitmap->blocks[index];
+    uint16_t value = productID & 0xFFFF;
+
+    if(block->words != NULL){
+
+        uint64_t bit = (uint64_t) 1 << (value & 63);
+
+        if(block->words[value >> 6] & bit){
+            block->words[value >> 6] &= ~bit;
+            block->count -= 1;
+        }
+
+    } else {
+
+        int position = findBlockValue(block, value, &found);
+
+        if(!found){
+            return;
+        }
+
+        memmove(block->values + position, block->values + position + 1, (block->count - position - 1) * sizeof(uint16_t));
+        block->count -= 1;
+    }
+
+    if(block->count == 0){
+        free(block->values);
+        free(block->words);
+        memmove(bitmap->blocks + index, bitmap->blocks + index + 1, (bitmap->count - index - 1) * sizeof(struct bitmapBlock));
+        bitmap->count -= 1;
+    }
+}
+
+/*Gives the words of a block, an array block is spread into scratch first*/
+const uint64_t *blockWords(const struct bitmapBlock *block, uint64_t *scratch){
+
+    if(block->words != NULL){
+        return block->words;
+    }
+
+    memset(scratch, 0, BITMAP_WORDS * sizeof(uint64_t));
+
+    int i;
+
+    for(i=0; i<block->count; i++){
+        scratch[block->values[i] >> 6] |= (uint64_t) 1 << (block->values[i] & 63);
+    }
+
+    return scratch;
+}
+
+/*Makes result a copy of block, returns 1 if memory ran out*/
+int copyBlock(const struct bitmapBlock *block, struct bitmapBlock *result){
+
+    *result = *block;
+    result->values = NULL;
+    result->words = NULL;
+
+    if(block->words != NULL){
+        result->words = malloc(BITMAP_WORDS * sizeof(uint64_t));
+        if(result->words == NULL){
+            return 1;
+        }
+        memcpy(result->words, block->words, BITMAP_WORDS * sizeof(uint64_t));
+        return 0;
+    }
+
+    result->values = malloc((block->count > 0 ? block->count : 1) * sizeof(uint16_t));
+
+    if(result->values == NULL){
+        return 1;
+    }
+
+    memcpy(result->values, block->values, block->count * sizeof(uint16_t));
+    result->capacity = block->count;
+
+    return 0;
+}
+
+/*Combines two blocks with the same key, result is left empty when nothing is in it, returns 1 if memory ran out*/
+int combineBlocks(const struct bitmapBlock *a, const struct bitmapBlock *b, enum bitmapOperation operation, struct bitmapBlock *result){
+
+    memset(result, 0, sizeof(struct bitmapBlock));
+    result->key = a->key;
+
+    /*An array is only ever made smaller by AND and AND NOT, so each of its values is looked up in the other block*/
+    const struct bitmapBlock *source = NULL;
+    const struct bitmapBlock *other = NULL;
+
+    if(operation != BITMAP_OR && a->words == NULL){
+        source = a;
+        other = b;
+    } else if(operation == BITMAP_AND && b->words == NULL){
+        source = b;
+        other = a;
+    }
+
+    if(source != NULL){
+
+        int i;
+
+        result->values = malloc((source->count > 0 ? source->count : 1) * sizeof(uint16_t));
+
+        if(result->values == NULL){
+            return 1;
+        }
+
+        for(i=0; i<source->count; i++){
+            if(blockContains(other, source->values[i]) == (operation == BITMAP_AND)){
+                result->values[result->count++] = source->values[i];
+            }
+        }
+
+        result->capacity = source->count;
+
+        return 0;
+    }
+
+    /*Otherwise the blocks are combined a word at a time*/
+    uint64_t scratchA[BITMAP_WORDS];
+    uint64_t scratchB[BITMAP_WORDS];
+    const uint64_t *wordsA = blockWords(a, scratchA);
+    const uint64_t *wordsB = blockWords(b, scratchB);
+
+    result->words = malloc(BITMAP_WORDS * sizeof(uint64_t));
+
+    if(result->words == NULL){
+        return 1;
+    }
+
+    int i;
+
+    for(i=0; i<BITMAP_WORDS; i++){
+
+        uint64_t word;
+
+        if(operation == BITMAP_AND){
+            word = wordsA[i] & wordsB[i];
+        } else if(operation == BITMAP_OR){
+            word = wordsA[i] | wordsB[i];
+        } else {
+            word = wordsA[i] & ~wordsB[i];
+        }
+
+        result->words[i] = word;
+        result->count += __builtin_popcountll(word);
+    }
+
+    if(result->count <= BITMAP_ARRAY_LIMIT){
+        return convertBlockToValues(result);
+    }
+
+    return 0;
+}
+
+/*Fills the empty bitmap result with a combined with b, result is left empty and 1 returned if memory ran out*/
+int combineBitmaps(const struct productBitmap *a, const struct productBitmap *b, enum bitmapOperation operation, struct productBitmap *result){
+
+    int i = 0;
+    int j = 0;
+    int failed = 0;
+
+    /*Both lists of blocks are in key order, so they are merged in one pass*/
+    while(!failed && (i < a->count || j < b->count)){
+
+        struct bitmapBlock block = {0, 0, 0, NULL, NULL};
+        int keep = 0;
+
+        if(j == b->count || (i < a->count && a->blocks[i].key < b->blocks[j].key)){
+
+            keep = operation != BITMAP_AND;
+            failed = keep && copyBlock(&a->blocks[i], &block);
+            i += 1;
+
+        } else if(i == a->count || b->blocks[j].key < a->blocks[i].key){
+
+            keep = operation == BITMAP_OR;
+            failed = keep && copyBlock(&b->blocks[j], &block);
+            j += 1;
+
+        } else {
+
+            failed = combineBlocks(&a->blocks[i], &b->blocks[j], operation, &block);
+            keep = block.count > 0;
+            i += 1;
+            j += 1;
+        }
+
+        if(!failed && keep){
+            failed = appendBitmapBlock(result, &block);
+        }
+
+        if(failed || !keep){
+            free(block.values);
+            free(block.words);
+        }
+    }
+
+    if(failed){
+        freeBitmap(result);
+    }
+
+    return failed;
+}
+
+/*Replaces target with target combined with operand and empties operand, returns 1 if memory ran out*/
+int applyBitmap(struct productBitmap *target, struct productBitmap *operand, enum bitmapOperation operation){
+
+    struct productBitmap result = {0, 0, NULL};
+
+    int failed = combineBitmaps(target, operand, operation, &result);
+
+    freeBitmap(target);
+    freeBitmap(operand);
+    *target = result;
+
+    return failed;
+}
+
+/*Writes out every productID of a bitmap in ascending order into a new array, returns 1 if memory ran out*/
+int bitmapToProductIDs(const struct productBitmap *bitmap, int **productIDs, int *count){
+
+    long total = 0;
+    int i;
+
+    for(i=0; i<bitmap->count; i++){
+        total += bitmap->blocks[i].count;
+    }
+
+    *productIDs = malloc((total > 0 ? total : 1) * sizeof(int));
+    *count = 0;
+
+    if(*productIDs == NULL){
+        return 1;
+    }
+
+    for(i=0; i<bitmap->count; i++){
+
+        const struct bitmapBlock *block = &bitmap->blocks[i];
+        int high = block->key << BITMAP_BLOCK_BITS;
+        int j;
+
+        if(block->words == NULL){
+            for(j=0; j<block->count; j++){
+                (*productIDs)[(*count)++] = high | block->values[j];
+            }
+            continue;
+        }
+
+        for(j=0; j<BITMAP_WORDS; j++){
+
+            uint64_t word = block->words[j];
+
+            while(word != 0){
+                (*productIDs)[(*count)++] = high | (j * 64 + __builtin_ctzll(word));
+                word &= word - 1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+/*Products held in memory when the product cache is switched on, each column has its own array so a scan only reads the column it filters on*/
+struct productCache{
+
+    int loaded;
+    int count;
+    int capacity;
+    int deletedCount;
+    /*Set when the cache changes inside a write operation, so a rollback of that operation knows to reload*/
+    int changedInWrite;
+    /*Kept in ascending order so a productID is found with a binary search*/
+    int *productIDs;
+    int *categoryIDs;
+    double *prices;
+    double *quantities;
+    unsigned int *nameOffsets;
+    int *nameLengths;
+    /*Deleted rows stay in place until the cache is compacted so the order is never disturbed*/
+    char *deleted;
+    /*Every name lives in one arena, a renamed product appends its new name and leaves the old one as garbage*/
+    char *names;
+    size_t namesUsed;
+    size_t namesCapacity;
+    size_t namesGarbage;
+    /*Products linked to each category indexed by categoryID, a product in several categories is in the bitmap of every one while categoryIDs holds the lowest*/
+    struct productBitmap *categoryBitmaps;
+    int categoryBitmapCount;
+};
+
+static struct productCache productCache = {0};
+
+/*Readers share the cache while the single writer changes it*/
+static pthread_rwlock_t productCacheLock = PTHREAD_RWLOCK_INITIALIZER;
+
+/*Releases every column of the product cache*/
+void freeProductCache(){
+
+    free(productCache.productIDs);
+    free(productCache.categoryIDs);
+    free(productCache.prices);
+    free(productCache.quantities);
+    free(productCache.nameOffsets);
+    free(productCache.nameLengths);
+    free(productCache.deleted);
+    free(productCache.names);
+
+    int i;
+
+    for(i=0; i<productCache.categoryBitmapCount; i++){
+        freeBitmap(&productCache.categoryBitmaps[i]);
+    }
+    free(productCache.categoryBitmaps);
+
+    memset(&productCache, 0, sizeof(productCache));
+}
+
+/*Makes room for at least needed rows, returns 1 if memory ran out*/
+int growProductCache(int needed){
+
+    if(needed <= productCache.capacity){
+        return 0;
+    }
+
+    int capacity = productCache.capacity > 0 ? productCache.capacity : 1024;
+
+    while(capacity < needed){
+        capacity *= 2;
+    }
+
+    void *columns[7];
+
+    columns[0] = realloc(productCache.productIDs, capacity * sizeof(int));
+    if(columns[0] != NULL) productCache.productIDs = columns[0];
+    columns[1] = realloc(productCache.categoryIDs, capacity * sizeof(int));
+    if(columns[1] != NULL) productCache.categoryIDs = columns[1];
+    columns[2] = realloc(productCache.prices, capacity * sizeof(double));
+    if(columns[2] != NULL) productCache.prices = columns[2];
+    columns[3] = realloc(productCache.quantities, capacity * sizeof(double));
+    if(columns[3] != NULL) productCache.quantities = columns[3];
+    columns[4] = realloc(productCache.nameOffsets, capacity * sizeof(unsigned int));
+    if(columns[4] != NULL) productCache.nameOffsets = columns[4];
+    columns[5] = realloc(productCache.nameLengths, capacity * sizeof(int));
+    if(columns[5] != NULL) productCache.nameLengths = columns[5];
+    columns[6] = realloc(productCache.deleted, capacity);
+    if(columns[6] != NULL) productCache.deleted = columns[6];
+
+    int i;
+
+    for(i=0; i<7; i++){
+        if(columns[i] == NULL){
+            return 1;
+        }
+    }
+
+    productCache.capacity = capacity;
+
+    return 0;
+}
+
+/*Copies a name into the arena, returns 1 if memory ran out*/
+int storeCachedName(int row, const char *name, int length){
+
+    if(productCache.namesUsed + length > productCache.namesCapacity){
+
+        size_t capacity = productCache.namesCapacity > 0 ? productCache.namesCapacity : 65536;
+
+        while(productCache.namesUsed + length > capacity){
+            capacity *= 2;
+        }
+
+        char *names = realloc(productCache.names, capacity);
+
+        if(names == NULL){
+            return 1;
+        }
+
+        productCache.names = names;
+        productCache.namesCapacity = capacity;
+    }
+
+    memcpy(productCache.names + productCache.namesUsed, name, length);
+    productCache.nameOffsets[row] = productCache.namesUsed;
+    productCache.nameLengths[row] = length;
+    productCache.namesUsed += length;
+
+    return 0;
+}
+
+/*Returns the row holding productID, or the row it would be inserted at when found is set to 0*/
+int findCachedRow(int productID, int *found){
+
+    int low = 0;
+    int high = productCache.count;
+
+    while(low < high){
+
+        int middle = low + (high - low) / 2;
+
+        if(productCache.productIDs[middle] < productID){
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    *found = low < productCache.count && productCache.productIDs[low] == productID;
+
+    return low;
+}
+
+/*Returns the row of a product that has not been deleted, or -1*/
+int findLiveCachedRow(int productID){
+
+    int found;
+    int row = findCachedRow(productID, &found);
+
+    if(!found || productCache.deleted[row]){
+        return -1;
+    }
+
+    return row;
+}
+
+/*Drops deleted rows and renamed names, rows keep their order*/
+void compactProductCache(){
+
+    char *names = malloc(productCache.namesCapacity > 0 ? productCache.namesCapacity : 1);
+
+    if(names == NULL){
+        return;
+    }
+
+    size_t used = 0;
+    int kept = 0;
+    int i;
+
+    for(i=0; i<productCache.count; i++){
+
+        if(productCache.deleted[i]){
+            continue;
+        }
+
+        memcpy(names + used, productCache.names + productCache.nameOffsets[i], productCache.nameLengths[i]);
+
+        productCache.productIDs[kept] = productCache.productIDs[i];
+        productCache.categoryIDs[kept] = productCache.categoryIDs[i];
+        productCache.prices[kept] = productCache.prices[i];
+        productCache.quantities[kept] = productCache.quantities[i];
+        productCache.nameOffsets[kept] = used;
+        productCache.nameLengths[kept] = productCache.nameLengths[i];
+        productCache.deleted[kept] = 0;
+
+        used += productCache.nameLengths[i];
+        kept += 1;
+    }
+
+    free(productCache.names);
+    productCache.names = names;
+    productCache.namesUsed = used;
+    productCache.namesGarbage = 0;
+    productCache.count = kept;
+    productCache.deletedCount = 0;
+}
+
+/*Adds a product to the cache in productID order, a product that is already cached keeps its first category, returns 1 if memory ran out*/
+int insertCachedRow(int productID, const char *name, int nameLength, int categoryID, double price, double quantity){
+
+    int found;
+    int row = findCachedRow(productID, &found);
+
+    if(found && !productCache.deleted[row]){
+        return 0;
+    }
+
+    if(found){
+
+        /*A deleted row with the same productID is brought back in place*/
+        productCache.deleted[row] = 0;
+        productCache.deletedCount -= 1;
+        productCache.namesGarbage += productCache.nameLengths[row];
+
+    } else {
+
+        if(growProductCache(productCache.count + 1) != 0){
+            return 1;
+        }
+
+        /*New products nearly always have the highest productID so this move is almost always empty*/
+        int moved = productCache.count - row;
+
+        if(moved > 0){
+            memmove(productCache.productIDs + row + 1, productCache.productIDs + row, moved * sizeof(int));
+            memmove(productCache.categoryIDs + row + 1, productCache.categoryIDs + row, moved * sizeof(int));
+            memmove(productCache.prices + row + 1, productCache.prices + row, moved * sizeof(double));
+            memmove(productCache.quantities + row + 1, productCache.quantities + row, moved * sizeof(double));
+            memmove(productCache.nameOffsets + row + 1, productCache.nameOffsets + row, moved * sizeof(unsigned int));
+            memmove(productCache.nameLengths + row + 1, productCache.nameLengths + row, moved * sizeof(int));
+            memmove(productCache.deleted + row + 1, productCache.deleted + row, moved);
+        }
+
+        productCache.count += 1;
+        productCache.productIDs[row] = productID;
+        productCache.deleted[row] = 0;
+        productCache.nameLengths[row] = 0;
+    }
+
+    productCache.categoryIDs[row] = categoryID;
+    productCache.prices[row] = price;
+    productCache.quantities[row] = quantity;
+
+    return storeCachedName(row, name, nameLength);
+}
+
+/*Returns the bitmap of a cached category, growing the array of bitmaps to reach it, or NULL if memory ran out*/
+struct productBitmap *cachedCategoryBitmap(int categoryID){
+
+    if(categoryID >= productCache.categoryBitmapCount){
+
+        struct productBitmap *bitmaps = realloc(productCache.categoryBitmaps, (categoryID + 1) * sizeof(struct productBitmap));
+
+        if(bitmaps == NULL){
+            return NULL;
+        }
+
+        memset(bitmaps + productCache.categoryBitmapCount, 0, (categoryID + 1 - productCache.categoryBitmapCount) * sizeof(struct productBitmap));
+        productCache.categoryBitmaps = bitmaps;
+        productCache.categoryBitmapCount = categoryID + 1;
+    }
+
+    return &productCache.categoryBitmaps[categoryID];
+}
+
+/*Returns the lowest category a cached product is linked to, or CATEGORY_NOT_FOUND*/
+int lowestCachedCategory(int productID){
+
+    int i;
+
+    for(i=0; i<productCache.categoryBitmapCount; i++){
+        if(bitmapContains(&productCache.categoryBitmaps[i], productID)){
+            return i;
+        }
+    }
+
+    return CATEGORY_NOT_FOUND;
+}
+
+/*Links a cached product to a category, returns 1 if memory ran out*/
+int linkCachedCategory(int productID, int categoryID){
+
+    if(categoryID < 0){
+        return 0;
+    }
+
+    struct productBitmap *bitmap = cachedCategoryBitmap(categoryID);
+
+    return bitmap == NULL || bitmapAdd(bitmap, productID) != 0;
+}
+
+/*Takes a cached product out of every category*/
+void unlinkCachedCategories(int productID){
+
+    int i;
+
+    for(i=0; i<productCache.categoryBitmapCount; i++){
+        bitmapRemove(&productCache.categoryBitmaps[i], productID);
+    }
+}
+
+/*Fills the category bitmaps from the links, one pass over the category index with each category's productIDs in ascending order so every one is appended, returns 1 if they could not be loaded*/
+int loadCategoryBitmaps(sqlite3 *db){
+
+    sqlite3_stmt *res = getStatement(db, STMT_READ_LINKS);
+
+    if(res == NULL){
+        stockMessage(STOCK_ERROR, "SQL error: %s\n", sqlite3_errmsg(db));
+        return 1;
+    }
+
+    int failed = 0;
+    int step;
+
+    while((step = sqlite3_step(res)) == SQLITE_ROW){
+
+        if(linkCachedCategory(sqlite3_column_int(res, 1), sqlite3_column_int(res, 0)) != 0){
+            failed = 1;
+            break;
+        }
+    }
+
+    if(step != SQLITE_DONE && step != SQLITE_ROW){
+        stockMessage(STOCK_ERROR, "SQL error: %s\n", sqlite3_errmsg(db));
+        failed = 1;
+    }
+
+    releaseStatement(res);
+
+    return failed;
+}
+
+/*Fills the product cache from the database, returns 1 and leaves the cache switched off if it could not be loaded*/
+int loadProductCache(sqlite3 *db){
+
+    sqlite3_stmt *res = getStatement(db, STMT_READ_ALL);
+
+    if(res == NULL){
+        stockMessage(STOCK_ERROR, "SQL error: %s\n", sqlite3_errmsg(db));
+        return 1;
+    }
+
+    pthread_rwlock_wrlock(&productCacheLock);
+
+    freeProductCache();
+
+    int failed = 0;
+    int step;
+
+    while((step = sqlite3_step(res)) == SQLITE_ROW){
+
+        const char *name = (const char *) sqlite3_column_text(res, 1);
+
+        if(insertCachedRow(sqlite3_column_int(res, 0), name ? name : "", sqlite3_column_bytes(res, 1), columnCategoryID(res, 4), sqlite3_column_double(res, 3), sqlite3_column_double(res, 2)) != 0){
+            failed = 1;
+            break;
+        }
+    }
+
+    if(step != SQLITE_DONE && step != SQLITE_ROW){
+        stockMessage(STOCK_ERROR, "SQL error: %s\n", sqlite3_errmsg(db));
+        failed = 1;
+    }
+
+    releaseStatement(res);
+
+    if(!failed){
+        failed = loadCategoryBitmaps(db);
+    }
+
+    if(failed){
+        stockMessage(STOCK_ERROR, "The product cache could not be loaded, products will be read from the database\n");
+        freeProductCache();
+    } else {
+        productCache.loaded = 1;
+    }
+
+    pthread_rwlock_unlock(&productCacheLock);
+
+    return failed;
+}
+
+/*Reloads the cache after changes it already holds were rolled back in the database*/
+void reloadProductCache(sqlite3 *db){
+
+    if(productCache.loaded){
+        loadProductCache(db);
+    }
+}
+
+/*Returns 1 if the product cache is switched on and loaded*/
+int isProductCacheLoaded(){
+
+    return productCache.loaded;
+}
+
+/*Write-through for a product that has been added to the database*/
+void cacheInsertProduct(int productID, const char *name, int categoryID, double price, double quantity){
+
+    if(!productCache.loaded){
+        return;
+    }
+
+    pthread_rwlock_wrlock(&productCacheLock);
+
+    if(insertCachedRow(productID, name, strlen(name), categoryID, price, quantity) != 0 || linkCachedCategory(productID, categoryID) != 0){
+        /*A cache missing a product would give wrong answers, so it is switched off instead*/
+        freeProductCache();
+    } else {
+        productCache.changedInWrite = 1;
+    }
+
+    pthread_rwlock_unlock(&productCacheLock);
+}
+
+/*Write-through for a renamed product*/
+void cacheSetName(int productID, const char *name){
+
+    if(!productCache.loaded){
+        return;
+    }
+
+    pthread_rwlock_wrlock(&productCacheLock);
+
+    int row = findLiveCachedRow(productID);
+
+    if(row >= 0){
+
+        productCache.namesGarbage += productCache.nameLengths[row];
+
+        if(storeCachedName(row, name, strlen(name)) != 0){
+            freeProductCache();
+        } else {
+
+            productCache.changedInWrite = 1;
+
+            if(productCache.namesGarbage > productCache.namesUsed / 2){
+                compactProductCache();
+            }
+        }
+    }
+
+    pthread_rwlock_unlock(&productCacheLock);
+}
+
+/*Write-through for a changed price*/
+void cacheSetPrice(int productID, double price){
+
+    if(!productCache.loaded){
+        return;
+    }
+
+    pthread_rwlock_wrlock(&productCacheLock);
+
+    int row = findLiveCachedRow(productID);
+
+    if(row >= 0){
+        productCache.prices[row] = price;
+        productCache.changedInWrite = 1;
+    }
+
+    pthread_rwlock_unlock(&productCacheLock);
+}
+
+/*Write-through for a changed quantity*/
+void cacheSetQuantity(int productID, double quantity){
+
+    if(!productCache.loaded){
+        return;
+    }
+
+    pthread_rwlock_wrlock(&productCacheLock);
+
+    int row = findLiveCachedRow(productID);
+
+    if(row >= 0){
+        productCache.quantities[row] = quantity;
+        productCache.changedInWrite = 1;
+    }
+
+    pthread_rwlock_unlock(&productCacheLock);
+}
+
+/*Write-through for a product whose categories were replaced, the lowest categoryID becomes the one held in its row. onlyLinked leaves a product without a category link alone, like the UPDATE of a bulk change*/
+void cacheSetCategories(int productID, const int *categoryIDs, int count, int onlyLinked){
+
+    if(!productCache.loaded){
+        return;
+    }
+
+    pthread_rwlock_wrlock(&productCacheLock);
+
+    int row = findLiveCachedRow(productID);
+
+    if(row >= 0 && (!onlyLinked || productCache.categoryIDs[row] != CATEGORY_NOT_FOUND)){
+
+        int lowest = CATEGORY_NOT_FOUND;
+        int failed = 0;
+        int i;
+
+        unlinkCachedCategories(productID);
+
+        for(i=0; i<count; i++){
+
+            failed |= linkCachedCategory(productID, categoryIDs[i]);
+
+            if(lowest == CATEGORY_NOT_FOUND || categoryIDs[i] < lowest){
+                lowest = categoryIDs[i];
+            }
+        }
+
+        if(failed){
+            freeProductCache();
+        } else {
+            productCache.categoryIDs[row] = lowest;
+            productCache.changedInWrite = 1;
+        }
+    }
+
+    pthread_rwlock_unlock(&productCacheLock);
+}
+
+/*Write-through for a product moved to a single category*/
+void cacheSetCategory(int productID, int categoryID){
+
+    cacheSetCategories(productID, &categoryID, 1, 1);
+}
+
+/*Write-through for a category added to a product*/
+void cacheLinkCategory(int productID, int categoryID){
+
+    if(!productCache.loaded){
+        return;
+    }
+
+    pthread_rwlock_wrlock(&productCacheLock);
+
+    int row = findLiveCachedRow(productID);
+
+    if(row >= 0){
+
+        if(linkCachedCategory(productID, categoryID) != 0){
+            freeProductCache();
+        } else {
+
+            if(productCache.categoryIDs[row] == CATEGORY_NOT_FOUND || categoryID < productCache.categoryIDs[row]){
+                productCache.categoryIDs[row] = categoryID;
+            }
+            productCache.changedInWrite = 1;
+        }
+    }
+
+    pthread_rwlock_unlock(&productCacheLock);
+}
+
+/*Write-through for a category taken away from a product*/
+void cacheUnlinkCategory(int productID, int categoryID){
+
+    if(!productCache.loaded){
+        return;
+    }
+
+    pthread_rwlock_wrlock(&productCacheLock);
+
+    int row = findLiveCachedRow(productID);
+
+    if(row >= 0 && categoryID >= 0 && categoryID < productCache.categoryBitmapCount){
+
+        bitmapRemove(&productCache.categoryBitmaps[categoryID], productID);
+        productCache.categoryIDs[row] = lowestCachedCategory(productID);
+        productCache.changedInWrite = 1;
+    }
+
+    pthread_rwlock_unlock(&productCacheLock);
+}
+
+/*Write-through for a deleted product*/
+void cacheDeleteProduct(int productID){
+
+    if(!productCache.loaded){
+        return;
+    }
+
+    pthread_rwlock_wrlock(&productCacheLock);
+
+    int row = findLiveCachedRow(productID);
+
+    if(row >= 0){
+
+        productCache.deleted[row] = 1;
+        productCache.deletedCount += 1;
+        productCache.changedInWrite = 1;
+        unlinkCachedCategories(productID);
+
+        if(productCache.deletedCount > productCache.count / 4){
+            compactProductCache();
+        }
+    }
+
+    pthread_rwlock_unlock(&productCacheLock);
+}
+
+/*Returns 1 if a product with a category link is cached under productID, or -1 if the cache is switched off*/
+int cachedProductExists(int productID){
+
+    pthread_rwlock_rdlock(&productCacheLock);
+
+    int exists = -1;
+
+    if(productCache.loaded){
+        int row = findLiveCachedRow(productID);
+        exists = row >= 0 && productCache.categoryIDs[row] != CATEGORY_NOT_FOUND;
+    }
+
+    pthread_rwlock_unlock(&productCacheLock);
+
+    return exists;
+}
+
+/*Names sharing the most three character sequences with the search text that are checked for typos*/
+#define FUZZY_CANDIDATES 200
+/*Longest part of a name compared by the fuzzy search*/
+#define FUZZY_NAME_LENGTH 64
+
+/*A product found by the text index that is waiting to be ranked by its edit distance*/
+struct fuzzyCandidate{
+
+    int productID;
+    int categoryID;
+    double price;
+    double quantity;
+    char name[FUZZY_NAME_LENGTH];
+    int nameLength;
+    /*Every categoryID of the product as the query gave them*/
+    char categories[CATEGORY_LIST_LENGTH];
+    int distance;
+    /*Position in the text index ranking, keeps equally distant names in that order*/
+    int order;
+};
+
+/*Fewest single character insertions, deletions, substitutions or swaps of neighbouring characters that turn text into some part of name, ignoring case*/
+int matchDistance(const char *text, int textLength, const char *name, int nameLength){
+
+    int rows[3][FUZZY_NAME_LENGTH + 1] = {{0}};
+    int i, j;
+
+    /*The match may start anywhere in the name, so skipping the start of the name costs nothing*/
+    for(j=0; j<=nameLength; j++){
+        rows[0][j] = 0;
+    }
+
+    for(i=1; i<=textLength; i++){
+
+        int *previous = rows[(i - 1) % 3];
+        int *current = rows[i % 3];
+        int *beforePrevious = rows[(i + 1) % 3];
+
+        current[0] = i;
+
+        for(j=1; j<=nameLength; j++){
+
+            int cost = tolower((unsigned char) text[i - 1]) != tolower((unsigned char) name[j - 1]);
+            int best = previous[j - 1] + cost;
+
+            if(previous[j] + 1 < best){
+                best = previous[j] + 1;
+            }
+            if(current[j - 1] + 1 < best){
+                best = current[j - 1] + 1;
+            }
+            if(i > 1 && j > 1 && tolower((unsigned char) text[i - 1]) == tolower((unsigned char) name[j - 2]) && tolower((unsigned char) text[i - 2]) == tolower((unsigned char) name[j - 1]) && beforePrevious[j - 2] + 1 < best){
+                best = beforePrevious[j - 2] + 1;
+            }
+
+            current[j] = best;
+        }
+    }
+
+    /*Likewise the match may end anywhere*/
+    int best = rows[textLength % 3][0];
+
+    for(j=1; j<=nameLength; j++){
+        if(rows[textLength % 3][j] < best){
+            best = rows[textLength % 3][j];
+        }
+    }
+
+    return best;
+}
+
+/*Orders fuzzy candidates by edit distance, then by their text index ranking*/
+int compareCandidates(const void *a, const void *b){
+
+    const struct fuzzyCandidate *first = a;
+    const struct fuzzyCandidate *second = b;
+
+    if(first->distance != second->distance){
+        return first->distance - second->distance;
+    }
+
+    return first->order - second->order;
+}
+
+/*Writes text as a single quoted phrase for an FTS5 MATCH, returns 1 if it does not fit*/
+int appendMatchPhrase(char *expression, size_t size, const char *text, int length){
+
+    size_t used = strlen(expression);
+    int i;
+
+    if(used + length * 2 + 3 > size){
+        return 1;
+    }
+
+    expression[used++] = '"';
+
+    for(i=0; i<length; i++){
+        /*A double quote inside a phrase is written twice*/
+        if(text[i] == '"'){
+            expression[used++] = '"';
+        }
+        expression[used++] = text[i];
+    }
+
+    expression[used++] = '"';
+    expression[used] = 0;
+
+    return 0;
+}
+
+/*Builds a MATCH for any three character sequence of the text, names sharing the most sequences rank highest, returns 1 if it does not fit*/
+int buildFuzzyMatch(char *expression, size_t size, const char *text){
+
+    int length = strlen(text);
+    int start = 0;
+
+    expression[0] = 0;
+
+    while(start < length){
+
+        /*Sequences are counted in characters, so a multi-byte character is never split*/
+        int end = start;
+        int characters = 0;
+
+        while(end < length && characters < 3){
+            end++;
+            while(end < length && (text[end] & 0xC0) == 0x80){
+                end++;
+            }
+            characters++;
+        }
+
+        if(characters < 3){
+            break;
+        }
+
+        if(expression[0] != 0){
+            if(strlen(expression) + 4 >= size){
+                return 1;
+            }
+            strcat(expression, " OR ");
+        }
+
+        if(appendMatchPhrase(expression, size, text + start, end - start) != 0){
+            return 1;
+        }
+
+        do {
+            start++;
+        } while(start < length && (text[start] & 0xC0) == 0x80);
+    }
+
+    return 0;
+}
+
+/*Collects the names containing text with at most one typo for every five characters into the iterator, closest first, returns 1 if the search failed*/
+int collectFuzzyMatches(struct productIterator *it, const char *text, int limit){
+
+    char expression[1024];
+
+    if(buildFuzzyMatch(expression, sizeof(expression), text) != 0){
+        stockMessage(STOCK_ERROR, "The search text is too long\n");
+        return 1;
+    }
+
+    sqlite3_stmt *res = getStatement(it->db, STMT_SEARCH_FUZZY);
+
+    if(res == NULL){
+        stockMessage(STOCK_ERROR, "SQL error: %s\n", sqlite3_errmsg(it->db));
+        return 1;
+    }
+
+    struct fuzzyCandidate *candidates = malloc(sizeof(struct fuzzyCandidate) * FUZZY_CANDIDATES);
+
+    if(candidates == NULL){
+        releaseStatement(res);
+        stockMessage(STOCK_ERROR, "The search could not be allocated\n");
+        return 1;
+    }
+
+    int textLength = strlen(text) < FUZZY_NAME_LENGTH ? strlen(text) : FUZZY_NAME_LENGTH;
+    int maxDistance = 1 + textLength / 5;
+    int count = 0;
+
+    sqlite3_bind_text(res, 1, expression, -1, SQLITE_STATIC);
+    sqlite3_bind_int(res, 2, FUZZY_CANDIDATES);
+
+    while(sqlite3_step(res) == SQLITE_ROW && count < FUZZY_CANDIDATES){
+
+        struct fuzzyCandidate *candidate = &candidates[count];
+        const char *name = (const char *) sqlite3_column_text(res, 1);
+
+        candidate->nameLength = sqlite3_column_bytes(res, 1);
+
+        if(name == NULL || candidate->nameLength > FUZZY_NAME_LENGTH){
+            continue;
+        }
+
+        memcpy(candidate->name, name, candidate->nameLength);
+
+        candidate->distance = matchDistance(text, textLength, candidate->name, candidate->nameLength);
+
+        if(candidate->distance > maxDistance){
+            continue;
+        }
+
+        candidate->productID = sqlite3_column_int(res, 0);
+        candidate->quantity = sqlite3_column_double(res, 2);
+        candidate->price = sqlite3_column_double(res, 3);
+        candidate->categoryID = columnCategoryID(res, 4);
+        candidate->order = count;
+
+        const char *categories = (const char *) sqlite3_column_text(res, 4);
+
+        snprintf(candidate->categories, sizeof(candidate->categories), "%s", categories != NULL ? categories : "");
+
+        count += 1;
+    }
+
+    releaseStatement(res);
+
+    qsort(candidates, count, sizeof(struct fuzzyCandidate), compareCandidates);
+
+    it->source = PRODUCTS_FROM_ARRAY;
+    it->candidates = candidates;
+    it->position = 0;
+    it->end = count < limit ? count : limit;
+
+    return 0;
+}
+
+/*Clears an iterator and starts timing it for the metric it is recorded under*/
+void startProducts(sqlite3 *db, enum metricID metric, struct productIterator *it){
+
+    memset(it, 0, sizeof(struct productIterator));
+
+    it->source = PRODUCTS_FROM_STATEMENT;
+    it->metric = metric;
+    it->started = startMetric();
+    it->limit = -1;
+    it->db = db;
+    it->categoryID = CATEGORY_NOT_FOUND;
+}
+
+/*Counts an iterator that could not be started as a failed operation, always returns 1*/
+int failProducts(struct productIterator *it){
+
+    it->failed = 1;
+
+    return closeProducts(it);
+}
+
+/*Takes the cache's read lock and returns 0 if the cache is loaded, otherwise lets go of the lock again and returns 1*/
+int lockLoadedCache(){
+
+    pthread_rwlock_rdlock(&productCacheLock);
+
+    if(!productCache.loaded){
+        pthread_rwlock_unlock(&productCacheLock);
+        return 1;
+    }
+
+    return 0;
+}
+
+/*Points an iterator at the cached rows, a productID or categoryID of -1 matches every product, returns 1 without touching the iterator if the cache is switched off*/
+int openCachedProducts(int productID, int categoryID, struct productIterator *it){
+
+    if(lockLoadedCache() != 0){
+        return 1;
+    }
+
+    /*Rows are read by productID rather than position as writes can move them between chunks*/
+    it->source = PRODUCTS_FROM_CACHE;
+    it->categoryID = categoryID;
+    it->position = INT_MIN;
+    it->end = INT_MAX;
+
+    if(productID >= 0){
+
+        int row = findLiveCachedRow(productID);
+
+        it->position = productID;
+        it->end = productID + 1;
+
+        /*Like the database lookup, a product without a category link is not found by its productID*/
+        if(row < 0 || productCache.categoryIDs[row] == CATEGORY_NOT_FOUND){
+            it->end = productID;
+        }
+    }
+
+    pthread_rwlock_unlock(&productCacheLock);
+
+    return 0;
+}
+
+/*Points an iterator at one of the registered statements, ready for the caller to bind, returns 1 if the statement is not available*/
+int openStatementProducts(enum statementID id, struct productIterator *it){
+
+    it->res = getStatement(it->db, id);
+
+    if(it->res == NULL){
+        stockMessage(STOCK_ERROR, "SQL error: %s\n", sqlite3_errmsg(it->db));
+        return failProducts(it);
+    }
+
+    return 0;
+}
+
+/*Every stock item whose name matches exactly*/
+int openProductsByName(sqlite3 *db, const char *name, struct productIterator *it){
+
+    startProducts(db, METRIC_FIND_BY_NAME, it);
+
+    if(openStatementProducts(STMT_READ_BY_NAME, it) != 0){
+        return 1;
+    }
+
+    sqlite3_bind_text(it->res, 1, name, -1, SQLITE_TRANSIENT);
+
+    return 0;
+}
+
+/*Every stock item linked to a category*/
+int openProductsByCategory(sqlite3 *db, int categoryID, struct productIterator *it){
+
+    startProducts(db, METRIC_FIND_BY_CATEGORY, it);
+
+    if(openCachedProducts(-1, categoryID, it) == 0){
+        return 0;
+    }
+
+    if(openStatementProducts(STMT_READ_BY_CATEGORY, it) != 0){
+        return 1;
+    }
+
+    sqlite3_bind_int(it->res, 1, categoryID);
+    /*The query leaves out the category as it is the same for every row*/
+    it->categoryID = categoryID;
+
+    return 0;
+}
+
+/*The individual stock item which matches an identifier*/
+int openProductByID(sqlite3 *db, int id, struct productIterator *it){
+
+    startProducts(db, METRIC_READ_BY_ID, it);
+
+    if(openCachedProducts(id, -1, it) == 0){
+        return 0;
+    }
+
+    if(openStatementProducts(STMT_READ_BY_ID, it) != 0){
+        return 1;
+    }
+
+    sqlite3_bind_int(it->res, 1, id);
+
+    return 0;
+}
+
+/*All of the stock which resides in the database*/
+int openAllProducts(sqlite3 *db, struct productIterator *it){
+
+    startProducts(db, METRIC_LIST, it);
+
+    if(openCachedProducts(-1, -1, it) == 0){
+        return 0;
+    }
+
+    if(openStatementProducts(STMT_READ_ALL, it) != 0){
+        return 1;
+    }
+
+    it->mergeLinks = 1;
+
+    return 0;
+}
+
+/*Products at or below their reorder level, read from the partial index so the cost depends on how many are low rather than on the size of the catalogue*/
+int openLowStock(sqlite3 *db, int categoryID, struct productIterator *it){
+
+    startProducts(db, METRIC_LOW_STOCK, it);
+
+    if(openStatementProducts(STMT_LOW_STOCK, it) != 0){
+        return 1;
+    }
+
+    if(categoryID != CATEGORY_NOT_FOUND){
+        sqlite3_bind_int(it->res, 1, categoryID);
+    }
+
+    return 0;
+}
+
+/*Fills the empty bitmap with the products of a category for a filter, or of every category when categoryID is CATEGORY_NOT_FOUND. They are copied from the cache when the iterator holds it and read from the category index otherwise, returns 1 if they could not be read*/
+int loadFilterBitmap(struct productIterator *it, int categoryID, struct productBitmap *bitmap){
+
+    int failed = 0;
+
+    if(it->res == NULL){
+
+        int i;
+
+        for(i=0; i<productCache.categoryBitmapCount && !failed; i++){
+
+            if(categoryID == CATEGORY_NOT_FOUND || i == categoryID){
+
+                struct productBitmap result = {0, 0, NULL};
+
+                failed = combineBitmaps(bitmap, &productCache.categoryBitmaps[i], BITMAP_OR, &result);
+                freeBitmap(bitmap);
+                *bitmap = result;
+            }
+        }
+
+        return failed;
+    }
+
+    sqlite3_stmt *res = getStatement(it->db, categoryID == CATEGORY_NOT_FOUND ? STMT_READ_LINKS : STMT_READ_CATEGORY_LINKS);
+
+    if(res == NULL){
+        stockMessage(STOCK_ERROR, "SQL error: %s\n", sqlite3_errmsg(it->db));
+        return 1;
+    }
+
+    int column = 0;
+    int step = SQLITE_DONE;
+
+    if(categoryID == CATEGORY_NOT_FOUND){
+        column = 1;
+    } else {
+        sqlite3_bind_int(res, 1, categoryID);
+    }
+
+    while(!failed && (step = sqlite3_step(res)) == SQLITE_ROW){
+        failed = bitmapAdd(bitmap, sqlite3_column_int(res, column));
+    }
+
+    if(!failed && step != SQLITE_DONE){
+        stockMessage(STOCK_ERROR, "SQL error: %s\n", sqlite3_errmsg(it->db));
+        failed = 1;
+    }
+
+    releaseStatement(res);
+
+    if(failed){
+        freeBitmap(bitmap);
+    }
+
+    return failed;
+}
+
+/*Works out which products a category filter matches with whole bitmap operations, allOf starts the set and narrows it, anyOf is gathered on its own and narrows it once and noneOf takes products out. Returns 1 if it could not be worked out*/
+int matchCategories(struct productIterator *it, const int *allOf, int allCount, const int *anyOf, int anyCount, const int *noneOf, int noneCount, struct productBitmap *matches){
+
+    struct productBitmap operand = {0, 0, NULL};
+    struct productBitmap any = {0, 0, NULL};
+    int failed = 0;
+    int i;
+
+    for(i=0; i<allCount && !failed; i++){
+        failed = loadFilterBitmap(it, allOf[i], &operand) || applyBitmap(matches, &operand, i == 0 ? BITMAP_OR : BITMAP_AND);
+    }
+
+    for(i=0; i<anyCount && !failed; i++){
+        failed = loadFilterBitmap(it, anyOf[i], &operand) || applyBitmap(&any, &operand, BITMAP_OR);
+    }
+
+    if(anyCount > 0 && !failed){
+        failed = applyBitmap(matches, &any, allCount > 0 ? BITMAP_AND : BITMAP_OR);
+    }
+
+    /*Only taking products out starts from every product that has a category*/
+    if(allCount == 0 && anyCount == 0 && !failed){
+        failed = loadFilterBitmap(it, CATEGORY_NOT_FOUND, matches);
+    }
+
+    for(i=0; i<noneCount && !failed; i++){
+        failed = loadFilterBitmap(it, noneOf[i], &operand) || applyBitmap(matches, &operand, BITMAP_AND_NOT);
+    }
+
+    freeBitmap(&operand);
+    freeBitmap(&any);
+
+    if(failed){
+        freeBitmap(matches);
+    }
+
+    return failed;
+}
+
+/*The filter runs on bitmaps of productIDs, from the cache when it is on and read from the category index otherwise, so its cost follows the size of the categories named rather than the number of conditions*/
+int openCategoryFilter(sqlite3 *db, const int *allOf, int allCount, const int *anyOf, int anyCount, const int *noneOf, int noneCount, struct productIterator *it){
+
+    startProducts(db, METRIC_CATEGORY_FILTER, it);
+
+    if(allCount + anyCount + noneCount == 0){
+        stockMessage(STOCK_ERROR, "A category filter needs at least one category\n");
+        return failProducts(it);
+    }
+
+    /*The cache's bitmaps are combined under its read lock, without the cache each product is read by its productID*/
+    if(lockLoadedCache() != 0 && openStatementProducts(STMT_READ_BY_ID, it) != 0){
+        return 1;
+    }
+
+    it->source = PRODUCTS_FROM_FILTER;
+    it->categoryID = CATEGORY_NOT_FOUND;
+    it->position = 0;
+    it->end = 0;
+
+    struct productBitmap matches = {0, 0, NULL};
+
+    int failed = matchCategories(it, allOf, allCount, anyOf, anyCount, noneOf, noneCount, &matches) != 0 || bitmapToProductIDs(&matches, &it->productIDs, &it->end) != 0;
+
+    if(it->res == NULL){
+        pthread_rwlock_unlock(&productCacheLock);
+    }
+
+    freeBitmap(&matches);
+
+    if(failed){
+        stockMessage(STOCK_ERROR, "The category filter could not be worked out\n");
+        return failProducts(it);
+    }
+
+    return 0;
+}
+
+/*Each page is a fresh indexed query so no read transaction is held between pages*/
+int openProductPage(sqlite3 *db, int categoryID, int afterID, int limit, struct productIterator *it){
+
+    startProducts(db, METRIC_PAGE, it);
+
+    if(openStatementProducts(categoryID == CATEGORY_NOT_FOUND ? STMT_PAGE_ALL : STMT_PAGE_CATEGORY, it) != 0){
+        return 1;
+    }
+
+    sqlite3_bind_int(it->res, 1, afterID);
+    /*One extra row is read to find out whether another page follows*/
+    sqlite3_bind_int(it->res, 2, limit + 1);
+
+    if(categoryID != CATEGORY_NOT_FOUND){
+        sqlite3_bind_int(it->res, 3, categoryID);
+    }
+
+    it->limit = limit;
+
+    return 0;
+}
+
+/*Prefix and substring searches are ordered by where the text starts then by name length, fuzzy ones by how close the spelling is, at most limit products are returned*/
+int openNameSearch(sqlite3 *db, const char *text, enum searchMode mode, int limit, struct productIterator *it){
+
+    startProducts(db, METRIC_SEARCH, it);
+
+    if(strlen(text) < SEARCH_MIN_LENGTH){
+        stockMessage(STOCK_ERROR, "Searches need at least %d characters\n", SEARCH_MIN_LENGTH);
+        return failProducts(it);
+    }
+
+    if(mode == SEARCH_FUZZY){
+        return collectFuzzyMatches(it, text, limit) != 0 ? failProducts(it) : 0;
+    }
+
+    char expression[128];
+    expression[0] = 0;
+
+    if(appendMatchPhrase(expression, sizeof(expression), text, strlen(text)) != 0){
+        stockMessage(STOCK_ERROR, "The search text is too long\n");
+        return failProducts(it);
+    }
+
+    if(openStatementProducts(STMT_SEARCH_NAME, it) != 0){
+        return 1;
+    }
+
+    /*A phrase of three character sequences matches any name containing the text, a prefix search then keeps the names it starts*/
+    sqlite3_bind_text(it->res, 1, expression, -1, SQLITE_TRANSIENT);
+    sqlite3_bind_int(it->res, 2, mode == SEARCH_PREFIX);
+    sqlite3_bind_text(it->res, 3, text, -1, SQLITE_TRANSIENT);
+    sqlite3_bind_int(it->res, 4, limit);
+
+    return 0;
+}
+
+/*Fills product from the row a statement is on*/
+void readStatementRow(struct productIterator *it, struct product *product){
+
+    const char *name = (const char *) sqlite3_column_text(it->res, 1);
+
+    /*Numbers are read in their stored types so none of them is converted to text by sqlite*/
+    it->name = name ? name : "";
+    it->nameLength = sqlite3_column_bytes(it->res, 1);
+    product->productID = sqlite3_column_int(it->res, 0);
+    product->quantity = sqlite3_column_double(it->res, 2);
+    product->price = sqlite3_column_double(it->res, 3);
+    product->categoryID = it->categoryID != CATEGORY_NOT_FOUND ? it->categoryID : columnCategoryID(it->res, 4);
+
+    /*Only a list of categories is text, a single categoryID is never converted*/
+    if(sqlite3_column_type(it->res, 4) == SQLITE_TEXT){
+
+        const char *categories = (const char *) sqlite3_column_text(it->res, 4);
+
+        if(strchr(categories, ',') != NULL){
+            it->categoryList = categories;
+        }
+    }
+}
+
+/*Reads on past the current row while the rows belong to the same product and gathers their categories, the lowest becomes product.categoryID and the step that ended them is held for the next call, returns 1 if memory ran out*/
+int mergeLinkedRows(struct productIterator *it, struct product *product){
+
+    /*The name has to outlive the rows read after it*/
+    if(it->nameLength >= it->heldNameCapacity){
+
+        int capacity = it->nameLength + 1 > 64 ? it->nameLength + 1 : 64;
+        char *name = realloc(it->heldName, capacity);
+
+        if(name == NULL){
+            stockMessage(STOCK_ERROR, "The listing ran out of memory\n");
+            it->failed = 1;
+            return 1;
+        }
+
+        it->heldName = name;
+        it->heldNameCapacity = capacity;
+    }
+
+    memcpy(it->heldName, it->name, it->nameLength);
+    it->heldName[it->nameLength] = 0;
+    it->name = it->heldName;
+
+    int count = 1;
+    int length = snprintf(it->categoryText, sizeof(it->categoryText), "%d", product->categoryID);
+    int step;
+
+    while((step = sqlite3_step(it->res)) == SQLITE_ROW && sqlite3_column_int(it->res, 0) == product->productID){
+
+        int categoryID = columnCategoryID(it->res, 4);
+
+        if(count < MAX_PRODUCT_CATEGORIES){
+            length += snprintf(it->categoryText + length, sizeof(it->categoryText) - length, ",%d", categoryID);
+            count += 1;
+        }
+
+        if(categoryID < product->categoryID){
+            product->categoryID = categoryID;
+        }
+    }
+
+    it->heldStep = step;
+
+    if(count > 1){
+        it->categoryList = it->categoryText;
+    }
+
+    return 0;
+}
+
+/*Cached rows are copied out of the cache this many at a time, the read lock is only held while a chunk is copied*/
+#define CACHE_CHUNK_ROWS 256
+
+/*Rows copied out of the product cache for an iterator, their names and category lists are kept in text*/
+struct cachedChunk{
+
+    int count;
+    int next;
+    int productIDs[CACHE_CHUNK_ROWS];
+    int categoryIDs[CACHE_CHUNK_ROWS];
+    double prices[CACHE_CHUNK_ROWS];
+    double quantities[CACHE_CHUNK_ROWS];
+    int nameOffsets[CACHE_CHUNK_ROWS];
+    int nameLengths[CACHE_CHUNK_ROWS];
+    /*-1 when the product has only the category in categoryIDs*/
+    int categoryOffsets[CACHE_CHUNK_ROWS];
+    char *text;
+    int textLength;
+    int textCapacity;
+};
+
+/*Copies one cached row into the chunk along with every category whose bitmap holds it, the caller holds the read lock, returns 1 if memory ran out*/
+int copyCachedRow(struct cachedChunk *chunk, int row){
+
+    int productID = productCache.productIDs[row];
+    int categoryID = productCache.categoryIDs[row];
+    char categories[CATEGORY_LIST_LENGTH];
+    int found = 0;
+    int length = 0;
+    int i;
+
+    for(i=categoryID; i >= 0 && i<productCache.categoryBitmapCount && found < MAX_PRODUCT_CATEGORIES; i++){
+
+        if(bitmapContains(&productCache.categoryBitmaps[i], productID)){
+            length += snprintf(categories + length, sizeof(categories) - length, found > 0 ? ",%d" : "%d", i);
+            found += 1;
+        }
+    }
+
+    int nameLength = productCache.nameLengths[row];
+    int needed = chunk->textLength + nameLength + (found > 1 ? length + 1 : 0);
+
+    if(needed > chunk->textCapacity){
+
+        int capacity = chunk->textCapacity > 0 ? chunk->textCapacity : 4096;
+
+        while(capacity < needed){
+            capacity *= 2;
+        }
+
+        char *text = realloc(chunk->text, capacity);
+
+        if(text == NULL){
+            return 1;
+        }
+
+        chunk->text = text;
+        chunk->textCapacity = capacity;
+    }
+
+    int n = chunk->count++;
+
+    chunk->productIDs[n] = productID;
+    chunk->categoryIDs[n] = categoryID;
+    chunk->prices[n] = productCache.prices[row];
+    chunk->quantities[n] = productCache.quantities[row];
+    chunk->nameOffsets[n] = chunk->textLength;
+    chunk->nameLengths[n] = nameLength;
+    memcpy(chunk->text + chunk->textLength, productCache.names + productCache.nameOffsets[row], nameLength);
+    chunk->textLength += nameLength;
+    chunk->categoryOffsets[n] = -1;
+
+    if(found > 1){
+        chunk->categoryOffsets[n] = chunk->textLength;
+        memcpy(chunk->text + chunk->textLength, categories, length + 1);
+        chunk->textLength += length + 1;
+    }
+
+    return 0;
+}
+
+/*Copies the next chunk of an iterator's rows out of the cache, an empty chunk means the listing is finished, returns 1 if it could not be read*/
+int fillCachedChunk(struct productIterator *it){
+
+    if(it->chunk == NULL){
+
+        it->chunk = calloc(1, sizeof(struct cachedChunk));
+
+        if(it->chunk == NULL){
+            stockMessage(STOCK_ERROR, "The listing ran out of memory\n");
+            return 1;
+        }
+    }
+
+    struct cachedChunk *chunk = it->chunk;
+
+    chunk->count = 0;
+    chunk->next = 0;
+    chunk->textLength = 0;
+
+    /*A reload that failed part way through the listing leaves the cache switched off*/
+    if(lockLoadedCache() != 0){
+        stockMessage(STOCK_ERROR, "The product cache was switched off during the listing\n");
+        return 1;
+    }
+
+    int failed = 0;
+
+    if(it->source == PRODUCTS_FROM_FILTER){
+
+        while(!failed && chunk->count < CACHE_CHUNK_ROWS && it->position < it->end){
+
+            /*A product deleted after the filter was worked out is skipped*/
+            int row = findLiveCachedRow(it->productIDs[it->position++]);
+
+            if(row >= 0){
+                failed = copyCachedRow(chunk, row);
+            }
+        }
+
+    } else if(it->categoryID != CATEGORY_NOT_FOUND){
+
+        /*Only the products in the category's bitmap are looked at, so a listing of a small category does not walk the whole cache. A product is listed under every category whose bitmap holds it, not only the one in its row*/
+        const struct productBitmap *bitmap = it->categoryID < productCache.categoryBitmapCount ? &productCache.categoryBitmaps[it->categoryID] : NULL;
+
+        while(!failed && chunk->count < CACHE_CHUNK_ROWS && it->position < it->end){
+
+            int productID = bitmap == NULL ? -1 : nextBitmapProduct(bitmap, it->position);
+
+            if(productID < 0 || productID >= it->end){
+                it->position = it->end;
+                break;
+            }
+
+            it->position = productID + 1;
+
+            int row = findLiveCachedRow(productID);
+
+            if(row >= 0){
+                failed = copyCachedRow(chunk, row);
+            }
+        }
+
+    } else {
+
+        int found;
+        int row;
+
+        for(row = findCachedRow(it->position, &found); !failed && chunk->count < CACHE_CHUNK_ROWS && row < productCache.count && productCache.productIDs[row] < it->end; row++){
+
+            if(productCache.deleted[row]){
+                continue;
+            }
+
+            failed = copyCachedRow(chunk, row);
+        }
+
+        it->position = row < productCache.count ? productCache.productIDs[row] : it->end;
+    }
+
+    pthread_rwlock_unlock(&productCacheLock);
+
+    if(failed){
+        stockMessage(STOCK_ERROR, "The listing ran out of memory\n");
+    }
+
+    return failed;
+}
+
+/*Hands out the next row copied from the cache, copying another chunk once this one is used up, returns 0 at the end*/
+int readChunkRow(struct productIterator *it, struct product *product){
+
+    if(it->chunk == NULL || it->chunk->next == it->chunk->count){
+
+        if(fillCachedChunk(it) != 0){
+            it->failed = 1;
+            return 0;
+        }
+
+        if(it->chunk->count == 0){
+            return 0;
+        }
+    }
+
+    struct cachedChunk *chunk = it->chunk;
+    int n = chunk->next++;
+
+    it->name = chunk->text + chunk->nameOffsets[n];
+    it->nameLength = chunk->nameLengths[n];
+    product->productID = chunk->productIDs[n];
+    product->quantity = chunk->quantities[n];
+    product->price = chunk->prices[n];
+    product->categoryID = chunk->categoryIDs[n];
+
+    if(chunk->categoryOffsets[n] >= 0){
+        it->categoryList = chunk->text + chunk->categoryOffsets[n];
+    }
+
+    return 1;
+}
+
+/*Reads the next row from wherever the iterator takes its products, returns 0 at the end*/
+int readNextProduct(struct productIterator *it, struct product *product){
+
+    it->categoryList = NULL;
+
+    switch(it->source){
+
+        case PRODUCTS_FROM_STATEMENT: {
+
+            int step = it->heldStep ? it->heldStep : sqlite3_step(it->res);
+
+            it->heldStep = 0;
+
+            if(step != SQLITE_ROW){
+                if(step != SQLITE_DONE){
+                    stockMessage(STOCK_ERROR, "SQL error: %s\n", sqlite3_errmsg(it->db));
+                    it->failed = 1;
+                }
+                return 0;
+            }
+
+            readStatementRow(it, product);
+
+            if(it->mergeLinks && mergeLinkedRows(it, product) != 0){
+                return 0;
+            }
+            break;
+        }
+
+        case PRODUCTS_FROM_CACHE: {
+
+            if(!readChunkRow(it, product)){
+                return 0;
+            }
+            break;
+        }
+
+        case PRODUCTS_FROM_FILTER: {
+
+            /*Without a statement the filter was worked out from the cache*/
+            if(it->res == NULL){
+
+                if(!readChunkRow(it, product)){
+                    return 0;
+                }
+                break;
+            }
+
+            int found = 0;
+
+            /*A product deleted after the filter was worked out is skipped*/
+            while(!found && it->position < it->end){
+
+                int productID = it->productIDs[it->position++];
+
+                sqlite3_reset(it->res);
+                sqlite3_bind_int(it->res, 1, productID);
+
+                int step = sqlite3_step(it->res);
+
+                if(step == SQLITE_ROW){
+                    readStatementRow(it, product);
+                    found = 1;
+                } else if(step != SQLITE_DONE){
+                    stockMessage(STOCK_ERROR, "SQL error: %s\n", sqlite3_errmsg(it->db));
+                    it->failed = 1;
+                    return 0;
+                }
+            }
+
+            if(!found){
+                return 0;
+            }
+            break;
+        }
+
+        case PRODUCTS_FROM_SNAPSHOT: {
+
+            if(it->position >= it->end){
+                return 0;
+            }
+
+            const struct catalogSnapshot *snapshot = it->snapshot;
+            uint32_t row = it->snapshotRows != NULL ? it->snapshotRows[it->position] : (uint32_t) it->position;
+
+            it->position += 1;
+
+            /*Rows and offsets are only checked as they are used, so a damaged file ends the listing or gives an empty name rather than a read outside the mapping*/
+            if(row >= (uint32_t) snapshot->productCount){
+                stockMessage(STOCK_ERROR, "The snapshot is damaged\n");
+                it->failed = 1;
+                return 0;
+            }
+
+            uint32_t offset = snapshot->nameOffsets[row];
+            uint32_t next = snapshot->nameOffsets[row + 1];
+
+            if(next <= offset || next > snapshot->namesSize){
+                offset = next = 0;
+            }
+
+            it->name = snapshot->names + offset;
+            it->nameLength = next > offset ? next - offset - 1 : 0;
+            product->productID = snapshot->productIDs[row];
+            product->quantity = snapshot->quantities[row];
+            product->price = snapshot->prices[row];
+            product->categoryID = snapshot->categoryIDs[row];
+
+            uint32_t link = snapshot->linkStarts[row];
+            uint32_t linkEnd = snapshot->linkStarts[row + 1];
+
+            /*A damaged range of links is left out, the product then shows only the category in its row*/
+            if(linkEnd > link + 1 && linkEnd <= snapshot->linkCount){
+
+                int length = 0;
+                int found;
+
+                for(found = 0; link < linkEnd && found < MAX_PRODUCT_CATEGORIES; link++, found++){
+                    length += snprintf(it->categoryText + length, sizeof(it->categoryText) - length, found > 0 ? ",%d" : "%d", snapshot->links[link]);
+                }
+
+                it->categoryList = it->categoryText;
+            }
+            break;
+        }
+
+        case PRODUCTS_FROM_ARRAY: {
+
+            if(it->position == it->end){
+                return 0;
+            }
+
+            struct fuzzyCandidate *candidate = &it->candidates[it->position++];
+
+            it->name = candidate->name;
+            it->nameLength = candidate->nameLength;
+            product->productID = candidate->productID;
+            product->quantity = candidate->quantity;
+            product->price = candidate->price;
+            product->categoryID = candidate->categoryID;
+            it->categoryList = strchr(candidate->categories, ',') != NULL ? candidate->categories : NULL;
+            break;
+        }
+    }
+
+    /*Cached and searched names are not NUL terminated, so the struct gets its own copy cut to fit*/
+    int length = it->nameLength < (int) sizeof(product->name) - 1 ? it->nameLength : (int) sizeof(product->name) - 1;
+
+    memcpy(product->name, it->name, length);
+    product->name[length] = 0;
+
+    return 1;
+}
+
+/*Fills product with the next row, returns 0 when there are no more*/
+int nextProduct(struct productIterator *it, struct product *product){
+
+    if(it->done){
+        return 0;
+    }
+
+    if(!readNextProduct(it, product)){
+        it->done = 1;
+        return 0;
+    }
+
+    /*The row read past the limit is only there to show that more follow*/
+    if(it->limit >= 0 && it->rows == it->limit){
+        it->more = 1;
+        it->done = 1;
+        return 0;
+    }
+
+    it->rows += 1;
+
+    return 1;
+}
+
+/*Lets go of whatever the iterator was reading from and records the operation*/
+int closeProducts(struct productIterator *it){
+
+    switch(it->source){
+
+        case PRODUCTS_FROM_STATEMENT:
+            releaseStatement(it->res);
+            break;
+
+        case PRODUCTS_FROM_CACHE:
+            break;
+
+        case PRODUCTS_FROM_ARRAY:
+            free(it->candidates);
+            break;
+
+        case PRODUCTS_FROM_SNAPSHOT:
+            break;
+
+        case PRODUCTS_FROM_FILTER:
+            free(it->productIDs);
+            it->productIDs = NULL;
+            releaseStatement(it->res);
+            break;
+    }
+
+    if(it->chunk != NULL){
+        free(it->chunk->text);
+        free(it->chunk);
+        it->chunk = NULL;
+    }
+
+    free(it->heldName);
+    it->heldName = NULL;
+    it->done = 1;
+
+    return endMetric(it->metric, &it->started, it->rows, it->failed);
+}
+
+/*Reads a single product, returns 1 if it does not exist or could not be read*/
+int getProductByID(sqlite3 *db, int id, struct product *product){
+
+    struct productIterator it;
+
+    if(openProductByID(db, id, &it) != 0){
+        return 1;
+    }
+
+    int found = nextProduct(&it, product);
+
+    return closeProducts(&it) != 0 || !found;
+}
+
+/*Answers from the cache when it is on, otherwise with an indexed EXISTS that stops at the first link rather than reading the product*/
+int productExists(sqlite3 *db, int id){
+
+    int exists = cachedProductExists(id);
+
+    if(exists >= 0){
+        return exists;
+    }
+
+    sqlite3_stmt *res = getStatement(db, STMT_CHECK_BY_ID);
+
+    if(res == NULL){
+        stockMessage(STOCK_ERROR, "SQL error: %s\n", sqlite3_errmsg(db));
+        return -1;
+    }
+
+    sqlite3_bind_int(res, 1, id);
+
+    exists = sqlite3_step(res) == SQLITE_ROW ? sqlite3_column_int(res, 0) : -1;
+
+    releaseStatement(res);
+
+    return exists;
+}
+
+/*Finds where the page ending just before beforeID starts, afterID is set so openProductPage reads that page and is PAGE_FIRST when it is the first page, returns 1 if no products come before beforeID*/
+int findPreviousPage(sqlite3 *db, int categoryID, int beforeID, int pageSize, int *afterID){
+
+    sqlite3_stmt *res = getStatement(db, categoryID == CATEGORY_NOT_FOUND ? STMT_PAGE_ALL_START : STMT_PAGE_CATEGORY_START);
+
+    if(res == NULL){
+        stockMessage(STOCK_ERROR, "SQL error: %s\n", sqlite3_errmsg(db));
+        return 1;
+    }
+
+    sqlite3_bind_int(res, 1, beforeID);
+    sqlite3_bind_int(res, 2, pageSize);
+
+    if(categoryID != CATEGORY_NOT_FOUND){
+        sqlite3_bind_int(res, 3, categoryID);
+    }
+
+    int found = 0;
+
+    /*min() over an empty page gives NULL*/
+    if(sqlite3_step(res) == SQLITE_ROW && sqlite3_column_type(res, 0) != SQLITE_NULL){
+
+        /*Without a row before the page the page is the first one*/
+        *afterID = sqlite3_column_int(res, 1) > pageSize ? sqlite3_column_int(res, 0) : PAGE_FIRST;
+        found = 1;
+    }
+
+    releaseStatement(res);
+
+    return !found;
+}
+
+/*Rows handled per block by the cached report, small enough that a block's values stay in the L1 cache*/
+#define REPORT_BLOCK_SIZE 1024
+
+/*Sets every bucket to empty, bucket 0 collects products without a known category and bucket categoryID + 1 holds each category*/
+void clearCategoryTotals(struct categoryTotals *totals, int bucketCount){
+
+    int i;
+
+    for(i=0; i<bucketCount; i++){
+        totals[i].products = 0;
+        totals[i].units = 0;
+        totals[i].value = 0;
+        totals[i].lowPrice = INFINITY;
+        totals[i].highPrice = -INFINITY;
+    }
+}
+
+/*Maps a categoryID onto its report bucket, unknown categories share bucket 0 with products that have none*/
+int reportBucket(int categoryID){
+
+    return (unsigned int) categoryID < (unsigned int) categories.size ? categoryID + 1 : 0;
+}
+
+/*Adds up the cached columns in one pass, returns 1 if the cache is switched off*/
+int aggregateCachedProducts(struct categoryTotals *totals, int bucketCount){
+
+    double values[REPORT_BLOCK_SIZE];
+    double live[REPORT_BLOCK_SIZE];
+    int buckets[REPORT_BLOCK_SIZE];
+    int start, i;
+
+    pthread_rwlock_rdlock(&productCacheLock);
+
+    if(!productCache.loaded){
+        pthread_rwlock_unlock(&productCacheLock);
+        return 1;
+    }
+
+    clearCategoryTotals(totals, bucketCount);
+
+    const double *prices = productCache.prices;
+    const double *quantities = productCache.quantities;
+    const int *categoryIDs = productCache.categoryIDs;
+    const char *deleted = productCache.deleted;
+    unsigned int size = categories.size;
+
+    for(start=0; start<productCache.count; start += REPORT_BLOCK_SIZE){
+
+        int length = productCache.count - start < REPORT_BLOCK_SIZE ? productCache.count - start : REPORT_BLOCK_SIZE;
+
+        /*Straight line loops over contiguous arrays with no branches, so the compiler can turn them into vector instructions*/
+        for(i=0; i<length; i++){
+            live[i] = 1.0 - deleted[start + i];
+        }
+        for(i=0; i<length; i++){
+            values[i] = prices[start + i] * quantities[start + i] * live[i];
+        }
+        for(i=0; i<length; i++){
+            unsigned int categoryID = categoryIDs[start + i];
+            buckets[i] = categoryID < size ? categoryID + 1 : 0;
+        }
+
+        /*Only the scatter into the buckets is left as a scalar loop, deleted rows add nothing and never move a price band*/
+        for(i=0; i<length; i++){
+
+            struct categoryTotals *bucket = &totals[buckets[i]];
+            double price = prices[start + i];
+            int isLive = deleted[start + i] == 0;
+
+            bucket->products += isLive;
+            bucket->units += quantities[start + i] * live[i];
+            bucket->value += values[i];
+            bucket->lowPrice = isLive && price < bucket->lowPrice ? price : bucket->lowPrice;
+            bucket->highPrice = isLive && price > bucket->highPrice ? price : bucket->highPrice;
+        }
+    }
+
+    pthread_rwlock_unlock(&productCacheLock);
+
+    return 0;
+}
+
+/*Adds up every category with a single GROUP BY in sqlite, returns 1 if the query failed*/
+int aggregateStoredProducts(sqlite3 *db, struct categoryTotals *totals, int bucketCount){
+
+    sqlite3_stmt *res = getStatement(db, STMT_CATEGORY_REPORT);
+
+    if(res == NULL){
+        stockMessage(STOCK_ERROR, "SQL error: %s\n", sqlite3_errmsg(db));
+        return 1;
+    }
+
+    clearCategoryTotals(totals, bucketCount);
+
+    int step;
+
+    while((step = sqlite3_step(res)) == SQLITE_ROW){
+
+        struct categoryTotals *bucket = &totals[reportBucket(columnCategoryID(res, 0))];
+        double lowPrice = sqlite3_column_double(res, 4);
+        double highPrice = sqlite3_column_double(res, 5);
+
+        bucket->products += sqlite3_column_int64(res, 1);
+        bucket->units += sqlite3_column_double(res, 2);
+        bucket->value += sqlite3_column_double(res, 3);
+        bucket->lowPrice = lowPrice < bucket->lowPrice ? lowPrice : bucket->lowPrice;
+        bucket->highPrice = highPrice > bucket->highPrice ? highPrice : bucket->highPrice;
+    }
+
+    releaseStatement(res);
+
+    if(step != SQLITE_DONE){
+        stockMessage(STOCK_ERROR, "SQL error: %s\n", sqlite3_errmsg(db));
+        return 1;
+    }
+
+    return 0;
+}
+
+/*Tracks the transaction used by write operations, so operations can be nested and many of them can share one commit*/
+struct writeState{
+
+    /*Number of logical operations currently open, only the outermost one begins and ends the transaction*/
+    int depth;
+    /*Set when any part of the current operation fails so the whole operation is rolled back*/
+    int failed;
+    /*Group commit settings, groupLimit is 0 when every operation commits on its own*/
+    int groupLimit;
+    int groupMillis;
+    /*Whether a group transaction is open, and how many operations it holds*/
+    int groupOpen;
+    int groupCount;
+    struct timespec groupStart;
+    /*Groups that have ended and how many of them were rolled back, so a caller can tell which operations a commit covered*/
+    long groupsEnded;
+    long groupsFailed;
+};
+
+static struct writeState writes = {0};
+
+/*Runs a transaction control statement, printing the error if it fails*/
+int execControl(sqlite3 *db, const char *command){
+
+    char *errMsg = 0;
+
+    if(sqlite3_exec(db, command, 0, 0, &errMsg) != SQLITE_OK){
+        stockMessage(STOCK_ERROR, "SQL error: %s\n", errMsg);
+        sqlite3_free(errMsg);
+        return 1;
+    }
+
+    return 0;
+}
+
+/*Commits the open group transaction, if the commit fails every operation in the group is lost and the failure is returned*/
+int commitGroup(sqlite3 *db){
+
+    int failed = 0;
+
+    if(!writes.groupOpen){
+        return 0;
+    }
+
+    if(execControl(db, "COMMIT") != 0){
+        stockMessage(STOCK_ERROR, "%d grouped changes were rolled back\n", writes.groupCount);
+        sqlite3_exec(db, "ROLLBACK", 0, 0, 0);
+        reloadProductCache(db);
+        failed = 1;
+    }
+
+    writes.groupOpen = 0;
+    writes.groupCount = 0;
+    writes.groupsEnded += 1;
+    writes.groupsFailed += failed;
+
+    return failed;
+}
+
+/*Fills progress with the groups ended so far and the operations still waiting in the open group*/
+void getGroupProgress(struct groupProgress *progress){
+
+    progress->ended = writes.groupsEnded;
+    progress->failed = writes.groupsFailed;
+    progress->pending = writes.groupOpen ? writes.groupCount : 0;
+}
+
+/*Lets up to maxOperations write operations, or as many as happen within maxMillis, share a single commit*/
+void startGroupCommit(int maxOperations, int maxMillis){
+
+    writes.groupLimit = maxOperations;
+    writes.groupMillis = maxMillis;
+}
+
+/*Commits anything still pending and goes back to committing every operation on its own*/
+int finishGroupCommit(sqlite3 *db){
+
+    writes.groupLimit = 0;
+
+    return commitGroup(db);
+}
+
+/*Starts a logical write operation, everything up to the matching endWrite is applied atomically*/
+int beginWrite(sqlite3 *db){
+
+    if(writes.depth++ > 0){
+        return 0;
+    }
+
+    writes.failed = 0;
+    productCache.changedInWrite = 0;
+
+    if(writes.groupLimit == 0){
+
+        if(execControl(db, "BEGIN IMMEDIATE") != 0){
+            writes.depth = 0;
+            return 1;
+        }
+
+        return 0;
+    }
+
+    if(!writes.groupOpen){
+
+        if(execControl(db, "BEGIN IMMEDIATE") != 0){
+            writes.depth = 0;
+            return 1;
+        }
+
+        writes.groupOpen = 1;
+        clock_gettime(CLOCK_MONOTONIC, &writes.groupStart);
+    }
+
+    /*Inside a group each operation gets its own savepoint so a failure only undoes that operation*/
+    if(execControl(db, "SAVEPOINT write_operation") != 0){
+        writes.depth = 0;
+        return 1;
+    }
+
+    return 0;
+}
+
+/*Ends a logical write operation, failed is non zero when the caller's part of the operation went wrong, returns 1 if the operation was not applied*/
+int endWrite(sqlite3 *db, int failed){
+
+    if(failed){
+        writes.failed = 1;
+    }
+
+    if(--writes.depth > 0){
+        return failed;
+    }
+
+    if(writes.groupLimit == 0){
+
+        if(writes.failed){
+            sqlite3_exec(db, "ROLLBACK", 0, 0, 0);
+            /*Nested operations that succeeded have already written through to the cache*/
+            if(productCache.changedInWrite){
+                reloadProductCache(db);
+            }
+            return 1;
+        }
+
+        if(execControl(db, "COMMIT") != 0){
+            sqlite3_exec(db, "ROLLBACK", 0, 0, 0);
+            reloadProductCache(db);
+            return 1;
+        }
+
+        return 0;
+    }
+
+    if(writes.failed){
+        sqlite3_exec(db, "ROLLBACK TO write_operation", 0, 0, 0);
+        sqlite3_exec(db, "RELEASE write_operation", 0, 0, 0);
+        if(productCache.changedInWrite){
+            reloadProductCache(db);
+        }
+        return 1;
+    }
+
+    if(execControl(db, "RELEASE write_operation") != 0){
+        return 1;
+    }
+
+    writes.groupCount += 1;
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    long elapsed = (now.tv_sec - writes.groupStart.tv_sec) * 1000 + (now.tv_nsec - writes.groupStart.tv_nsec) / 1000000;
+
+    if(writes.groupCount >= writes.groupLimit || elapsed >= writes.groupMillis){
+        return commitGroup(db);
+    }
+
+    return 0;
+}
+
+/*Steps a bound write statement and resets it, returns 1 and prints the error if the statement failed*/
+int stepWrite(sqlite3 *db, sqlite3_stmt *res){
+
+    if(res == NULL){
+        stockMessage(STOCK_ERROR, "SQL error: %s\n", sqlite3_errmsg(db));
+        return 1;
+    }
+
+    int rc = sqlite3_step(res);
+
+    if(rc != SQLITE_DONE){
+        stockMessage(STOCK_ERROR, "SQL error: %s\n", sqlite3_errmsg(db));
+    }
+
+    releaseStatement(res);
+
+    return rc != SQLITE_DONE;
+}
+
+/*Function used to change the product name given the productID of the product*/
+int changeProductName(sqlite3 *db, int id, const char *name){
+
+    struct timespec started = startMetric();
+
+    if(beginWrite(db) != 0){
+        return endMetric(METRIC_CHANGE_NAME, &started, 0, 1);
+    }
+
+    /*The old name leaves the text index before the row changes and the new one is added after*/
+    sqlite3_stmt *res = getStatement(db, STMT_UNINDEX_NAME);
+
+    if(res != NULL){
+        sqlite3_bind_int(res, 1, id);
+    }
+
+    int failed = stepWrite(db, res);
+
+    if(!failed){
+
+        res = getStatement(db, STMT_UPDATE_NAME);
+
+        if(res != NULL){
+            sqlite3_bind_text(res, 1, name, -1, SQLITE_STATIC);
+            sqlite3_bind_int(res, 2, id);
+        }
+
+        failed = stepWrite(db, res);
+    }
+
+    int changed = sqlite3_changes(db);
+
+    /*No row changes when the product does not exist*/
+    if(!failed && changed == 0){
+        stockMessage(STOCK_ERROR, "No stock item has the id %d\n", id);
+        failed = 1;
+    }
+
+    if(!failed){
+
+        res = getStatement(db, STMT_INDEX_NAME);
+
+        if(res != NULL){
+            sqlite3_bind_int(res, 1, id);
+            sqlite3_bind_text(res, 2, name, -1, SQLITE_STATIC);
+        }
+
+        failed = stepWrite(db, res);
+    }
+
+    if(endWrite(db, failed) != 0){
+        return endMetric(METRIC_CHANGE_NAME, &started, 0, 1);
+    }
+
+    cacheSetName(id, name);
+
+    return endMetric(METRIC_CHANGE_NAME, &started, changed, 0);
+}
+
+/*Function used to change the product price give the productID of the product*/
+int changeProductPrice(sqlite3 *db, int id, double price){
+
+    struct timespec started = startMetric();
+
+    if(beginWrite(db) != 0){
+        return endMetric(METRIC_CHANGE_PRICE, &started, 0, 1);
+    }
+
+    sqlite3_stmt *res = getStatement(db, STMT_UPDATE_PRICE);
+
+    if(res != NULL){
+        sqlite3_bind_double(res, 1, price);
+        sqlite3_bind_int(res, 2, id);
+    }
+
+    int failed = stepWrite(db, res);
+
+    if(!failed && sqlite3_changes(db) == 0){
+        stockMessage(STOCK_ERROR, "No stock item has the id %d\n", id);
+        failed = 1;
+    }
+
+    if(endWrite(db, failed) != 0){
+        return endMetric(METRIC_CHANGE_PRICE, &started, 0, 1);
+    }
+
+    cacheSetPrice(id, price);
+
+    return endMetric(METRIC_CHANGE_PRICE, &started, 1, 0);
+}
+
+/*Function used to change the quantity of the stock item given the productID of the product*/
+int changeProductQuantity(sqlite3 *db, int id, double quantity){
+
+    struct timespec started = startMetric();
+
+    if(beginWrite(db) != 0){
+        return endMetric(METRIC_CHANGE_QUANTITY, &started, 0, 1);
+    }
+
+    /*The ledger entry is worked out from the quantity being replaced, so it is written first*/
+    sqlite3_stmt *res = getStatement(db, STMT_RECORD_SET_MOVEMENT);
+
+    if(res != NULL){
+        sqlite3_bind_int(res, 1, id);
+        sqlite3_bind_double(res, 2, quantity);
+    }
+
+    int failed = stepWrite(db, res);
+
+    if(!failed){
+
+        res = getStatement(db, STMT_UPDATE_QUANTITY);
+
+        if(res != NULL){
+            sqlite3_bind_double(res, 1, quantity);
+            sqlite3_bind_int(res, 2, id);
+        }
+
+        failed = stepWrite(db, res);
+
+        if(!failed && sqlite3_changes(db) == 0){
+            stockMessage(STOCK_ERROR, "No stock item has the id %d\n", id);
+            failed = 1;
+        }
+    }
+
+    if(endWrite(db, failed) != 0){
+        return endMetric(METRIC_CHANGE_QUANTITY, &started, 0, 1);
+    }
+
+    cacheSetQuantity(id, quantity);
+
+    return endMetric(METRIC_CHANGE_QUANTITY, &started, 1, 0);
+}
+
+/*Adds delta to the quantity of a product and records it in the ledger. The quantity is changed inside sqlite so adjustments made at the same time add up rather than overwrite each other*/
+int adjustProductQuantity(sqlite3 *db, int id, double delta, const char *reason, double *quantity){
+
+    struct timespec started = startMetric();
+
+    if(beginWrite(db) != 0){
+        return endMetric(METRIC_ADJUST_QUANTITY, &started, 0, 1);
+    }
+
+    sqlite3_stmt *res = getStatement(db, STMT_ADJUST_QUANTITY);
+    double newQuantity = 0;
+    double reorderLevel = 0;
+    int lowStock = 0;
+    int adjusted = 0;
+    int failed = 0;
+
+    if(res == NULL){
+        stockMessage(STOCK_ERROR, "SQL error: %s\n", sqlite3_errmsg(db));
+        failed = 1;
+    } else {
+
+        sqlite3_bind_double(res, 1, delta);
+        sqlite3_bind_int(res, 2, id);
+
+        int rc = sqlite3_step(res);
+
+        if(rc == SQLITE_ROW){
+
+            newQuantity = sqlite3_column_double(res, 0);
+            adjusted = 1;
+
+            /*The level comes back with the new quantity, so a sale that runs the stock low is spotted without another query*/
+            if(delta < 0 && sqlite3_column_type(res, 1) != SQLITE_NULL && newQuantity <= sqlite3_column_double(res, 1)){
+                lowStock = 1;
+                reorderLevel = sqlite3_column_double(res, 1);
+            }
+
+            rc = sqlite3_step(res);
+        }
+
+        if(rc != SQLITE_DONE){
+            stockMessage(STOCK_ERROR, "SQL error: %s\n", sqlite3_errmsg(db));
+            failed = 1;
+        }
+
+        releaseStatement(res);
+    }
+
+    /*No row comes back when the product is missing or the change would leave less than nothing in stock, only then is it looked up to tell the two apart*/
+    if(!failed && !adjusted){
+
+        int exists = delta < 0 ? productExists(db, id) : 0;
+
+        if(exists > 0){
+            stockMessage(STOCK_ERROR, "Product %d does not have %g in stock\n", id, -delta);
+        } else if(exists == 0){
+            stockMessage(STOCK_ERROR, "No stock item has the id %d\n", id);
+        }
+        failed = 1;
+    }
+
+    if(!failed){
+
+        res = getStatement(db, STMT_RECORD_MOVEMENT);
+
+        if(res != NULL){
+            sqlite3_bind_int(res, 1, id);
+            sqlite3_bind_double(res, 2, delta);
+            sqlite3_bind_text(res, 3, reason, -1, SQLITE_STATIC);
+        }
+
+        failed = stepWrite(db, res);
+    }
+
+    if(endWrite(db, failed) != 0){
+        return endMetric(METRIC_ADJUST_QUANTITY, &started, 0, 1);
+    }
+
+    cacheSetQuantity(id, newQuantity);
+
+    if(lowStock){
+        stockMessage(STOCK_NOTICE, "Product %d is down to %g, at or below its reorder level of %g\n", id, newQuantity, reorderLevel);
+    }
+
+    if(quantity != NULL){
+        *quantity = newQuantity;
+    }
+
+    return endMetric(METRIC_ADJUST_QUANTITY, &started, 1, 0);
+}
+
+/*Binds a reorder level, NAN is bound as NULL which means no level*/
+void bindReorderLevel(sqlite3_stmt *res, int index, double level){
+
+    if(isnan(level)){
+        sqlite3_bind_null(res, index);
+    } else {
+        sqlite3_bind_double(res, index, level);
+    }
+}
+
+/*Gives a product a reorder level of its own, or with NAN hands it back to its category's level*/
+int setProductReorderLevel(sqlite3 *db, int id, double level){
+
+    struct timespec started = startMetric();
+
+    if(beginWrite(db) != 0){
+        return endMetric(METRIC_REORDER_LEVEL, &started, 0, 1);
+    }
+
+    sqlite3_stmt *res = getStatement(db, STMT_SET_PRODUCT_REORDER);
+
+    if(res != NULL){
+        bindReorderLevel(res, 1, level);
+        sqlite3_bind_int(res, 2, id);
+    }
+
+    int failed = stepWrite(db, res);
+
+    if(!failed && sqlite3_changes(db) == 0){
+        stockMessage(STOCK_ERROR, "No stock item has the id %d\n", id);
+        failed = 1;
+    }
+
+    if(endWrite(db, failed) != 0){
+        return endMetric(METRIC_REORDER_LEVEL, &started, 0, 1);
+    }
+
+    return endMetric(METRIC_REORDER_LEVEL, &started, 1, 0);
+}
+
+/*Sets the reorder level of a category and copies it to every product in the category that has no level of its own*/
+int setCategoryReorderLevel(sqlite3 *db, int categoryID, double level){
+
+    struct timespec started = startMetric();
+
+    if(beginWrite(db) != 0){
+        return endMetric(METRIC_REORDER_LEVEL, &started, 0, 1);
+    }
+
+    sqlite3_stmt *res = getStatement(db, STMT_SET_CATEGORY_REORDER);
+
+    if(res != NULL){
+        bindReorderLevel(res, 1, level);
+        sqlite3_bind_int(res, 2, categoryID);
+    }
+
+    int failed = stepWrite(db, res);
+    int changed = 0;
+
+    if(!failed){
+
+        res = getStatement(db, STMT_APPLY_CATEGORY_REORDER);
+
+        if(res != NULL){
+            sqlite3_bind_int(res, 1, categoryID);
+        }
+
+        failed = stepWrite(db, res);
+        changed = sqlite3_changes(db);
+    }
+
+    if(endWrite(db, failed) != 0){
+        return endMetric(METRIC_REORDER_LEVEL, &started, 0, 1);
+    }
+
+    return endMetric(METRIC_REORDER_LEVEL, &started, changed, 0);
+}
+
+/*Links a product to a category, linking it again changes nothing*/
+int linkProductCategory(sqlite3 *db, int id, int categoryID){
+
+    sqlite3_stmt *res = getStatement(db, STMT_LINK_CATEGORY);
+
+    if(res != NULL){
+        sqlite3_bind_int(res, 1, id);
+        sqlite3_bind_int(res, 2, categoryID);
+    }
+
+    return stepWrite(db, res);
+}
+
+/*A product without a reorder level of its own takes the level of its lowest category, run once its links have changed*/
+int inheritReorderLevel(sqlite3 *db, int id){
+
+    sqlite3_stmt *res = getStatement(db, STMT_INHERIT_REORDER);
+
+    if(res != NULL){
+        sqlite3_bind_int(res, 1, id);
+    }
+
+    return stepWrite(db, res);
+}
+
+/*Replaces every category of a product, a category given twice is only linked once*/
+int setProductCategories(sqlite3 *db, int id, const int *categoryIDs, int count){
+
+    struct timespec started = startMetric();
+
+    if(count < 1){
+        stockMessage(STOCK_ERROR, "A product needs at least one category\n");
+        return endMetric(METRIC_CHANGE_CATEGORY, &started, 0, 1);
+    }
+
+    if(beginWrite(db) != 0){
+        return endMetric(METRIC_CHANGE_CATEGORY, &started, 0, 1);
+    }
+
+    sqlite3_stmt *res = getStatement(db, STMT_DELETE_PRODUCT_CAT);
+
+    if(res != NULL){
+        sqlite3_bind_int(res, 1, id);
+    }
+
+    int failed = stepWrite(db, res);
+    int i;
+
+    for(i=0; i<count && !failed; i++){
+        failed = linkProductCategory(db, id, categoryIDs[i]);
+    }
+
+    if(!failed){
+        failed = inheritReorderLevel(db, id);
+    }
+
+    if(endWrite(db, failed) != 0){
+        return endMetric(METRIC_CHANGE_CATEGORY, &started, 0, 1);
+    }
+
+    cacheSetCategories(id, categoryIDs, count, 0);
+
+    return endMetric(METRIC_CHANGE_CATEGORY, &started, 1, 0);
+}
+
+/*Function used to change the category of the product given the productID of the product*/
+int changeProductCategory(sqlite3 *db, int id, int categoryID){
+
+    return setProductCategories(db, id, &categoryID, 1);
+}
+
+/*Adds a category to those a product already has*/
+int addProductCategory(sqlite3 *db, int id, int categoryID){
+
+    struct timespec started = startMetric();
+
+    if(beginWrite(db) != 0){
+        return endMetric(METRIC_CHANGE_CATEGORY, &started, 0, 1);
+    }
+
+    int failed = linkProductCategory(db, id, categoryID);
+
+    if(!failed){
+        failed = inheritReorderLevel(db, id);
+    }
+
+    if(endWrite(db, failed) != 0){
+        return endMetric(METRIC_CHANGE_CATEGORY, &started, 0, 1);
+    }
+
+    cacheLinkCategory(id, categoryID);
+
+    return endMetric(METRIC_CHANGE_CATEGORY, &started, 1, 0);
+}
+
+/*Takes a category away from a product, refused when it is not one of the product's categories or is the only one left*/
+int removeProductCategory(sqlite3 *db, int id, int categoryID){
+
+    struct timespec started = startMetric();
+
+    if(beginWrite(db) != 0){
+        return endMetric(METRIC_CHANGE_CATEGORY, &started, 0, 1);
+    }
+
+    sqlite3_stmt *res = getStatement(db, STMT_UNLINK_CATEGORY);
+
+    if(res != NULL){
+        sqlite3_bind_int(res, 1, id);
+        sqlite3_bind_int(res, 2, categoryID);
+    }
+
+    int failed = stepWrite(db, res);
+
+    if(!failed && sqlite3_changes(db) == 0){
+        stockMessage(STOCK_ERROR, "Product %d is not in %s alongside another category, a product keeps at least one\n", id, getCategoryName(categoryID));
+        failed = 1;
+    }
+
+    if(!failed){
+        failed = inheritReorderLevel(db, id);
+    }
+
+    if(endWrite(db, failed) != 0){
+        return endMetric(METRIC_CHANGE_CATEGORY, &started, 0, 1);
+    }
+
+    cacheUnlinkCategory(id, categoryID);
+
+    return endMetric(METRIC_CHANGE_CATEGORY, &started, 1, 0);
+}
+
+/*Function will compare a given productID with the productId within the product table and the product_cat table, then the matching stock item */
+int deleteStock(sqlite3 *db, int id){
+
+    struct timespec started = startMetric();
+
+    if(beginWrite(db) != 0){
+        return endMetric(METRIC_DELETE, &started, 0, 1);
+    }
+
+    /*The name leaves the text index while the product row is still there to read it from*/
+    sqlite3_stmt *res = getStatement(db, STMT_UNINDEX_NAME);
+
+    if(res != NULL){
+        sqlite3_bind_int(res, 1, id);
+    }
+
+    int failed = stepWrite(db, res);
+    int deleted = 0;
+
+    /*product will exist in both the product and product_cat table and therefore must be deleted from both in the same transaction*/
+    if(!failed){
+
+        res = getStatement(db, STMT_DELETE_PRODUCT);
+
+        if(res != NULL){
+            sqlite3_bind_int(res, 1, id);
+        }
+
+        failed = stepWrite(db, res);
+        deleted = sqlite3_changes(db);
+    }
+
+    if(!failed){
+
+        res = getStatement(db, STMT_DELETE_PRODUCT_CAT);
+
+        if(res != NULL){
+            sqlite3_bind_int(res, 1, id);
+        }
+
+        failed = stepWrite(db, res);
+    }
+
+    /*The product's ledger goes with it*/
+    if(!failed){
+
+        res = getStatement(db, STMT_DELETE_MOVEMENTS);
+
+        if(res != NULL){
+            sqlite3_bind_int(res, 1, id);
+        }
+
+        failed = stepWrite(db, res);
+    }
+
+    if(!failed){
+
+        res = getStatement(db, STMT_DELETE_SNAPSHOT);
+
+        if(res != NULL){
+            sqlite3_bind_int(res, 1, id);
+        }
+
+        failed = stepWrite(db, res);
+    }
+
+    if(endWrite(db, failed) != 0){
+        return endMetric(METRIC_DELETE, &started, 0, 1);
+    }
+
+    cacheDeleteProduct(id);
+
+    return endMetric(METRIC_DELETE, &started, deleted, 0);
+}
+
+/*Adds a product in tempProduct.categoryID and each of extraCategoryIDs*/
+int insertDataInCategories(sqlite3 *db, struct product tempProduct, const int *extraCategoryIDs, int extraCount){
+
+    struct timespec started = startMetric();
+
+    if(beginWrite(db) != 0){
+        return endMetric(METRIC_INSERT, &started, 0, 1);
+    }
+
+    /*Adding data to the product table*/
+    sqlite3_stmt *res = getStatement(db, STMT_INSERT_PRODUCT);
+
+    if(res != NULL){
+
+        if(tempProduct.productID == AUTO_PRODUCT_ID){
+            /*A NULL primary key makes sqlite pick the next rowid while it holds the write lock, so concurrent adders never collide*/
+            sqlite3_bind_null(res, 1);
+        } else {
+            sqlite3_bind_int(res, 1, tempProduct.productID);
+        }
+        sqlite3_bind_text(res, 2, tempProduct.name, -1, SQLITE_STATIC);
+        sqlite3_bind_double(res, 3, tempProduct.price);
+        sqlite3_bind_double(res, 4, tempProduct.quantity);
+        sqlite3_bind_int(res, 5, tempProduct.categoryID);
+    }
+
+    int failed = stepWrite(db, res);
+    int productID = 0;
+
+    /*Adding data to the productCat table, using the productID sqlite assigned*/
+    if(!failed){
+
+        productID = (int) sqlite3_last_insert_rowid(db);
+
+        res = getStatement(db, STMT_INSERT_PRODUCT_CAT);
+
+        if(res != NULL){
+            sqlite3_bind_int(res, 1, productID);
+            sqlite3_bind_int(res, 2, tempProduct.categoryID);
+        }
+
+        failed = stepWrite(db, res);
+    }
+
+    int i;
+
+    for(i=0; i<extraCount && !failed; i++){
+        failed = linkProductCategory(db, productID, extraCategoryIDs[i]);
+    }
+
+    /*The level copied by the insert came from the first category, which need not be the lowest*/
+    if(extraCount > 0 && !failed){
+        failed = inheritReorderLevel(db, productID);
+    }
+
+    /*Adding the name to the text index used by searches*/
+    if(!failed){
+
+        res = getStatement(db, STMT_INDEX_NAME);
+
+        if(res != NULL){
+            sqlite3_bind_int(res, 1, productID);
+            sqlite3_bind_text(res, 2, tempProduct.name, -1, SQLITE_STATIC);
+        }
+
+        failed = stepWrite(db, res);
+    }
+
+    /*All three rows are committed together or not at all*/
+    if(endWrite(db, failed) != 0){
+        return endMetric(METRIC_INSERT, &started, 0, 1);
+    }
+
+    cacheInsertProduct(productID, tempProduct.name, tempProduct.categoryID, tempProduct.price, tempProduct.quantity);
+
+    for(i=0; i<extraCount; i++){
+        cacheLinkCategory(productID, extraCategoryIDs[i]);
+    }
+
+    return endMetric(METRIC_INSERT, &started, 1, 0);
+}
+
+/*Takes the stock data structure passed from the addStock function and adds the data to the database*/
+int insertData(sqlite3 *db, struct product tempProduct){
+
+    return insertDataInCategories(db, tempProduct, NULL, 0);
+}
+
+
+/*Number of rows committed in each transaction of an import, large enough that the commit cost is spread over many rows*/
+#define IMPORT_BATCH_SIZE 50000
+/*Longest line accepted from an import file*/
+#define IMPORT_LINE_LENGTH 1024
+/*Number of rejected rows that are reported individually before only the total is given*/
+#define IMPORT_REPORT_LIMIT 10
+
+/*Splits a delimited line into fields in place, double quoted fields may contain the delimiter and use "" for a quote, returns the number of fields*/
+int splitFields(char *line, char delimiter, char **fields, int maxFields){
+
+    int count = 0;
+    char *read = line;
+
+    while(count < maxFields){
+
+        /*Fields are compacted in place as quotes are removed, so the write position can fall behind the read position*/
+        char *write = read;
+        fields[count++] = write;
+
+        if(*read == '"'){
+
+            read++;
+
+            while(*read){
+                if(*read == '"' && *(read + 1) == '"'){
+                    *write++ = '"';
+                    read += 2;
+                } else if(*read == '"'){
+                    read++;
+                    break;
+                } else {
+                    *write++ = *read++;
+                }
+            }
+        }
+
+        while(*read && *read != delimiter){
+            *write++ = *read++;
+        }
+
+        if(*read == delimiter){
+            *write = 0;
+            read++;
+        } else {
+            *write = 0;
+            return count;
+        }
+    }
+
+    /*More fields than expected are counted so the row can be rejected*/
+    return *read ? count + 1 : count;
+}
+
+/*Turns one line of an import file into a product, returns NULL on success or the reason the row was rejected*/
+const char *parseImportLine(char *line, char delimiter, struct product *tempProduct){
+
+    char *fields[4];
+
+    line[strcspn(line, "\r\n")] = 0;
+
+    if(splitFields(line, delimiter, fields, 4) != 4){
+        return "expected 4 fields: name, category, price, quantity";
+    }
+
+    if(strlen(fields[0]) == 0){
+        return "missing name";
+    }
+
+    if(strlen(fields[0]) >= sizeof(tempProduct->name)){
+        return "name longer than 19 characters";
+    }
+
+    int categoryID = getCategoryID(fields[1]);
+
+    if(categoryID == CATEGORY_NOT_FOUND){
+        return "unknown category";
+    }
+
+    if(!doubleCheck(fields[2])){
+        return "price is not a number";
+    }
+
+    if(!doubleCheck(fields[3])){
+        return "quantity is not a number";
+    }
+
+    strcpy(tempProduct->name, fields[0]);
+    tempProduct->categoryID = categoryID;
+    tempProduct->price = strtod(fields[2], NULL);
+    tempProduct->quantity = strtod(fields[3], NULL);
+
+    return NULL;
+}
+
+/*Inserts one imported product with the bound insert statements, the caller holds the transaction, on failure sqlite's reason is copied into reason*/
+int insertImportedProduct(sqlite3 *db, struct product *tempProduct, char *reason, size_t reasonSize){
+
+    sqlite3_stmt *res = getStatement(db, STMT_INSERT_PRODUCT);
+
+    if(res == NULL){
+        snprintf(reason, reasonSize, "%s", sqlite3_errmsg(db));
+        return 1;
+    }
+
+    sqlite3_bind_int(res, 1, tempProduct->productID);
+    /*SQLITE_STATIC is safe as the name outlives the step*/
+    sqlite3_bind_text(res, 2, tempProduct->name, -1, SQLITE_STATIC);
+    sqlite3_bind_double(res, 3, tempProduct->price);
+    sqlite3_bind_double(res, 4, tempProduct->quantity);
+    sqlite3_bind_int(res, 5, tempProduct->categoryID);
+
+    int rc = sqlite3_step(res);
+    releaseStatement(res);
+
+    if(rc != SQLITE_DONE){
+        snprintf(reason, reasonSize, "%s", sqlite3_errmsg(db));
+        return 1;
+    }
+
+    res = getStatement(db, STMT_INSERT_PRODUCT_CAT);
+
+    sqlite3_bind_int(res, 1, tempProduct->productID);
+    sqlite3_bind_int(res, 2, tempProduct->categoryID);
+
+    rc = sqlite3_step(res);
+    releaseStatement(res);
+
+    if(rc == SQLITE_DONE){
+
+        res = getStatement(db, STMT_INDEX_NAME);
+
+        sqlite3_bind_int(res, 1, tempProduct->productID);
+        sqlite3_bind_text(res, 2, tempProduct->name, -1, SQLITE_STATIC);
+
+        rc = sqlite3_step(res);
+        releaseStatement(res);
+    }
+
+    if(rc != SQLITE_DONE){
+
+        /*The reason is taken before the clean up below replaces sqlite's error message*/
+        snprintf(reason, reasonSize, "%s", sqlite3_errmsg(db));
+
+        /*The product rows are removed again so a failed row never leaves a product without its category link or its text index entry*/
+        char query[150];
+        sprintf(query, "DELETE FROM PRODUCT WHERE productID = %d; DELETE FROM PRODUCT_CAT WHERE productID = %d", tempProduct->productID, tempProduct->productID);
+        sqlite3_exec(db, query, 0, 0, 0);
+
+        return 1;
+    }
+
+    return 0;
+}
+
+/*Streams a CSV or TSV file of name, category, price, quantity rows into the database in large transactions, rejected rows are copied to a side file and the counts are left in result*/
+int importStock(sqlite3 *db, const char *filename, struct importResult *result){
+
+    struct timespec started = startMetric();
+
+    memset(result, 0, sizeof(struct importResult));
+
+    /*An import runs its own transactions, so anything grouped so far is committed first*/
+    if(commitGroup(db) != 0){
+        return endMetric(METRIC_IMPORT, &started, 0, 1);
+    }
+
+    FILE *file = fopen(filename, "r");
+
+    if(file == NULL){
+        stockMessage(STOCK_ERROR, "Import file could not be opened\n");
+        return endMetric(METRIC_IMPORT, &started, 0, 1);
+    }
+
+    char *rejectName = result->rejectName;
+    snprintf(rejectName, sizeof(result->rejectName), "%s.rejected", filename);
+    result->opened = 1;
+    /*The reject file is only created once the first row is rejected*/
+    FILE *rejects = NULL;
+
+    char line[IMPORT_LINE_LENGTH];
+    char original[IMPORT_LINE_LENGTH];
+    char delimiter = ',';
+
+    long lineNumber = 0;
+    long imported = 0;
+    long rejected = 0;
+    int batchCount = 0;
+    /*Rows inserted in the open batch, only counted as imported once the batch is committed*/
+    int batchImported = 0;
+    char failure[200];
+    int batchFirstID = 0;
+    int reservedEnd = 0;
+    int nextID = 0;
+    int failed = 0;
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    while(fgets(line, sizeof(line), file)){
+
+        lineNumber += 1;
+
+        /*Lines longer than the buffer are rejected and the remainder of the line is skipped*/
+        if(strchr(line, '\n') == NULL && !feof(file)){
+            int ch;
+            do {
+                ch = fgetc(file);
+            } while(ch != '\n' && ch != EOF);
+            line[0] = 0;
+        }
+
+        /*The delimiter is taken from the first line, a tab means the file is tab separated*/
+        if(lineNumber == 1 && strchr(line, '\t') != NULL){
+            delimiter = '\t';
+        }
+
+        strcpy(original, line);
+
+        struct product tempProduct;
+        const char *reason;
+
+        if(line[0] == 0){
+            reason = "line is too long";
+        } else {
+            reason = parseImportLine(line, delimiter, &tempProduct);
+        }
+
+        /*A header row is skipped rather than rejected*/
+        if(reason != NULL && lineNumber == 1 && strncmp(original, "name", 4) == 0){
+            continue;
+        }
+
+        if(reason == NULL){
+
+            /*Each batch runs in one transaction and takes its productIDs from the in-process counter*/
+            if(batchCount == 0){
+
+                if(sqlite3_exec(db, "BEGIN IMMEDIATE", 0, 0, 0) != SQLITE_OK){
+                    stockMessage(STOCK_ERROR, "SQL error: %s\n", sqlite3_errmsg(db));
+                    failed = 1;
+                    break;
+                }
+                nextID = reserveProductIDs(db, IMPORT_BATCH_SIZE);
+                batchFirstID = nextID;
+                reservedEnd = nextID + IMPORT_BATCH_SIZE;
+            }
+
+            /*An ID is used up even when the insert fails, so the batch never runs past its reservation*/
+            tempProduct.productID = nextID++;
+
+            if(insertImportedProduct(db, &tempProduct, failure, sizeof(failure)) != 0){
+                reason = failure;
+            } else {
+                batchImported += 1;
+            }
+
+            batchCount += 1;
+
+            if(batchCount == IMPORT_BATCH_SIZE){
+
+                if(sqlite3_exec(db, "COMMIT", 0, 0, 0) != SQLITE_OK){
+                    stockMessage(STOCK_ERROR, "SQL error: %s\n", sqlite3_errmsg(db));
+                    failed = 1;
+                    break;
+                }
+                imported += batchImported;
+                batchImported = 0;
+                batchCount = 0;
+            }
+        }
+
+        if(reason != NULL){
+
+            rejected += 1;
+
+            if(rejected <= IMPORT_REPORT_LIMIT){
+                stockMessage(STOCK_NOTICE, "Line %ld rejected: %s\n", lineNumber, reason);
+            }
+
+            if(rejects == NULL){
+                rejects = fopen(rejectName, "w");
+            }
+
+            if(rejects != NULL){
+                fputs(original, rejects);
+                if(strchr(original, '\n') == NULL){
+                    fputc('\n', rejects);
+                }
+            }
+        }
+    }
+
+    if(batchCount > 0){
+
+        if(failed){
+            sqlite3_exec(db, "ROLLBACK", 0, 0, 0);
+        } else if(sqlite3_exec(db, "COMMIT", 0, 0, 0) != SQLITE_OK){
+            stockMessage(STOCK_ERROR, "SQL error: %s\n", sqlite3_errmsg(db));
+            sqlite3_exec(db, "ROLLBACK", 0, 0, 0);
+            failed = 1;
+        } else {
+            imported += batchImported;
+        }
+
+        /*Only the last batch can stop short of its reservation, a rolled back batch hands back all of it*/
+        releaseProductIDs(failed ? batchFirstID : nextID, reservedEnd);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    fclose(file);
+    if(rejects != NULL){
+        fclose(rejects);
+    }
+
+    result->lines = lineNumber;
+    result->imported = imported;
+    result->rejected = rejected;
+    result->seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    result->stopped = failed;
+
+    /*Imported rows bypass the write-through functions so the cache is rebuilt in one pass*/
+    reloadProductCache(db);
+
+    return endMetric(METRIC_IMPORT, &started, imported, failed);
+}
+
+/*FNV-1a hash of the whole category file, written as hex into hash, returns 1 if the file could not be read*/
+int hashCategoryFile(const char *filename, char *hash, size_t size){
+
+    FILE *file = fopen(filename, "rb");
+
+    if(file == NULL){
+        return 1;
+    }
+
+    unsigned long long value = 14695981039346656037ull;
+    unsigned char buffer[4096];
+    size_t length;
+    size_t i;
+
+    while((length = fread(buffer, 1, sizeof(buffer), file)) > 0){
+        for(i=0; i<length; i++){
+            value ^= buffer[i];
+            value *= 1099511628211ull;
+        }
+    }
+
+    fclose(file);
+
+    snprintf(hash, size, "%016llx", value);
+
+    return 0;
+}
+
+/*Runs a statement that takes a single text parameter, returns 1 if it failed*/
+int execWithText(sqlite3 *db, const char *query, const char *text){
+
+    sqlite3_stmt *res;
+
+    if(sqlite3_prepare_v2(db, query, -1, &res, 0) != SQLITE_OK){
+        stockMessage(STOCK_ERROR, "SQL error: %s\n", sqlite3_errmsg(db));
+        return 1;
+    }
+
+    if(text != NULL){
+        sqlite3_bind_text(res, 1, text, -1, SQLITE_STATIC);
+    }
+
+    int rc = sqlite3_step(res);
+
+    if(rc != SQLITE_DONE && rc != SQLITE_ROW){
+        stockMessage(STOCK_ERROR, "SQL error: %s\n", sqlite3_errmsg(db));
+    }
+
+    sqlite3_finalize(res);
+
+    return rc != SQLITE_DONE && rc != SQLITE_ROW;
+}
+
+/*Returns 1 if the category table was last synced from a file with this hash*/
+int categoriesUpToDate(sqlite3 *db, const char *hash){
+
+    sqlite3_stmt *res;
+    int upToDate = 0;
+
+    /*An emptied category table is synced again even if the file has not changed*/
+    if(sqlite3_prepare_v2(db, "SELECT value FROM SETTING WHERE name = 'category_file_hash' AND EXISTS (SELECT 1 FROM CATEGORY)", -1, &res, 0) != SQLITE_OK){
+        return 0;
+    }
+
+    if(sqlite3_step(res) == SQLITE_ROW){
+        const char *stored = (const char *) sqlite3_column_text(res, 0);
+        upToDate = stored != NULL && strcmp(stored, hash) == 0;
+    }
+
+    sqlite3_finalize(res);
+
+    return upToDate;
+}
+
+/*Applies the category file to the category table in one transaction, new names get the next free categoryID and existing names keep theirs, so the links in PRODUCT_CAT never change meaning*/
+int syncCategories(sqlite3 *db, FILE *file, const char *hash){
+
+    char buffer[256];
+    sqlite3_stmt *res;
+    int added = 0;
+    int failed = 0;
+
+    if(sqlite3_exec(db, "BEGIN IMMEDIATE", 0, 0, 0) != SQLITE_OK){
+        stockMessage(STOCK_ERROR, "SQL error: %s\n", sqlite3_errmsg(db));
+        return 1;
+    }
+
+    /*The names in the file are collected so the ones that were removed from it can be found*/
+    failed |= execWithText(db, "CREATE TEMP TABLE IF NOT EXISTS CATEGORY_FILE(name TEXT PRIMARY KEY)", NULL);
+    failed |= execWithText(db, "DELETE FROM temp.CATEGORY_FILE", NULL);
+
+    if(!failed && sqlite3_prepare_v2(db, "INSERT OR IGNORE INTO temp.CATEGORY_FILE VALUES(?)", -1, &res, 0) == SQLITE_OK){
+
+        while(fgets(buffer, sizeof(buffer), file)){
+
+            buffer[strcspn(buffer, "\r\n")] = 0;
+
+            /*Blank lines are not categories*/
+            if(buffer[0] == 0){
+                continue;
+            }
+
+            sqlite3_bind_text(res, 1, buffer, -1, SQLITE_STATIC);
+
+            if(sqlite3_step(res) != SQLITE_DONE){
+                stockMessage(STOCK_ERROR, "SQL error: %s\n", sqlite3_errmsg(db));
+                failed = 1;
+            }
+
+            sqlite3_reset(res);
+        }
+
+        sqlite3_finalize(res);
+
+    } else {
+        failed = 1;
+    }
+
+    if(!failed){
+
+        /*Each new name takes the next categoryID in file order, a new table starts at 0 like the old numbering by line*/
+        failed |= execWithText(db,
+            "INSERT INTO CATEGORY(categoryID, name) "
+            "SELECT (SELECT coalesce(max(categoryID), -1) FROM CATEGORY) + row_number() OVER (ORDER BY rowid), name "
+            "FROM temp.CATEGORY_FILE WHERE name NOT IN (SELECT name FROM CATEGORY) ORDER BY rowid", NULL);
+        added = sqlite3_changes(db);
+    }
+
+    int removed = 0;
+
+    if(!failed){
+
+        /*A category that is gone from the file is only removed once no product is linked to it*/
+        failed |= execWithText(db,
+            "DELETE FROM CATEGORY WHERE name NOT IN (SELECT name FROM temp.CATEGORY_FILE) "
+            "AND NOT EXISTS (SELECT 1 FROM PRODUCT_CAT WHERE PRODUCT_CAT.categoryID = CATEGORY.categoryID)", NULL);
+        removed = sqlite3_changes(db);
+    }
+
+    if(!failed){
+        failed |= execWithText(db, "INSERT OR REPLACE INTO SETTING(name, value) VALUES('category_file_hash', ?)", hash);
+    }
+
+    if(failed || sqlite3_exec(db, "COMMIT", 0, 0, 0) != SQLITE_OK){
+        stockMessage(STOCK_ERROR, "The categories could not be updated: %s\n", sqlite3_errmsg(db));
+        sqlite3_exec(db, "ROLLBACK", 0, 0, 0);
+        return 1;
+    }
+
+    stockMessage(STOCK_STATUS, "Categories updated, %d added and %d removed\n", added, removed);
+
+    if(sqlite3_prepare_v2(db, "SELECT name FROM CATEGORY WHERE name NOT IN (SELECT name FROM temp.CATEGORY_FILE)", -1, &res, 0) == SQLITE_OK){
+
+        while(sqlite3_step(res) == SQLITE_ROW){
+            stockMessage(STOCK_STATUS, "Category %s is no longer in %s but is kept as products still use it\n", sqlite3_column_text(res, 0), CATEGORY_FILE);
+        }
+
+        sqlite3_finalize(res);
+    }
+
+    return 0;
+}
+
+/*Brings the categories table in line with the category file, nothing is written when the file has not changed since the last sync*/
+int setCategories(sqlite3* db){
+
+    char hash[32];
+
+    if(hashCategoryFile(CATEGORY_FILE, hash, sizeof(hash)) != 0){
+        stockMessage(STOCK_ERROR, "Category file could not be found\n");
+        return 1;
+    }
+
+    if(categoriesUpToDate(db, hash)){
+        return 0;
+    }
+
+    FILE *file = fopen(CATEGORY_FILE, "r");
+
+    if(file == NULL){
+        stockMessage(STOCK_ERROR, "Category file could not be found\n");
+        return 1;
+    }
+
+    int failed = syncCategories(db, file, hash);
+
+    fclose(file);
+
+    return failed;
+}
+
+/*Matches the products a bulk change applies to, each condition is skipped when its parameter is NULL. ?1 is the productID the chunk starts after*/
+#define BULK_MATCH \
+    "PRODUCT.productID > ?1 " \
+    "AND (?2 IS NULL OR PRODUCT_CAT.categoryID = ?2) " \
+    "AND (?3 IS NULL OR PRODUCT.name LIKE ?3) " \
+    "AND (?4 IS NULL OR PRODUCT.price >= ?4) " \
+    "AND (?5 IS NULL OR PRODUCT.price <= ?5) " \
+    "AND (?6 IS NULL OR PRODUCT.quantity >= ?6) " \
+    "AND (?7 IS NULL OR PRODUCT.quantity <= ?7)"
+
+/*Selects the productIDs of the next chunk, walking PRODUCT in rowid order so each chunk starts where the last one ended*/
+#define BULK_SELECT_CHUNK \
+    "INSERT INTO temp.BULK_CHUNK SELECT PRODUCT.productID FROM PRODUCT " \
+    "LEFT JOIN PRODUCT_CAT ON PRODUCT_CAT.productID = PRODUCT.productID " \
+    "WHERE " BULK_MATCH " GROUP BY PRODUCT.productID ORDER BY PRODUCT.productID LIMIT ?8"
+
+#define BULK_IN_CHUNK "productID IN (SELECT productID FROM temp.BULK_CHUNK)"
+#define BULK_MAX_STATEMENTS 5
+
+/*Statements run against each chunk for an action, the last one's changes are the products counted*/
+static const char *bulkStatements[][BULK_MAX_STATEMENTS] = {
+    [BULK_SET_PRICE] = {"UPDATE PRODUCT SET price = ?1 WHERE " BULK_IN_CHUNK},
+    [BULK_SCALE_PRICE] = {"UPDATE PRODUCT SET price = round(price * (1 + ?1 / 100.0), 2) WHERE " BULK_IN_CHUNK},
+    /*Quantity changes go into the ledger as the difference they make, worked out before the update*/
+    [BULK_SET_QUANTITY] = {
+        "INSERT INTO STOCK_MOVEMENT(productID, delta, reason, createdAt) SELECT productID, ?1 - quantity, 'bulk', " LEDGER_NOW " FROM PRODUCT WHERE quantity <> ?1 AND " BULK_IN_CHUNK,
+        "UPDATE PRODUCT SET quantity = ?1 WHERE " BULK_IN_CHUNK},
+    [BULK_ADJUST_QUANTITY] = {
+        "INSERT INTO STOCK_MOVEMENT(productID, delta, reason, createdAt) SELECT productID, max(quantity + ?1, 0) - quantity, 'bulk', " LEDGER_NOW " FROM PRODUCT WHERE max(quantity + ?1, 0) <> quantity AND " BULK_IN_CHUNK,
+        "UPDATE PRODUCT SET quantity = max(quantity + ?1, 0) WHERE " BULK_IN_CHUNK},
+    /*With a category filter (?2) only that link moves and the product's other categories stay, without one every link is folded into the new category. OR REPLACE drops a link the product already had to the new category rather than breaking the unique index, then each linked product is counted once*/
+    [BULK_SET_CATEGORY] = {
+        "UPDATE OR REPLACE PRODUCT_CAT SET categoryID = ?1 WHERE (?2 IS NULL OR categoryID = ?2) AND " BULK_IN_CHUNK,
+        "UPDATE PRODUCT SET reorderLevel = CASE WHEN ownReorderLevel = 0 THEN " PRODUCT_LEVEL_CATEGORY " ELSE reorderLevel END "
+        "WHERE " BULK_IN_CHUNK " AND EXISTS (SELECT 1 FROM PRODUCT_CAT WHERE PRODUCT_CAT.productID = PRODUCT.productID)"},
+    /*The text index reads the names being removed from PRODUCT, so it goes first*/
+    [BULK_DELETE] = {
+        "INSERT INTO PRODUCT_NAME_SEARCH(PRODUCT_NAME_SEARCH, rowid, name) SELECT 'delete', productID, name FROM PRODUCT WHERE " BULK_IN_CHUNK,
+        "DELETE FROM PRODUCT_CAT WHERE " BULK_IN_CHUNK,
+        "DELETE FROM STOCK_MOVEMENT WHERE " BULK_IN_CHUNK,
+        "DELETE FROM STOCK_SNAPSHOT WHERE " BULK_IN_CHUNK,
+        "DELETE FROM PRODUCT WHERE " BULK_IN_CHUNK}
+};
+
+/*Sets every field of a filter so that it matches all products*/
+void clearProductFilter(struct productFilter *filter){
+
+    filter->categoryID = CATEGORY_NOT_FOUND;
+    filter->namePattern = NULL;
+    filter->minPrice = NAN;
+    filter->maxPrice = NAN;
+    filter->minQuantity = NAN;
+    filter->maxQuantity = NAN;
+}
+
+/*Binds a bound of the filter, an unset one is NULL so its condition is skipped*/
+void bindFilterBound(sqlite3_stmt *res, int index, double value){
+
+    if(isnan(value)){
+        sqlite3_bind_null(res, index);
+    } else {
+        sqlite3_bind_double(res, index, value);
+    }
+}
+
+/*Applies a committed chunk to the product cache, the rows are read back so the cache holds exactly what the database does. fromCategoryID is the filter's category, the only link a category change moves when it is set*/
+void cacheBulkChunk(sqlite3_stmt *changed, enum bulkAction action, double value, int fromCategoryID){
+
+    while(sqlite3_step(changed) == SQLITE_ROW){
+
+        int productID = sqlite3_column_int(changed, 0);
+
+        switch(action){
+            case BULK_SET_PRICE:
+            case BULK_SCALE_PRICE:
+                cacheSetPrice(productID, sqlite3_column_double(changed, 1));
+                break;
+            case BULK_SET_QUANTITY:
+            case BULK_ADJUST_QUANTITY:
+                cacheSetQuantity(productID, sqlite3_column_double(changed, 2));
+                break;
+            case BULK_SET_CATEGORY:
+                if(fromCategoryID == CATEGORY_NOT_FOUND){
+                    cacheSetCategory(productID, (int) value);
+                } else {
+                    cacheUnlinkCategory(productID, fromCategoryID);
+                    cacheLinkCategory(productID, (int) value);
+                }
+                break;
+            case BULK_DELETE:
+                cacheDeleteProduct(productID);
+                break;
+        }
+    }
+
+    sqlite3_reset(changed);
+}
+
+/*Applies an action to every product the filter matches as set based statements, one transaction per chunk of chunkSize products so a reader or another writer never waits for more than one chunk*/
+int bulkModify(sqlite3 *db, const struct productFilter *filter, enum bulkAction action, double value, int chunkSize, long *affected){
+
+    struct timespec started = startMetric();
+    sqlite3_stmt *select = NULL;
+    sqlite3_stmt *clear = NULL;
+    sqlite3_stmt *last = NULL;
+    sqlite3_stmt *changed = NULL;
+    sqlite3_stmt *actions[BULK_MAX_STATEMENTS] = {NULL};
+    int actionCount = 0;
+    int failed = 0;
+
+    *affected = 0;
+
+    if(chunkSize < 1){
+        chunkSize = BULK_CHUNK_SIZE;
+    }
+
+    /*A bulk change runs its own transactions, so anything grouped so far is committed first*/
+    if(commitGroup(db) != 0){
+        return endMetric(METRIC_BULK, &started, 0, 1);
+    }
+
+    if(execWithText(db, "CREATE TEMP TABLE IF NOT EXISTS BULK_CHUNK(productID INTEGER PRIMARY KEY)", NULL) != 0){
+        return endMetric(METRIC_BULK, &started, 0, 1);
+    }
+
+    failed |= sqlite3_prepare_v2(db, BULK_SELECT_CHUNK, -1, &select, 0) != SQLITE_OK;
+    failed |= sqlite3_prepare_v2(db, "DELETE FROM temp.BULK_CHUNK", -1, &clear, 0) != SQLITE_OK;
+    failed |= sqlite3_prepare_v2(db, "SELECT max(productID) FROM temp.BULK_CHUNK", -1, &last, 0) != SQLITE_OK;
+
+    while(!failed && actionCount < BULK_MAX_STATEMENTS && bulkStatements[action][actionCount] != NULL){
+        failed |= sqlite3_prepare_v2(db, bulkStatements[action][actionCount], -1, &actions[actionCount], 0) != SQLITE_OK;
+        actionCount += 1;
+    }
+
+    /*Deleted rows are gone by the time the cache is updated, so the chunk is read with a LEFT JOIN*/
+    if(!failed && isProductCacheLoaded()){
+        failed |= sqlite3_prepare_v2(db,
+            "SELECT BULK_CHUNK.productID, PRODUCT.price, PRODUCT.quantity FROM temp.BULK_CHUNK "
+            "LEFT JOIN PRODUCT ON PRODUCT.productID = BULK_CHUNK.productID", -1, &changed, 0) != SQLITE_OK;
+    }
+
+    if(failed){
+        stockMessage(STOCK_ERROR, "SQL error: %s\n", sqlite3_errmsg(db));
+    } else {
+
+        sqlite3_bind_int(select, 1, PAGE_FIRST);
+
+        if(filter->categoryID == CATEGORY_NOT_FOUND){
+            sqlite3_bind_null(select, 2);
+        } else {
+            sqlite3_bind_int(select, 2, filter->categoryID);
+        }
+
+        if(filter->namePattern == NULL){
+            sqlite3_bind_null(select, 3);
+        } else {
+            sqlite3_bind_text(select, 3, filter->namePattern, -1, SQLITE_STATIC);
+        }
+
+        bindFilterBound(select, 4, filter->minPrice);
+        bindFilterBound(select, 5, filter->maxPrice);
+        bindFilterBound(select, 6, filter->minQuantity);
+        bindFilterBound(select, 7, filter->maxQuantity);
+        sqlite3_bind_int(select, 8, chunkSize);
+
+        for(int i = 0; i < actionCount; i++){
+
+            if(sqlite3_bind_parameter_count(actions[i]) == 0){
+                continue;
+            }
+
+            if(action == BULK_SET_CATEGORY){
+                sqlite3_bind_int(actions[i], 1, (int) value);
+                if(filter->categoryID == CATEGORY_NOT_FOUND){
+                    sqlite3_bind_null(actions[i], 2);
+                } else {
+                    sqlite3_bind_int(actions[i], 2, filter->categoryID);
+                }
+            } else {
+                sqlite3_bind_double(actions[i], 1, value);
+            }
+        }
+    }
+
+    while(!failed){
+
+        if(execControl(db, "BEGIN IMMEDIATE") != 0){
+            failed = 1;
+            break;
+        }
+
+        int chunkRows = 0;
+        long chunkChanges = 0;
+
+        if(sqlite3_step(clear) != SQLITE_DONE || sqlite3_step(select) != SQLITE_DONE){
+            failed = 1;
+        } else {
+            chunkRows = sqlite3_changes(db);
+        }
+
+        sqlite3_reset(clear);
+        sqlite3_reset(select);
+
+        for(int i = 0; !failed && chunkRows > 0 && i < actionCount; i++){
+
+            if(sqlite3_step(actions[i]) != SQLITE_DONE){
+                failed = 1;
+            } else {
+                chunkChanges = sqlite3_changes(db);
+            }
+
+            sqlite3_reset(actions[i]);
+        }
+
+        /*The next chunk starts after the highest productID in this one*/
+        if(!failed && chunkRows > 0){
+
+            if(sqlite3_step(last) == SQLITE_ROW){
+                sqlite3_bind_int(select, 1, sqlite3_column_int(last, 0));
+            } else {
+                failed = 1;
+            }
+
+            sqlite3_reset(last);
+        }
+
+        if(failed){
+            stockMessage(STOCK_ERROR, "SQL error: %s\n", sqlite3_errmsg(db));
+            sqlite3_exec(db, "ROLLBACK", 0, 0, 0);
+            break;
+        }
+
+        if(execControl(db, "COMMIT") != 0){
+            sqlite3_exec(db, "ROLLBACK", 0, 0, 0);
+            failed = 1;
+            break;
+        }
+
+        *affected += chunkChanges;
+
+        if(changed != NULL){
+            cacheBulkChunk(changed, action, value, filter->categoryID);
+        }
+
+        if(chunkRows < chunkSize){
+            break;
+        }
+    }
+
+    sqlite3_finalize(select);
+    sqlite3_finalize(clear);
+    sqlite3_finalize(last);
+    sqlite3_finalize(changed);
+
+    for(int i = 0; i < actionCount; i++){
+        sqlite3_finalize(actions[i]);
+    }
+
+    return endMetric(METRIC_BULK, &started, *affected, failed);
+}
+
+/*Reads up to max of a product's movements newest first, count is set to the number read*/
+int getMovements(sqlite3 *db, int id, struct stockMovement *movements, int max, int *count){
+
+    sqlite3_stmt *res = getStatement(db, STMT_READ_MOVEMENTS);
+    int rc = SQLITE_DONE;
+
+    *count = 0;
+
+    if(res == NULL){
+        stockMessage(STOCK_ERROR, "SQL error: %s\n", sqlite3_errmsg(db));
+        return 1;
+    }
+
+    sqlite3_bind_int(res, 1, id);
+    sqlite3_bind_int(res, 2, max);
+
+    while((rc = sqlite3_step(res)) == SQLITE_ROW){
+
+        struct stockMovement *movement = &movements[(*count)++];
+        const char *reason = (const char *) sqlite3_column_text(res, 2);
+
+        movement->movementID = sqlite3_column_int64(res, 0);
+        movement->delta = sqlite3_column_double(res, 1);
+        snprintf(movement->reason, sizeof(movement->reason), "%s", reason != NULL ? reason : "");
+        movement->createdAt = sqlite3_column_int64(res, 3);
+    }
+
+    if(rc != SQLITE_DONE){
+        stockMessage(STOCK_ERROR, "SQL error: %s\n", sqlite3_errmsg(db));
+    }
+
+    releaseStatement(res);
+
+    return rc != SQLITE_DONE;
+}
+
+/*Reads the snapshot a product's older movements were folded into, returns 1 if it has none*/
+int getSnapshot(sqlite3 *db, int id, struct stockSnapshot *snapshot){
+
+    sqlite3_stmt *res = getStatement(db, STMT_READ_SNAPSHOT);
+    int found = 0;
+
+    if(res == NULL){
+        stockMessage(STOCK_ERROR, "SQL error: %s\n", sqlite3_errmsg(db));
+        return 1;
+    }
+
+    sqlite3_bind_int(res, 1, id);
+
+    if(sqlite3_step(res) == SQLITE_ROW){
+        snapshot->quantity = sqlite3_column_double(res, 0);
+        snapshot->movementID = sqlite3_column_int64(res, 1);
+        snapshot->createdAt = sqlite3_column_int64(res, 2);
+        found = 1;
+    }
+
+    releaseStatement(res);
+
+    return !found;
+}
+
+/*Runs a ledger statement whose only parameter is a movementID, returns 1 if it failed*/
+int execWithMovementID(sqlite3 *db, const char *query, sqlite3_int64 movementID){
+
+    sqlite3_stmt *res;
+
+    if(sqlite3_prepare_v2(db, query, -1, &res, 0) != SQLITE_OK){
+        stockMessage(STOCK_ERROR, "SQL error: %s\n", sqlite3_errmsg(db));
+        return 1;
+    }
+
+    sqlite3_bind_int64(res, 1, movementID);
+
+    int rc = sqlite3_step(res);
+
+    if(rc != SQLITE_DONE){
+        stockMessage(STOCK_ERROR, "SQL error: %s\n", sqlite3_errmsg(db));
+    }
+
+    sqlite3_finalize(res);
+
+    return rc != SQLITE_DONE;
+}
+
+/*Folds every movement recorded before the time given into the snapshot of its product and removes it from the ledger, in one transaction*/
+int compactMovements(sqlite3 *db, time_t before, long *folded){
+
+    struct timespec started = startMetric();
+    sqlite3_stmt *res;
+    sqlite3_int64 lastID = 0;
+    int failed = 0;
+
+    *folded = 0;
+
+    /*Compaction runs its own transaction, so anything grouped so far is committed first*/
+    if(commitGroup(db) != 0 || execControl(db, "BEGIN IMMEDIATE") != 0){
+        return endMetric(METRIC_COMPACT, &started, 0, 1);
+    }
+
+    /*Everything up to the newest movement before the cut off is folded, so the ledger left behind always runs on from each snapshot without gaps*/
+    if(sqlite3_prepare_v2(db, "SELECT max(movementID) FROM STOCK_MOVEMENT WHERE createdAt <= ?", -1, &res, 0) != SQLITE_OK){
+        stockMessage(STOCK_ERROR, "SQL error: %s\n", sqlite3_errmsg(db));
+        failed = 1;
+    } else {
+
+        sqlite3_bind_int64(res, 1, before);
+
+        if(sqlite3_step(res) == SQLITE_ROW){
+            lastID = sqlite3_column_int64(res, 0);
+        }
+
+        sqlite3_finalize(res);
+    }
+
+    /*Each snapshot is the current quantity less the movements that stay in the ledger, movements of deleted products are simply dropped*/
+    if(!failed && lastID > 0){
+
+        failed = execWithMovementID(db,
+            "INSERT OR REPLACE INTO STOCK_SNAPSHOT(productID, quantity, movementID, createdAt) "
+            "SELECT FOLDED.productID, PRODUCT.quantity - (SELECT total(delta) FROM STOCK_MOVEMENT WHERE STOCK_MOVEMENT.productID = FOLDED.productID AND STOCK_MOVEMENT.movementID > ?1), "
+            "FOLDED.lastID, " LEDGER_NOW " "
+            "FROM (SELECT productID, max(movementID) AS lastID FROM STOCK_MOVEMENT WHERE movementID <= ?1 GROUP BY productID) AS FOLDED "
+            "JOIN PRODUCT ON PRODUCT.productID = FOLDED.productID", lastID);
+
+        if(!failed){
+            failed = execWithMovementID(db, "DELETE FROM STOCK_MOVEMENT WHERE movementID <= ?1", lastID);
+            *folded = sqlite3_changes(db);
+        }
+    }
+
+    if(failed || execControl(db, "COMMIT") != 0){
+        sqlite3_exec(db, "ROLLBACK", 0, 0, 0);
+        *folded = 0;
+        return endMetric(METRIC_COMPACT, &started, 0, 1);
+    }
+
+    return endMetric(METRIC_COMPACT, &started, *folded, 0);
+}
+
+/*Pages copied by each backup step, the source is only read locked while a step runs*/
+#define BACKUP_STEP_PAGES 256
+/*Pause between backup steps so the copy does not take all of the disk from the live session*/
+#define BACKUP_STEP_MILLIS 5
+
+/*Backups are named after the database file, stock_data.db is backed up as stock_data-<time>.db*/
+void backupPrefix(char *prefix, int size){
+
+    const char *name = strrchr(settings.path, '/');
+
+    name = name != NULL ? name + 1 : settings.path;
+    snprintf(prefix, size, "%s", name);
+
+    char *extension = strrchr(prefix, '.');
+
+    if(extension != NULL && extension != prefix){
+        *extension = 0;
+    }
+}
+
+int compareNamesDescending(const void *a, const void *b){
+
+    return strcmp(*(char * const *) b, *(char * const *) a);
+}
+
+/*Deletes all but the newest keep backups in directory, the timestamp in the name sorts them by age. Returns the number deleted*/
+int pruneBackups(const char *directory, const char *prefix, int keep){
+
+    DIR *dir = opendir(directory);
+    struct dirent *entry;
+    char **names = NULL;
+    int count = 0;
+    int capacity = 0;
+    int removed = 0;
+    int i;
+
+    if(dir == NULL){
+        return 0;
+    }
+
+    size_t prefixLength = strlen(prefix);
+
+    while((entry = readdir(dir)) != NULL){
+
+        size_t length = strlen(entry->d_name);
+
+        /*Only names of the form prefix-YYYYMMDD-HHMMSS.db are backups, anything else in the directory is left alone*/
+        if(length != prefixLength + 19 || strncmp(entry->d_name, prefix, prefixLength) != 0 || entry->d_name[prefixLength] != '-' || strcmp(entry->d_name + length - 3, ".db") != 0){
+            continue;
+        }
+
+        if(count == capacity){
+
+            capacity = capacity == 0 ? 16 : capacity * 2;
+            char **grown = realloc(names, sizeof(char *) * capacity);
+
+            if(grown == NULL){
+                break;
+            }
+            names = grown;
+        }
+
+        names[count] = strdup(entry->d_name);
+
+        if(names[count] != NULL){
+            count += 1;
+        }
+    }
+
+    closedir(dir);
+
+    qsort(names, count, sizeof(char *), compareNamesDescending);
+
+    for(i=0; i<count; i++){
+
+        if(i >= keep){
+
+            char path[600];
+
+            snprintf(path, sizeof(path), "%s/%s", directory, names[i]);
+
+            if(remove(path) == 0){
+                removed += 1;
+            }
+        }
+
+        free(names[i]);
+    }
+
+    free(names);
+
+    return removed;
+}
+
+/*Copies the database into a new timestamped file in directory a few pages at a time through the sqlite backup API, then deletes all but the newest keep backups*/
+int backupDatabase(const char *directory, int keep, struct backupResult *result){
+
+    struct timespec started = startMetric();
+    struct timespec pause = {0, BACKUP_STEP_MILLIS * 1000000L};
+    char prefix[256];
+    char stamp[32];
+    char partial[320];
+    sqlite3 *source = NULL;
+    sqlite3 *destination = NULL;
+    int failed = 0;
+
+    memset(result, 0, sizeof(struct backupResult));
+
+    if(mkdir(directory, 0755) != 0 && errno != EEXIST){
+        stockMessage(STOCK_ERROR, "Backup directory %s could not be created: %s\n", directory, strerror(errno));
+        return endMetric(METRIC_BACKUP, &started, 0, 1);
+    }
+
+    time_t now = time(NULL);
+
+    strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", localtime(&now));
+    backupPrefix(prefix, sizeof(prefix));
+    snprintf(result->path, sizeof(result->path), "%s/%s-%s.db", directory, prefix, stamp);
+    /*The copy only takes its final name once it is complete, so a backup file is never half written*/
+    snprintf(partial, sizeof(partial), "%s.part", result->path);
+    remove(partial);
+
+    /*The backup reads through a connection of its own so it can run beside the session's reads and writes*/
+    if(sqlite3_open_v2(settings.path, &source, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK){
+        stockMessage(STOCK_ERROR, "Backup could not be started: %s\n", sqlite3_errmsg(source));
+        sqlite3_close(source);
+        return endMetric(METRIC_BACKUP, &started, 0, 1);
+    }
+
+    if(sqlite3_open(partial, &destination) != SQLITE_OK){
+        stockMessage(STOCK_ERROR, "Backup file %s could not be created: %s\n", partial, sqlite3_errmsg(destination));
+        sqlite3_close(source);
+        sqlite3_close(destination);
+        remove(partial);
+        return endMetric(METRIC_BACKUP, &started, 0, 1);
+    }
+
+    sqlite3_busy_timeout(source, atoi(settings.busyTimeout));
+
+    /*In WAL mode a read transaction held across every step keeps one consistent snapshot without blocking writers, otherwise each step takes its own lock and sqlite starts the copy again if a writer changes the file in between*/
+    int holdSnapshot = strcasecmp(settings.journalMode, "WAL") == 0;
+
+    if(holdSnapshot && (execControl(source, "BEGIN") != 0 || execControl(source, "SELECT count(*) FROM sqlite_schema") != 0)){
+        failed = 1;
+    }
+
+    sqlite3_backup *backup = failed ? NULL : sqlite3_backup_init(destination, "main", source, "main");
+
+    if(backup == NULL){
+        stockMessage(STOCK_ERROR, "Backup could not be started: %s\n", sqlite3_errmsg(destination));
+        failed = 1;
+    } else {
+
+        int rc;
+
+        do {
+            rc = sqlite3_backup_step(backup, BACKUP_STEP_PAGES);
+
+            if(rc == SQLITE_OK || rc == SQLITE_BUSY || rc == SQLITE_LOCKED){
+                nanosleep(&pause, NULL);
+            }
+        } while(rc == SQLITE_OK || rc == SQLITE_BUSY || rc == SQLITE_LOCKED);
+
+        result->pages = sqlite3_backup_pagecount(backup);
+
+        if(sqlite3_backup_finish(backup) != SQLITE_OK || rc != SQLITE_DONE){
+            stockMessage(STOCK_ERROR, "Backup failed: %s\n", sqlite3_errmsg(destination));
+            failed = 1;
+        }
+    }
+
+    if(holdSnapshot){
+        sqlite3_exec(source, "COMMIT", 0, 0, 0);
+    }
+
+    sqlite3_close(source);
+
+    if(sqlite3_close(destination) != SQLITE_OK){
+        failed = 1;
+    }
+
+    if(!failed && rename(partial, result->path) != 0){
+        stockMessage(STOCK_ERROR, "Backup could not be renamed to %s: %s\n", result->path, strerror(errno));
+        failed = 1;
+    }
+
+    if(failed){
+        remove(partial);
+        return endMetric(METRIC_BACKUP, &started, 0, 1);
+    }
+
+    if(keep > 0){
+        result->removed = pruneBackups(directory, prefix, keep);
+    }
+
+    struct timespec finished;
+    clock_gettime(CLOCK_MONOTONIC, &finished);
+    result->seconds = (finished.tv_sec - started.tv_sec) + (finished.tv_nsec - started.tv_nsec) / 1e9;
+
+    return endMetric(METRIC_BACKUP, &started, result->pages, 0);
+}
+
+/*Identifies a catalogue snapshot file, the version changes whenever the layout does*/
+#define SNAPSHOT_MAGIC "STOCKSNP"
+#define SNAPSHOT_VERSION 2
+/*Written as a number so a file made on a machine of the other byte order is recognised and refused*/
+#define SNAPSHOT_BYTE_ORDER 0x01020304u
+
+/*Fixed header at the start of a snapshot, each section is a plain array at the given byte offset and starts on an 8 byte boundary*/
+struct snapshotHeader{
+
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint64_t fileSize;
+    uint64_t createdAt;
+    uint32_t productCount;
+    /*One more than the highest categoryID*/
+    uint32_t categorySlots;
+    /*Number of category links, and of entries in categoryRows, which lists a product once for each link or once in slot 0 when it has none*/
+    uint32_t linkCount;
+    uint32_t categoryRowCount;
+    /*int32 productIDs in ascending order, then double prices and quantities and int32 categoryIDs, one entry per product*/
+    uint64_t productIDs;
+    uint64_t prices;
+    uint64_t quantities;
+    uint64_t categoryIDs;
+    /*productCount + 1 uint32 offsets into the name pool, each name is followed by a NUL*/
+    uint64_t nameOffsets;
+    uint64_t names;
+    uint64_t namesSize;
+    /*productCount + 1 uint32 offsets into the int32 categoryIDs each product is linked to, in ascending order*/
+    uint64_t linkStarts;
+    uint64_t links;
+    /*uint32 rows grouped by category in productID order, categoryStarts has categorySlots + 2 entries, slot 0 for products without a category and slot categoryID + 1 for each category*/
+    uint64_t categoryRows;
+    uint64_t categoryStarts;
+    /*categorySlots + 1 uint32 offsets into the category name pool, an unused categoryID has an empty name*/
+    uint64_t categoryNameOffsets;
+    uint64_t categoryNames;
+    uint64_t categoryNamesSize;
+};
+
+/*Growable buffer a snapshot section is gathered in before it is written*/
+struct snapshotBuffer{
+
+    char *data;
+    size_t size;
+    size_t capacity;
+};
+
+/*Appends bytes to a section, returns 1 if it could not grow*/
+int appendSnapshot(struct snapshotBuffer *buffer, const void *data, size_t size){
+
+    if(buffer->size + size > buffer->capacity){
+
+        size_t capacity = buffer->capacity == 0 ? 4096 : buffer->capacity;
+
+        while(capacity < buffer->size + size){
+            capacity *= 2;
+        }
+
+        char *grown = realloc(buffer->data, capacity);
+
+        if(grown == NULL){
+            return 1;
+        }
+
+        buffer->data = grown;
+        buffer->capacity = capacity;
+    }
+
+    memcpy(buffer->data + buffer->size, data, size);
+    buffer->size += size;
+
+    return 0;
+}
+
+/*Writes a section after the ones already in the file and records where it starts, padding it to 8 bytes so every array in the mapped file is aligned*/
+int writeSnapshotSection(FILE *file, const void *data, size_t size, uint64_t *offset){
+
+    static const char padding[8] = {0};
+    long position = ftell(file);
+
+    *offset = position;
+
+    if(size > 0 && fwrite(data, 1, size, file) != size){
+        return 1;
+    }
+
+    size_t pad = (8 - size % 8) % 8;
+
+    return pad > 0 && fwrite(padding, 1, pad, file) != pad;
+}
+
+/*Writes the products, their category links and the category table into a binary snapshot that openCatalogSnapshot maps straight into memory, the file is replaced atomically so readers with the old one mapped keep a consistent copy*/
+int exportSnapshot(sqlite3 *db, const char *filename, long *products){
+
+    struct timespec started = startMetric();
+    struct snapshotBuffer productIDs = {0}, prices = {0}, quantities = {0}, categoryIDs = {0}, nameOffsets = {0}, names = {0};
+    struct snapshotBuffer linkStarts = {0}, links = {0};
+    struct snapshotBuffer categoryNameOffsets = {0}, categoryNames = {0};
+    struct snapshotHeader header;
+    uint32_t *categoryRows = NULL;
+    uint32_t *categoryStarts = NULL;
+    sqlite3_stmt *res = NULL;
+    int categorySlots = 0;
+    uint32_t linkCount = 0;
+    uint32_t unlinked = 0;
+    int32_t lastProductID = 0;
+    int failed = 0;
+    int rc;
+
+    *products = 0;
+
+    /*Both queries read inside one transaction so the products and categories match, a transaction that is already open is read from as it is*/
+    int ownTransaction = sqlite3_get_autocommit(db);
+
+    if(ownTransaction && execControl(db, "BEGIN") != 0){
+        return endMetric(METRIC_SNAPSHOT, &started, 0, 1);
+    }
+
+    /*A product comes back once for each of its category links, lowest first, which is the one kept in categoryIDs*/
+    if(sqlite3_prepare_v2(db, "SELECT PRODUCT.productID, PRODUCT.name, PRODUCT.price, PRODUCT.quantity, PRODUCT_CAT.categoryID FROM PRODUCT LEFT JOIN PRODUCT_CAT ON PRODUCT_CAT.productID = PRODUCT.productID ORDER BY PRODUCT.productID, PRODUCT_CAT.categoryID", -1, &res, 0) != SQLITE_OK){
+        failed = 1;
+    }
+
+    while(!failed && (rc = sqlite3_step(res)) == SQLITE_ROW){
+
+        int32_t productID = sqlite3_column_int(res, 0);
+        int32_t categoryID = columnCategoryID(res, 4);
+
+        if(categoryID >= categorySlots){
+            categorySlots = categoryID + 1;
+        }
+
+        /*The rows after a product's first only add a link*/
+        if(*products > 0 && productID == lastProductID){
+            failed |= appendSnapshot(&links, &categoryID, sizeof(categoryID));
+            linkCount += 1;
+            continue;
+        }
+
+        double price = sqlite3_column_double(res, 2);
+        double quantity = sqlite3_column_double(res, 3);
+        uint32_t offset = names.size;
+        const char *name = (const char *) sqlite3_column_text(res, 1);
+
+        failed |= appendSnapshot(&linkStarts, &linkCount, sizeof(linkCount));
+
+        if(categoryID == CATEGORY_NOT_FOUND){
+            unlinked += 1;
+        } else {
+            failed |= appendSnapshot(&links, &categoryID, sizeof(categoryID));
+            linkCount += 1;
+        }
+
+        failed |= appendSnapshot(&productIDs, &productID, sizeof(productID));
+        failed |= appendSnapshot(&prices, &price, sizeof(price));
+        failed |= appendSnapshot(&quantities, &quantity, sizeof(quantity));
+        failed |= appendSnapshot(&categoryIDs, &categoryID, sizeof(categoryID));
+        failed |= appendSnapshot(&nameOffsets, &offset, sizeof(offset));
+        failed |= appendSnapshot(&names, name != NULL ? name : "", (name != NULL ? sqlite3_column_bytes(res, 1) : 0) + 1);
+
+        lastProductID = productID;
+        *products += 1;
+    }
+
+    if(!failed && rc != SQLITE_DONE){
+        failed = 1;
+    }
+
+    sqlite3_finalize(res);
+    res = NULL;
+
+    /*The closing offset lets the length of the last name be worked out like the others*/
+    uint32_t namesEnd = names.size;
+    failed |= appendSnapshot(&nameOffsets, &namesEnd, sizeof(namesEnd));
+    failed |= appendSnapshot(&linkStarts, &linkCount, sizeof(linkCount));
+
+    if(!failed && sqlite3_prepare_v2(db, "SELECT categoryID, name FROM CATEGORY WHERE categoryID >= 0 ORDER BY categoryID", -1, &res, 0) != SQLITE_OK){
+        failed = 1;
+    }
+
+    int nextCategory = 0;
+
+    while(!failed && (rc = sqlite3_step(res)) == SQLITE_ROW){
+
+        int categoryID = sqlite3_column_int(res, 0);
+        const char *name = (const char *) sqlite3_column_text(res, 1);
+
+        /*Unused categoryIDs get an empty name so the offsets can be indexed by categoryID*/
+        for(; nextCategory <= categoryID; nextCategory++){
+
+            uint32_t offset = categoryNames.size;
+
+            failed |= appendSnapshot(&categoryNameOffsets, &offset, sizeof(offset));
+
+            if(nextCategory == categoryID && name != NULL){
+                failed |= appendSnapshot(&categoryNames, name, strlen(name));
+            }
+            failed |= appendSnapshot(&categoryNames, "", 1);
+        }
+    }
+
+    if(!failed && rc != SQLITE_DONE){
+        failed = 1;
+    }
+
+    sqlite3_finalize(res);
+
+    if(failed){
+        stockMessage(STOCK_ERROR, "SQL error: %s\n", sqlite3_errmsg(db));
+    }
+
+    if(ownTransaction){
+        sqlite3_exec(db, "COMMIT", 0, 0, 0);
+    }
+
+    if(nextCategory > categorySlots){
+        categorySlots = nextCategory;
+    }
+
+    for(; !failed && nextCategory < categorySlots; nextCategory++){
+
+        uint32_t offset = categoryNames.size;
+
+        failed |= appendSnapshot(&categoryNameOffsets, &offset, sizeof(offset));
+        failed |= appendSnapshot(&categoryNames, "", 1);
+    }
+
+    uint32_t categoryNamesEnd = categoryNames.size;
+    failed |= appendSnapshot(&categoryNameOffsets, &categoryNamesEnd, sizeof(categoryNamesEnd));
+
+    /*Rows are grouped by category with a counting sort, rows were read in productID order so each group stays in that order*/
+    long count = *products;
+    uint32_t categoryRowCount = linkCount + unlinked;
+
+    categoryRows = malloc(sizeof(uint32_t) * (categoryRowCount > 0 ? categoryRowCount : 1));
+    /*One spare entry is needed while the counts are turned into starts*/
+    categoryStarts = calloc(categorySlots + 3, sizeof(uint32_t));
+
+    if(!failed && (categoryRows == NULL || categoryStarts == NULL)){
+        stockMessage(STOCK_ERROR, "Snapshot could not be allocated\n");
+        failed = 1;
+    }
+
+    if(!failed){
+
+        const uint32_t *rowLinks = (const uint32_t *) linkStarts.data;
+        const int32_t *linkCategories = (const int32_t *) links.data;
+        uint32_t link;
+        long row;
+        int slot;
+
+        /*A product is counted in the slot of each of its categories, categoryID + 1, or in slot 0 when it has none. Slots are counted two entries along so the sums below leave each slot's start one entry along*/
+        for(row = 0; row < count; row++){
+
+            if(rowLinks[row] == rowLinks[row + 1]){
+                categoryStarts[2] += 1;
+            }
+
+            for(link = rowLinks[row]; link < rowLinks[row + 1]; link++){
+                categoryStarts[linkCategories[link] + 3] += 1;
+            }
+        }
+
+        for(slot = 2; slot < categorySlots + 3; slot++){
+            categoryStarts[slot] += categoryStarts[slot - 1];
+        }
+
+        /*Each slot fills from its start, which leaves that entry holding the start of the next slot*/
+        for(row = 0; row < count; row++){
+
+            if(rowLinks[row] == rowLinks[row + 1]){
+                categoryRows[categoryStarts[1]++] = row;
+            }
+
+            for(link = rowLinks[row]; link < rowLinks[row + 1]; link++){
+                categoryRows[categoryStarts[linkCategories[link] + 2]++] = row;
+            }
+        }
+    }
+
+    char partial[320];
+    FILE *file = NULL;
+
+    snprintf(partial, sizeof(partial), "%s.part", filename);
+
+    if(!failed && (file = fopen(partial, "wb")) == NULL){
+        stockMessage(STOCK_ERROR, "Snapshot file %s could not be created\n", partial);
+        failed = 1;
+    }
+
+    if(!failed){
+
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+        header.version = SNAPSHOT_VERSION;
+        header.byteOrder = SNAPSHOT_BYTE_ORDER;
+        header.createdAt = time(NULL);
+        header.productCount = count;
+        header.categorySlots = categorySlots;
+        header.linkCount = linkCount;
+        header.categoryRowCount = categoryRowCount;
+        header.namesSize = names.size;
+        header.categoryNamesSize = categoryNames.size;
+
+        /*The header is written again at the end once every offset is known*/
+        failed |= fwrite(&header, sizeof(header), 1, file) != 1;
+        failed |= writeSnapshotSection(file, productIDs.data, productIDs.size, &header.productIDs);
+        failed |= writeSnapshotSection(file, prices.data, prices.size, &header.prices);
+        failed |= writeSnapshotSection(file, quantities.data, quantities.size, &header.quantities);
+        failed |= writeSnapshotSection(file, categoryIDs.data, categoryIDs.size, &header.categoryIDs);
+        failed |= writeSnapshotSection(file, nameOffsets.data, nameOffsets.size, &header.nameOffsets);
+        failed |= writeSnapshotSection(file, names.data, names.size, &header.names);
+        failed |= writeSnapshotSection(file, linkStarts.data, linkStarts.size, &header.linkStarts);
+        failed |= writeSnapshotSection(file, links.data, links.size, &header.links);
+        failed |= writeSnapshotSection(file, categoryRows, sizeof(uint32_t) * categoryRowCount, &header.categoryRows);
+        failed |= writeSnapshotSection(file, categoryStarts, sizeof(uint32_t) * (categorySlots + 2), &header.categoryStarts);
+        failed |= writeSnapshotSection(file, categoryNameOffsets.data, categoryNameOffsets.size, &header.categoryNameOffsets);
+        failed |= writeSnapshotSection(file, categoryNames.data, categoryNames.size, &header.categoryNames);
+
+        header.fileSize = ftell(file);
+
+        failed |= fseek(file, 0, SEEK_SET) != 0;
+        failed |= fwrite(&header, sizeof(header), 1, file) != 1;
+        failed |= fclose(file) != 0;
+
+        if(failed){
+            stockMessage(STOCK_ERROR, "Snapshot file %s could not be written\n", partial);
+        } else if(rename(partial, filename) != 0){
+            stockMessage(STOCK_ERROR, "Snapshot could not be renamed to %s: %s\n", filename, strerror(errno));
+            failed = 1;
+        }
+
+        if(failed){
+            remove(partial);
+        }
+    }
+
+    free(productIDs.data);
+    free(prices.data);
+    free(quantities.data);
+    free(categoryIDs.data);
+    free(nameOffsets.data);
+    free(names.data);
+    free(linkStarts.data);
+    free(links.data);
+    free(categoryNameOffsets.data);
+    free(categoryNames.data);
+    free(categoryRows);
+    free(categoryStarts);
+
+    return endMetric(METRIC_SNAPSHOT, &started, failed ? 0 : *products, failed);
+}
+
+/*Returns 1 if a section of count entries of size bytes lies inside the mapped file and is aligned for its type*/
+int snapshotSectionFits(const struct catalogSnapshot *snapshot, uint64_t offset, uint64_t count, size_t size){
+
+    return offset >= sizeof(struct snapshotHeader) && offset % 8 == 0 && offset <= snapshot->size && count <= (snapshot->size - offset) / size;
+}
+
+/*Maps a snapshot written by exportSnapshot, nothing is parsed or copied apart from the category names, which become the ones getCategoryName and getCategoryID answer with*/
+int openCatalogSnapshot(const char *filename, struct catalogSnapshot *snapshot){
+
+    struct stat status;
+
+    memset(snapshot, 0, sizeof(struct catalogSnapshot));
+
+    int descriptor = open(filename, O_RDONLY);
+
+    if(descriptor < 0 || fstat(descriptor, &status) != 0){
+        stockMessage(STOCK_ERROR, "Snapshot %s could not be opened: %s\n", filename, strerror(errno));
+        if(descriptor >= 0){
+            close(descriptor);
+        }
+        return 1;
+    }
+
+    snapshot->size = status.st_size;
+
+    if(snapshot->size < sizeof(struct snapshotHeader)){
+        stockMessage(STOCK_ERROR, "%s is not a snapshot this program can read\n", filename);
+        close(descriptor);
+        return 1;
+    }
+
+    /*A shared read only mapping means every process that opens the same snapshot reads the same pages of the page cache*/
+    snapshot->map = mmap(NULL, snapshot->size, PROT_READ, MAP_SHARED, descriptor, 0);
+    close(descriptor);
+
+    if(snapshot->map == MAP_FAILED){
+        stockMessage(STOCK_ERROR, "Snapshot %s could not be mapped\n", filename);
+        snapshot->map = NULL;
+        return 1;
+    }
+
+    const struct snapshotHeader *header = snapshot->map;
+    uint32_t count = header->productCount;
+    uint32_t slots = header->categorySlots;
+
+    int valid = memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) == 0
+        && header->version == SNAPSHOT_VERSION
+        && header->byteOrder == SNAPSHOT_BYTE_ORDER
+        && header->fileSize == snapshot->size
+        && snapshotSectionFits(snapshot, header->productIDs, count, sizeof(int32_t))
+        && snapshotSectionFits(snapshot, header->prices, count, sizeof(double))
+        && snapshotSectionFits(snapshot, header->quantities, count, sizeof(double))
+        && snapshotSectionFits(snapshot, header->categoryIDs, count, sizeof(int32_t))
+        && snapshotSectionFits(snapshot, header->nameOffsets, (uint64_t) count + 1, sizeof(uint32_t))
+        && snapshotSectionFits(snapshot, header->names, header->namesSize, 1)
+        && snapshotSectionFits(snapshot, header->linkStarts, (uint64_t) count + 1, sizeof(uint32_t))
+        && snapshotSectionFits(snapshot, header->links, header->linkCount, sizeof(int32_t))
+        && snapshotSectionFits(snapshot, header->categoryRows, header->categoryRowCount, sizeof(uint32_t))
+        && snapshotSectionFits(snapshot, header->categoryStarts, (uint64_t) slots + 2, sizeof(uint32_t))
+        && snapshotSectionFits(snapshot, header->categoryNameOffsets, (uint64_t) slots + 1, sizeof(uint32_t))
+        && snapshotSectionFits(snapshot, header->categoryNames, header->categoryNamesSize, 1);
+
+    const char *base = snapshot->map;
+    uint32_t slot;
+
+    /*A category listing reads categoryRows between two starts, so the starts must never fall back or run past the rows. There are only a few of them, so they are checked here rather than on every read. Link ranges are checked as they are read like the names*/
+    if(valid){
+
+        const uint32_t *categoryStarts = (const uint32_t *) (base + header->categoryStarts);
+
+        for(slot = 1; slot < slots + 2 && valid; slot++){
+            valid = categoryStarts[slot - 1] <= categoryStarts[slot];
+        }
+
+        valid = valid && categoryStarts[slots + 1] <= header->categoryRowCount;
+    }
+
+    if(!valid){
+        stockMessage(STOCK_ERROR, "%s is not a snapshot this program can read\n", filename);
+        closeCatalogSnapshot(snapshot);
+        return 1;
+    }
+
+    snapshot->productCount = count;
+    snapshot->categorySlots = slots;
+    snapshot->productIDs = (const int32_t *) (base + header->productIDs);
+    snapshot->prices = (const double *) (base + header->prices);
+    snapshot->quantities = (const double *) (base + header->quantities);
+    snapshot->categoryIDs = (const int32_t *) (base + header->categoryIDs);
+    snapshot->nameOffsets = (const uint32_t *) (base + header->nameOffsets);
+    snapshot->names = base + header->names;
+    snapshot->namesSize = header->namesSize;
+    snapshot->linkStarts = (const uint32_t *) (base + header->linkStarts);
+    snapshot->links = (const int32_t *) (base + header->links);
+    snapshot->linkCount = header->linkCount;
+    snapshot->categoryRows = (const uint32_t *) (base + header->categoryRows);
+    snapshot->categoryStarts = (const uint32_t *) (base + header->categoryStarts);
+    snapshot->categoryRowCount = header->categoryRowCount;
+
+    /*Only the small category table is copied, into the same index the database loads*/
+    const uint32_t *categoryNameOffsets = (const uint32_t *) (base + header->categoryNameOffsets);
+    const char *categoryNames = base + header->categoryNames;
+
+    freeCategoryIndex();
+
+    for(slot = 0; slot < slots; slot++){
+
+        uint32_t offset = categoryNameOffsets[slot];
+
+        if(offset < header->categoryNamesSize && categoryNames[offset] != 0 && memchr(categoryNames + offset, 0, header->categoryNamesSize - offset) != NULL){
+            if(setCategoryName(slot, categoryNames + offset) != 0){
+                closeCatalogSnapshot(snapshot);
+                return 1;
+            }
+        }
+    }
+
+    if(buildCategoryHash() != 0){
+        closeCatalogSnapshot(snapshot);
+        return 1;
+    }
+
+    return 0;
+}
+
+/*Unmaps a snapshot, iterators over it must be closed first*/
+void closeCatalogSnapshot(struct catalogSnapshot *snapshot){
+
+    if(snapshot->map != NULL){
+        munmap(snapshot->map, snapshot->size);
+    }
+
+    memset(snapshot, 0, sizeof(struct catalogSnapshot));
+}
+
+/*Points an iterator at rows of a snapshot, rows is NULL when the positions are the rows themselves. The range is kept inside the rows there are*/
+void openSnapshotRows(const struct catalogSnapshot *snapshot, const uint32_t *rows, uint32_t position, uint32_t end, struct productIterator *it){
+
+    uint32_t limit = rows != NULL ? snapshot->categoryRowCount : (uint32_t) snapshot->productCount;
+
+    if(end > limit){
+        end = limit;
+    }
+
+    if(position > end){
+        position = end;
+    }
+
+    it->source = PRODUCTS_FROM_SNAPSHOT;
+    it->snapshot = snapshot;
+    it->snapshotRows = rows;
+    it->position = position;
+    it->end = end;
+}
+
+/*Every product in the snapshot in productID order*/
+int openSnapshotProducts(const struct catalogSnapshot *snapshot, struct productIterator *it){
+
+    startProducts(NULL, METRIC_LIST, it);
+    openSnapshotRows(snapshot, NULL, 0, snapshot->productCount, it);
+
+    return 0;
+}
+
+/*The product with a productID, found by a binary search of the sorted productIDs*/
+int openSnapshotProductByID(const struct catalogSnapshot *snapshot, int id, struct productIterator *it){
+
+    int low = 0;
+    int high = snapshot->productCount;
+
+    startProducts(NULL, METRIC_READ_BY_ID, it);
+
+    while(low < high){
+
+        int middle = low + (high - low) / 2;
+
+        if(snapshot->productIDs[middle] < id){
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    /*Like the database lookup, a product without a category link is not found by its productID*/
+    if(low < snapshot->productCount && snapshot->productIDs[low] == id && snapshot->categoryIDs[low] != CATEGORY_NOT_FOUND){
+        openSnapshotRows(snapshot, NULL, low, low + 1, it);
+    } else {
+        openSnapshotRows(snapshot, NULL, 0, 0, it);
+    }
+
+    return 0;
+}
+
+/*The products of a category, read from the rows the snapshot groups by category*/
+int openSnapshotProductsByCategory(const struct catalogSnapshot *snapshot, int categoryID, struct productIterator *it){
+
+    startProducts(NULL, METRIC_FIND_BY_CATEGORY, it);
+
+    if(categoryID < 0 || categoryID >= snapshot->categorySlots){
+        openSnapshotRows(snapshot, NULL, 0, 0, it);
+        return 0;
+    }
+
+    openSnapshotRows(snapshot, snapshot->categoryRows, snapshot->categoryStarts[categoryID + 1], snapshot->categoryStarts[categoryID + 2], it);
+
+    return 0;
+}
+
+/*Opens the database and prepares everything the data functions rely on, returns NULL if the database could not be opened*/
+sqlite3 *openStockDatabase(){
+
+    /*initialises the database*/
+    sqlite3 *db = initialiseDatabase();
+
+    if(db == NULL){
+        return NULL;
+    }
+
+    /*creates all three tables within the database*/
+    createTable(db);
+    /*Brings older database files up to the current schema version*/
+    migrateDatabase(db);
+    /*Prepares every query once, the statements are reused until the database is closed*/
+    prepareStatements(db);
+    /*Brings the categories table in line with the 'categories.txt' file when the file has changed*/
+    setCategories(db);
+    /*Builds the in-memory category index used for every lookup by category name or categoryID*/
+    loadCategoryIndex(db);
+    /*Holds every product in memory so lookups by productID, category listings and full listings skip sqlite*/
+    if(strcasecmp(settings.productCache, "ON") == 0){
+        loadProductCache(db);
+    }
+
+    return db;
+}
+
+/*Opens a read only connection for a reader thread with its own prepared statements*/
+sqlite3 *openStockReader(){
+
+    sqlite3 *db;
+
+    if(sqlite3_open_v2(settings.path, &db, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK){
+        stockMessage(STOCK_ERROR, "Reader connection could not be opened: %s\n", sqlite3_errmsg(db));
+        sqlite3_close(db);
+        return NULL;
+    }
+
+    applyDatabaseSettings(db, 1);
+
+    if(prepareStatements(db) != 0){
+        closeDB(db);
+        return NULL;
+    }
+
+    return db;
+}
+
+/*Closes a connection opened by openStockReader*/
+void closeStockReader(sqlite3 *db){
+
+    closeDB(db);
+}
+
+/*Releases everything set up by openStockDatabase*/
+void closeStockDatabase(sqlite3 *db){
+
+    freeCategoryIndex();
+    freeProductCache();
+    closeDB(db);
+}
@@ -0,0 +1,444 @@
+#ifndef STOCK_DATA_H
+#define STOCK_DATA_H
+
+#include <stdio.h>
+#include <time.h>
+#include <limits.h>
+#include <stdint.h>
+#include <sqlite3.h>
+
+/*Data access for the stock database, shared by the menu, the commands, the server and the benchmark. Nothing in here reads from or prints to the terminal, products are handed back as structs and iterators and any message goes to the handler set with setStockMessageHandler*/
+
+/*How much a library message matters, the application decides which ones it shows*/
+enum stockMessageLevel{
+    /*Routine progress such as tables being configured, which a command can leave out*/
+    STOCK_STATUS,
+    /*Something the user should know about even though nothing failed, such as a migration or a rejected import line*/
+    STOCK_NOTICE,
+    STOCK_ERROR
+};
+
+/*Receives each library message as a complete line*/
+typedef void (*stockMessageHandler)(enum stockMessageLevel level, const char *message);
+
+/*Sets where library messages go, without a handler notices and errors are written to standard error and status messages are dropped*/
+void setStockMessageHandler(stockMessageHandler handler);
+
+/*Settings applied to the database connection when it is opened, each one can be overridden by an environment variable*/
+struct databaseSettings{
+
+    const char *path;
+    const char *journalMode;
+    const char *synchronous;
+    const char *cacheSize;
+    const char *mmapSize;
+    const char *tempStore;
+    const char *busyTimeout;
+    const char *productCache;
+    const char *pageSize;
+    const char *backupDirectory;
+    /*Backups kept once a new one is written, 0 keeps every backup*/
+    const char *backupKeep;
+    /*Minutes between the server's own backups, 0 switches them off*/
+    const char *backupInterval;
+};
+
+/*Returns the settings in effect, they are read from the environment when the database is opened*/
+const struct databaseSettings *getDatabaseSettings();
+
+/*Opens the database, brings its schema and categories up to date and prepares every statement, returns NULL if it could not be opened*/
+sqlite3 *openStockDatabase();
+
+/*Opens a read only connection to the same database with its own prepared statements, for a thread that only reads*/
+sqlite3 *openStockReader();
+
+/*Closes a connection opened by openStockReader*/
+void closeStockReader(sqlite3 *db);
+
+/*Closes the database opened by openStockDatabase and frees the category index and the product cache*/
+void closeStockDatabase(sqlite3 *db);
+
+/*Data operations that are timed and counted*/
+enum metricID{
+
+    METRIC_INSERT,
+    METRIC_FIND_BY_NAME,
+    METRIC_FIND_BY_CATEGORY,
+    METRIC_READ_BY_ID,
+    METRIC_LIST,
+    METRIC_CHANGE_NAME,
+    METRIC_CHANGE_PRICE,
+    METRIC_CHANGE_QUANTITY,
+    METRIC_CHANGE_CATEGORY,
+    METRIC_DELETE,
+    METRIC_IMPORT,
+    METRIC_REPORT,
+    METRIC_SEARCH,
+    METRIC_PAGE,
+    METRIC_BULK,
+    METRIC_ADJUST_QUANTITY,
+    METRIC_COMPACT,
+    METRIC_REORDER_LEVEL,
+    METRIC_LOW_STOCK,
+    METRIC_BACKUP,
+    METRIC_SNAPSHOT,
+    METRIC_CATEGORY_FILTER,
+    METRIC_COUNT
+};
+
+/*Reads the clock at the start of an operation*/
+struct timespec startMetric();
+
+/*Records a finished operation and passes its result straight back, so it can wrap each return statement*/
+int endMetric(enum metricID id, struct timespec *started, long rows, int result);
+
+/*Writes the operation counters followed by sqlite's cache and statement statistics for every open connection*/
+void printMetrics(FILE *out);
+
+/*productID given to a new product when sqlite should assign the next free rowid itself*/
+#define AUTO_PRODUCT_ID -1
+
+/*Use of structs, used when adding data to the database so only a single data structure needs to be passed through as a parameter*/
+struct product{
+
+    char name[20];
+    int productID;
+    int categoryID;
+    double price;
+    double quantity;
+};
+
+/*Checks and conversions for numbers typed by the user or read from a file*/
+long int strToInt(char *string);
+int intCheck(char *string);
+long double strToDbl(char *string);
+int doubleCheck(char *string);
+
+/*Returned by category lookups when no category matches, categoryIDs start at 0 so any negative value is free*/
+#define CATEGORY_NOT_FOUND -1
+
+/*File the category names are read from, one name per line*/
+#define CATEGORY_FILE "categories.txt"
+
+/*Gets the category id associated with a specific category name, returns CATEGORY_NOT_FOUND if there is no match*/
+int getCategoryID(const char *categoryName);
+
+/*Returns the category name for a categoryID, or None when there is no such category*/
+const char *getCategoryName(int categoryID);
+
+/*Returns one more than the highest categoryID, not every ID below it has to be in use*/
+int getCategoryCount();
+
+/*Returns 1 if categoryID belongs to a category*/
+int hasCategory(int categoryID);
+
+/*Most categories a single product can belong to, a product in several is listed under its lowest categoryID wherever only one is shown*/
+#define MAX_PRODUCT_CATEGORIES 16
+/*Room for the categoryIDs of one product written out with commas between them*/
+#define CATEGORY_LIST_LENGTH (MAX_PRODUCT_CATEGORIES * 12)
+
+/*Returns 1 if the product cache is switched on and loaded*/
+int isProductCacheLoaded();
+
+/*How a name search matches the text it is given*/
+enum searchMode{
+    SEARCH_PREFIX,
+    SEARCH_SUBSTRING,
+    SEARCH_FUZZY
+};
+
+/*The text index is built from three character sequences, so shorter search text cannot use it*/
+#define SEARCH_MIN_LENGTH 3
+/*Results shown when no --limit is given*/
+#define SEARCH_DEFAULT_LIMIT 20
+
+/*Where a productIterator takes its rows from*/
+enum productSource{
+    PRODUCTS_FROM_STATEMENT,
+    PRODUCTS_FROM_CACHE,
+    PRODUCTS_FROM_ARRAY,
+    PRODUCTS_FROM_SNAPSHOT,
+    /*productIDs picked by a category filter, read one at a time from the cache or the database*/
+    PRODUCTS_FROM_FILTER
+};
+
+/*Held by an iterator over fuzzy search results, defined with the search code*/
+struct fuzzyCandidate;
+struct cachedChunk;
+
+/*A catalogue snapshot mapped into memory by openCatalogSnapshot, every array points straight into the file*/
+struct catalogSnapshot{
+
+    void *map;
+    size_t size;
+    int productCount;
+    int categorySlots;
+    /*Row i of each column belongs to productIDs[i], which are in ascending order*/
+    const int32_t *productIDs;
+    const double *prices;
+    const double *quantities;
+    const int32_t *categoryIDs;
+    /*Name of row i starts at names + nameOffsets[i] and is NUL terminated*/
+    const uint32_t *nameOffsets;
+    const char *names;
+    uint64_t namesSize;
+    /*Category links of row i are links[linkStarts[i]] up to links[linkStarts[i + 1]] in ascending order, categoryIDs[i] is the lowest of them*/
+    const uint32_t *linkStarts;
+    const int32_t *links;
+    uint32_t linkCount;
+    /*Rows of category c are categoryRows[categoryStarts[c + 1]] up to categoryRows[categoryStarts[c + 2]], a row is listed under every category it is linked to*/
+    const uint32_t *categoryRows;
+    const uint32_t *categoryStarts;
+    uint32_t categoryRowCount;
+};
+
+/*Walks the products of a listing one at a time, whether they come from a prepared statement, the product cache or a sorted search result. Only one iterator can be open on a connection at a time and products must not be changed while it is open*/
+struct productIterator{
+
+    enum productSource source;
+    enum metricID metric;
+    struct timespec started;
+    /*Products returned so far, and whether the listing went wrong part way through*/
+    long rows;
+    int failed;
+    int done;
+    /*Products returned before the iterator stops, -1 for no limit, more is set once a product is left over*/
+    int limit;
+    int more;
+    /*Full name of the current product, which product.name may hold cut short, valid until the next call to nextProduct*/
+    const char *name;
+    int nameLength;
+    /*Every categoryID of the current product in ascending order with commas between them, NULL when it has only the one in product.categoryID. Valid until the next call to nextProduct*/
+    const char *categoryList;
+    char categoryText[CATEGORY_LIST_LENGTH];
+    /*Set when a statement gives a row for each category link of a product. Those rows are merged into one product, which means stepping past them, so the result of that step is held for the next call and the name is copied to heldName*/
+    int mergeLinks;
+    int heldStep;
+    char *heldName;
+    int heldNameCapacity;
+
+    sqlite3 *db;
+    sqlite3_stmt *res;
+    /*Every row of a statement belongs to this category, or the category is read from each row when it is CATEGORY_NOT_FOUND. The cache skips rows in other categories*/
+    int categoryID;
+    /*Next and end position within the array of search results or filtered productIDs. For the cache they are the lowest productID not yet looked at and one past the highest wanted*/
+    int position;
+    int end;
+    struct fuzzyCandidate *candidates;
+    /*Cached rows are copied out a chunk at a time under the cache's read lock, so the lock is never held while the caller writes rows out*/
+    struct cachedChunk *chunk;
+    /*Snapshot being read and the rows to read from it, every row in order when snapshotRows is NULL*/
+    const struct catalogSnapshot *snapshot;
+    const uint32_t *snapshotRows;
+    /*Products matched by a category filter in ascending order*/
+    int *productIDs;
+};
+
+/*Each of these opens an iterator and returns 0, or returns 1 with nothing left to close when the listing could not be started*/
+int openProductsByName(sqlite3 *db, const char *name, struct productIterator *it);
+int openProductsByCategory(sqlite3 *db, int categoryID, struct productIterator *it);
+int openProductByID(sqlite3 *db, int id, struct productIterator *it);
+int openAllProducts(sqlite3 *db, struct productIterator *it);
+
+/*Up to limit products in productID order after afterID, every category when categoryID is CATEGORY_NOT_FOUND, more is set when another page follows*/
+int openProductPage(sqlite3 *db, int categoryID, int afterID, int limit, struct productIterator *it);
+
+/*Products at or below their reorder level in productID order, from every category when categoryID is CATEGORY_NOT_FOUND*/
+int openLowStock(sqlite3 *db, int categoryID, struct productIterator *it);
+
+/*Products in every category of allOf, in at least one of anyOf and in none of noneOf, in productID order. Lists can be empty as long as one is not, with only noneOf every product with a category is the starting point*/
+int openCategoryFilter(sqlite3 *db, const int *allOf, int allCount, const int *anyOf, int anyCount, const int *noneOf, int noneCount, struct productIterator *it);
+
+/*Products whose name starts with or contains text, or is spelt like it, best matches first*/
+int openNameSearch(sqlite3 *db, const char *text, enum searchMode mode, int limit, struct productIterator *it);
+
+/*Fills product with the next row, returns 0 when there are no more*/
+int nextProduct(struct productIterator *it, struct product *product);
+
+/*Finishes an iterator and records it in the metrics, returns 1 if the listing failed*/
+int closeProducts(struct productIterator *it);
+
+/*Reads a single product, returns 1 if it does not exist or could not be read*/
+int getProductByID(sqlite3 *db, int id, struct product *product);
+
+/*Returns 1 if a product with a category link has the productID, 0 if not and -1 if the check failed*/
+int productExists(sqlite3 *db, int id);
+
+/*productID to page from when the first page is wanted*/
+#define PAGE_FIRST INT_MIN
+/*productID to page back from when the last page is wanted*/
+#define PAGE_LAST INT_MAX
+
+/*Finds where the page ending just before beforeID starts, afterID is set so openProductPage reads that page and is PAGE_FIRST when it is the first page, returns 1 if no products come before beforeID*/
+int findPreviousPage(sqlite3 *db, int categoryID, int beforeID, int pageSize, int *afterID);
+
+/*Totals for one category in the stock report*/
+struct categoryTotals{
+
+    long products;
+    double units;
+    double value;
+    double lowPrice;
+    double highPrice;
+};
+
+/*Report totals are kept in getCategoryCount() + 1 buckets, bucket 0 collects products without a known category and bucket categoryID + 1 holds the products whose lowest numbered category it is*/
+void clearCategoryTotals(struct categoryTotals *totals, int bucketCount);
+int aggregateCachedProducts(struct categoryTotals *totals, int bucketCount);
+int aggregateStoredProducts(sqlite3 *db, struct categoryTotals *totals, int bucketCount);
+
+/*Starts a logical write operation, everything up to the matching endWrite is applied atomically, operations can be nested so several changes become one*/
+int beginWrite(sqlite3 *db);
+
+/*Ends a logical write operation, failed is non zero when the caller's part of the operation went wrong, returns 1 if the operation was not applied*/
+int endWrite(sqlite3 *db, int failed);
+
+/*Commits the open group transaction, returns 1 if the commit failed and every operation in the group was lost*/
+int commitGroup(sqlite3 *db);
+
+/*Lets up to maxOperations write operations, or as many as happen within maxMillis, share a single commit*/
+void startGroupCommit(int maxOperations, int maxMillis);
+
+/*Commits anything still pending and goes back to committing every operation on its own*/
+int finishGroupCommit(sqlite3 *db);
+
+/*How far group commits have got, compared before and after an operation to tell whether a group ended during it*/
+struct groupProgress{
+
+    /*Group transactions committed or rolled back so far, and how many of them were rolled back*/
+    long ended;
+    long failed;
+    /*Operations held in the group that is still open*/
+    int pending;
+};
+
+void getGroupProgress(struct groupProgress *progress);
+
+/*Each change is applied atomically and written through to the product cache, they return 1 if nothing was changed because of an error*/
+int insertData(sqlite3 *db, struct product tempProduct);
+int changeProductName(sqlite3 *db, int id, const char *name);
+int changeProductPrice(sqlite3 *db, int id, double price);
+int changeProductQuantity(sqlite3 *db, int id, double quantity);
+int changeProductCategory(sqlite3 *db, int id, int categoryID);
+int deleteStock(sqlite3 *db, int id);
+
+/*A product belongs to one or more categories. insertDataInCategories adds a product to extraCategoryIDs as well as tempProduct.categoryID, setProductCategories replaces every category of a product, and a product keeps at least one so removing its last category is refused. changeProductCategory is setProductCategories with a single category*/
+int insertDataInCategories(sqlite3 *db, struct product tempProduct, const int *extraCategoryIDs, int extraCount);
+int setProductCategories(sqlite3 *db, int id, const int *categoryIDs, int count);
+int addProductCategory(sqlite3 *db, int id, int categoryID);
+int removeProductCategory(sqlite3 *db, int id, int categoryID);
+
+/*Adds delta to a product's quantity inside sqlite and records it in the stock movement ledger with reason, a change that would leave the quantity below 0 is refused and one that takes it down to its reorder level sends a notice. quantity is set to the new quantity unless it is NULL*/
+int adjustProductQuantity(sqlite3 *db, int id, double delta, const char *reason, double *quantity);
+
+/*A product is low on stock once its quantity is at or below its reorder level. It uses its own level when it has one and its category's otherwise, passing NAN removes a level*/
+int setProductReorderLevel(sqlite3 *db, int id, double level);
+int setCategoryReorderLevel(sqlite3 *db, int categoryID, double level);
+
+/*One entry in the stock movement ledger, every change to a quantity is recorded as the amount it added or removed*/
+struct stockMovement{
+
+    long movementID;
+    double delta;
+    /*receive, sell, set for a quantity set outright or bulk for a bulk change*/
+    char reason[16];
+    long createdAt;
+};
+
+/*Quantity of a product once all of its movements up to movementID are counted, left behind when those movements are compacted*/
+struct stockSnapshot{
+
+    double quantity;
+    long movementID;
+    long createdAt;
+};
+
+/*Reads up to max of a product's movements newest first, count is set to the number read, returns 1 if they could not be read*/
+int getMovements(sqlite3 *db, int id, struct stockMovement *movements, int max, int *count);
+
+/*Reads the snapshot older movements of a product were folded into, returns 1 if there is none*/
+int getSnapshot(sqlite3 *db, int id, struct stockSnapshot *snapshot);
+
+/*Movements newer than this many days are kept by compaction unless told otherwise*/
+#define LEDGER_KEEP_DAYS 30
+
+/*Folds every movement recorded before the time given into the snapshot of its product, folded is set to the number of movements removed, returns 1 if the ledger was left unchanged*/
+int compactMovements(sqlite3 *db, time_t before, long *folded);
+
+/*Which products a bulk change applies to, clearProductFilter sets every field to match all products and each field that is then set narrows them down*/
+struct productFilter{
+
+    int categoryID;
+    /*SQL LIKE pattern, % matches any run of characters and _ any single one, ignoring case*/
+    const char *namePattern;
+    double minPrice;
+    double maxPrice;
+    double minQuantity;
+    double maxQuantity;
+};
+
+void clearProductFilter(struct productFilter *filter);
+
+/*Changes a bulk change can make to every product it matches*/
+enum bulkAction{
+    BULK_SET_PRICE,
+    /*Raises the price by value percent, or lowers it when value is negative, rounded to two decimal places*/
+    BULK_SCALE_PRICE,
+    BULK_SET_QUANTITY,
+    /*Adds value to the quantity, which stops at 0*/
+    BULK_ADJUST_QUANTITY,
+    /*Moves the products to the category whose categoryID is value*/
+    BULK_SET_CATEGORY,
+    BULK_DELETE
+};
+
+/*Products changed in each transaction of a bulk change when no chunk size is given*/
+#define BULK_CHUNK_SIZE 2000
+
+/*Applies action to every product filter matches, committing every chunkSize products, affected is set to the products changed in the chunks that were committed, returns 1 if a chunk failed and the rest were left unchanged*/
+int bulkModify(sqlite3 *db, const struct productFilter *filter, enum bulkAction action, double value, int chunkSize, long *affected);
+
+/*Outcome of an import*/
+struct importResult{
+
+    /*Set once the file has been opened, so a file that could not be read is told apart from an empty one*/
+    int opened;
+    long lines;
+    long imported;
+    long rejected;
+    double seconds;
+    /*Set when a database error stopped the import and its last batch was rolled back*/
+    int stopped;
+    /*Side file holding the rejected lines*/
+    char rejectName[300];
+};
+
+/*Streams a CSV or TSV file of name, category, price, quantity rows into the database in large transactions, returns 1 if the import failed*/
+int importStock(sqlite3 *db, const char *filename, struct importResult *result);
+
+/*Outcome of a backup*/
+struct backupResult{
+
+    char path[300];
+    int pages;
+    double seconds;
+    /*Older backups deleted to stay within the number kept*/
+    int removed;
+};
+
+/*Copies the live database into a new timestamped file in directory with the sqlite backup API, a few pages at a time so writers are never held up for long, then deletes all but the newest keep backups (0 keeps them all). Returns 1 if no backup was written*/
+int backupDatabase(const char *directory, int keep, struct backupResult *result);
+
+/*Writes every product and category into path as a fixed layout binary snapshot, products is set to the number written, returns 1 if no snapshot was written*/
+int exportSnapshot(sqlite3 *db, const char *path, long *products);
+
+/*Maps a snapshot for reading without a database, its categories become the ones getCategoryName and getCategoryID use, returns 1 if it could not be mapped or is not a snapshot of this version*/
+int openCatalogSnapshot(const char *path, struct catalogSnapshot *snapshot);
+void closeCatalogSnapshot(struct catalogSnapshot *snapshot);
+
+/*Iterators over a mapped snapshot, closed with closeProducts like any other*/
+int openSnapshotProducts(const struct catalogSnapshot *snapshot, struct productIterator *it);
+int openSnapshotProductByID(const struct catalogSnapshot *snapshot, int id, struct productIterator *it);
+int openSnapshotProductsByCategory(const struct catalogSnapshot *snapshot, int categoryID, struct productIterator *it);
+
+#endif
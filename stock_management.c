@@ -6,356 +6,533 @@
 #include <unistd.h>
 #include <signal.h>
 #include <ctype.h>
+#include <time.h>
+#include <math.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "stock_data.h"
+
+/*Set when the program runs a command or script rather than the menu, hides status messages so only results are printed*/
+static bool quietMode = false;
+
+/*Stream that command output is written to, each server thread points it at its own client while the rest of the program uses standard output*/
+static __thread FILE *commandOutput = NULL;
+
+/*Returns the stream that command output should be written to*/
+FILE *outputStream(){
+
+    return commandOutput != NULL ? commandOutput : stdout;
+}
 
-/*Used to initially open the database for the rest of the program, will create the db file if the file does not exist*/
-sqlite3 *initialiseDatabase(){
+/*Used in place of printf by everything a command can run, so the output reaches whoever issued the command*/
+int reply(const char *format, ...){
 
-    sqlite3 *db;
-    /*Holds the error message that is used in the event of an error when executing sqlite command*/
-    char *errMsg = 0;
+    va_list args;
 
-    int rc = sqlite3_open("stock_data.db", &db);
-    if (rc != SQLITE_OK) {
-        /*SQLITE_OK is an integer variable that is held as part of the sqlite library this represents a successful sqlite execution*/
-        printf("\n\nThe database has not been initialised successfully\n\n");
-        printf("\n%s\n", sqlite3_errmsg(db));
-    } else {
-        printf("\n\nThe database has been initialised successfully\n\n");
-        return db;
-    }
+    va_start(args, format);
+    int length = vfprintf(outputStream(), format, args);
+    va_end(args);
+
+    return length;
 }
 
-/*Closes the database when the function is called*/
-void closeDB(sqlite3 *db){
+/*Shows the messages of the stock data library the way the program shows its own, status messages are left out of commands and scripts*/
+void showStockMessage(enum stockMessageLevel level, const char *message){
 
-    sqlite3_close(db);
-}
+    if(level == STOCK_STATUS && quietMode){
+        return;
+    }
 
-/*Creates the tables for the database*/
-int createTable(sqlite3 *db){
+    reply("%s", message);
+}
 
-    /*Product table to hold the product productID, name, price and quantity*/
-    char *errMsg = 0;
-    char *data = "CREATE TABLE IF NOT EXISTS PRODUCT(productID INTEGER PRIMARY KEY, name TEXT, price REAL, quantity REAL);";
+/*Reads a PRAGMA back from the connection so the setting sqlite actually uses is shown*/
+void printPragma(sqlite3 *db, const char *pragma){
 
-    int rc = sqlite3_exec(db, data, 0, 0, &errMsg);
-   /*follows the structure of database, sqlite command, callback function (optional), pointer variable (optional), error message variable pointer (optional)*/
+    char query[64];
+    sqlite3_stmt *res;
 
-    if(rc != SQLITE_OK) {
+    snprintf(query, sizeof(query), "PRAGMA %s", pragma);
 
-        printf("\n%s\n", sqlite3_errmsg(db));
-        sqlite3_free(errMsg);/*sqlite library command to free up the error message from dynamic memory*/
+    if(sqlite3_prepare_v2(db, query, -1, &res, 0) != SQLITE_OK){
+        return;
+    }
 
-        return 1;
+    if(sqlite3_step(res) == SQLITE_ROW){
+        reply("  %-14s %s\n", pragma, sqlite3_column_text(res, 0));
     }
-    
-    /*Product Category table to link the productID to the categoryID*/
-    errMsg = 0;
-    char productCatData[100] = "CREATE TABLE IF NOT EXISTS PRODUCT_CAT(productID INTEGER, categoryID INTEGER);";
-    data = productCatData;
-    
-    rc = sqlite3_exec(db, data, 0, 0, &errMsg);
-    
 
-    if(rc != SQLITE_OK) {
-        printf("\n%s\n", sqlite3_errmsg(db));
-        sqlite3_free(errMsg);
+    sqlite3_finalize(res);
+}
 
-        return 1;
+/*Prints the effective database settings*/
+int printDatabaseSettings(sqlite3 *db){
+
+    const struct databaseSettings *settings = getDatabaseSettings();
+
+    reply("Database settings\n");
+    reply("  %-14s %s\n", "path", settings->path);
+    printPragma(db, "journal_mode");
+    printPragma(db, "synchronous");
+    printPragma(db, "cache_size");
+    printPragma(db, "mmap_size");
+    printPragma(db, "temp_store");
+    printPragma(db, "busy_timeout");
+    reply("  %-14s %s\n", "product_cache", settings->productCache);
+    reply("  %-14s %s\n", "page_size", settings->pageSize);
+    reply("  %-14s %s\n", "backup_dir", settings->backupDirectory);
+    reply("  %-14s %s\n", "backup_keep", settings->backupKeep);
+    reply("  %-14s %s\n", "backup_every", settings->backupInterval);
+
+    return 0;
+}
+
+/*Waits for SIGUSR1 on its own thread and dumps the metrics to standard error each time it arrives*/
+void *metricsSignalThread(void *arg){
+
+    sigset_t *signals = arg;
+    int received;
+
+    while(sigwait(signals, &received) == 0){
+        printMetrics(stderr);
     }
 
-    /*Category table to link the categoryID to the category name*/
-    errMsg = 0;
-    char catData[100] = "CREATE TABLE IF NOT EXISTS CATEGORY(categoryID INTEGER PRIMARY KEY, name TEXT);";
-    data = catData;
+    return NULL;
+}
 
-    rc = sqlite3_exec(db, data, 0, 0, &errMsg);
+/*Blocks SIGUSR1 in every thread and hands it to a dedicated thread, which can safely print where a signal handler cannot*/
+void startMetricsSignalThread(){
 
-    if(rc != SQLITE_OK) {
-        printf("\n%s\n", sqlite3_errmsg(db));
-        sqlite3_free(errMsg);
+    static sigset_t signals;
+    pthread_t thread;
 
-        return 1;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+    if(pthread_create(&thread, NULL, metricsSignalThread, &signals) == 0){
+        pthread_detach(thread);
     }
-    
+}
+
+/*Prints all categories out to the user from the showCategories query function*/
+int categoryCallback(void *unused, int numOfCols, char **fields, char **colNames){
+
+    int i;
 
-    printf("\nTables configured successfully\n");
+    for(i=0; i<numOfCols; i++){
+
+        /*Checks that the field is not empty*/
+       if(fields[i] != NULL){
+           /*Prints the fields name*/
+           printf("%s   ", fields[i]);
+       }
+    }
+    printf("\n");
 
     return 0;
 }
 
+/*Performs a query for all categories on the category table*/
+int showCategories(sqlite3 *db){
 
-/*Fetches the last primary key for the Product table so only unique productID's will be added to the database*/
-int getLastID(sqlite3 *db){
+    printf("Category options\n");
 
     char *errMsg = 0;
-    sqlite3_stmt *res;/*Variable to hold the result of the query*/
-    char *query = "SELECT productID FROM PRODUCT";
 
-    int rc = sqlite3_prepare_v2(db, query, -1, &res, 0);
+    /*Query to get */
+    char *query = "SELECT name FROM CATEGORY";
+
+    /*Execution command for sqlite, uses the categoryCallback function to print results*/  
+    int rc = sqlite3_exec(db, query, categoryCallback, 0, &errMsg);
 
+    /*Catches error then clears error from dynamic memory*/
     if(rc != SQLITE_OK){
         printf("SQL error: %s\n", errMsg);
         sqlite3_free(errMsg);
-        
-        return -1;
+    }
 
-    } else {
-        /*If the execution was successful the function will step through the query*/
-        int done = 0;
-        int lastID = -1;
-        /*lastID set to -1 variable to hold the last identifier*/
+    return 0;
+}
 
-        while(!done){
+/*Formats that listings can be written in*/
+enum outputFormat{
 
-            /*step variable checks that the loop has not reached the end of the query*/
-            int step = sqlite3_step(res);
+    FORMAT_HUMAN,
+    FORMAT_CSV,
+    FORMAT_JSON
+};
 
-            if(step == SQLITE_ROW){
-                /*SQLITE_ROW indicates a new row of the query still exists*/
-                lastID = sqlite3_column_int(res, 0);
-                /*Retrieves the first column (productID) as an integer*/
-            } else {
-                done = 1;
-            }
-        }
+/*Size of the buffer that rows are formatted into before being written out in one chunk*/
+#define WRITER_BUFFER_SIZE 65536
 
-        return lastID;
+/*Formats listing rows into a reusable buffer which is written to the output in large chunks*/
+struct rowWriter{
+
+    enum outputFormat format;
+    char *buffer;
+    size_t used;
+    size_t capacity;
+};
+
+/*Each thread formats into its own buffer*/
+static __thread struct rowWriter rowOutput = {FORMAT_HUMAN, NULL, 0, 0};
+
+/*Chooses the listing format from its name, returns 1 if the name is not a known format*/
+int setOutputFormat(const char *name){
+
+    if(strcmp(name, "human") == 0){
+        rowOutput.format = FORMAT_HUMAN;
+    } else if(strcmp(name, "csv") == 0){
+        rowOutput.format = FORMAT_CSV;
+    } else if(strcmp(name, "json") == 0){
+        rowOutput.format = FORMAT_JSON;
+    } else {
+        return 1;
     }
 
+    return 0;
 }
 
-/*Function to convert a string into a long integer*/
-long int strToInt(char *string){
+/*Returns 1 when listings are written for people rather than other programs*/
+int isHumanFormat(){
 
-    long int temp;
+    return rowOutput.format == FORMAT_HUMAN;
+}
 
-    /*strcspn removes the newline character from any inputted string*/
-    string[strcspn(string, "\n")] = 0;
-    /*strtol function to return long integer from string*/
-    temp = strtol(string, NULL, 10); /*Follows the structure of string_input, pointer (optional), base value for integer*/
+/*Writes everything held in the buffer to the output*/
+void flushRows(){
 
-    return temp;
+    if(rowOutput.used > 0){
+        fwrite(rowOutput.buffer, 1, rowOutput.used, outputStream());
+        rowOutput.used = 0;
+    }
 }
 
-/*Function to check that the user has inputted an integer, takes in a string*/
-int intCheck(char *string){
+/*Frees the row buffer*/
+void freeRowWriter(){
 
-    /*variable to hold counter for for loop*/
-    int i;
-    /*Variable to hold result from function*/
-    int success = 0;
-    /*variable to hold the length of the string (result of strlen function)*/
-    int length = strlen(string);
+    flushRows();
+    free(rowOutput.buffer);
 
-    for(i=0; i<length; i++){
+    rowOutput.buffer = NULL;
+    rowOutput.capacity = 0;
+}
 
-        /*isDigit inbuilt function, executed for each digit inside the string, returns positive integer if the string character is an integer*/
-        if(isdigit(string[i]) > 0){
+/*Makes sure the buffer has room for needed more bytes, flushing it first and only growing it for rows bigger than the whole buffer*/
+int reserveRowSpace(size_t needed){
 
-            success = 1;
-        } else {
-            return 0;
+    if(rowOutput.used + needed <= rowOutput.capacity){
+        return 0;
+    }
+
+    flushRows();
+
+    if(needed > rowOutput.capacity){
+
+        size_t capacity = needed > WRITER_BUFFER_SIZE ? needed : WRITER_BUFFER_SIZE;
+        char *buffer = realloc(rowOutput.buffer, capacity);
+
+        if(buffer == NULL){
+            reply("Output buffer could not be allocated\n");
+            return 1;
         }
+
+        rowOutput.buffer = buffer;
+        rowOutput.capacity = capacity;
     }
 
-    return success;
+    return 0;
 }
 
-/*Function to return a long double value from a string*/
-long double strToDbl(char *string){
+/*Appends text to the buffer, the caller has already reserved the space*/
+void appendText(const char *text, size_t length){
 
-    /*Temporary variable to hold double value*/
-    long double temp;
+    memcpy(rowOutput.buffer + rowOutput.used, text, length);
+    rowOutput.used += length;
+}
 
-    /*Removes newline character from string*/
-    string[strcspn(string, "\n")] = 0;
-    /*Converts string to double value with inbuilt function*/
-    temp = strtod(string, NULL);
+/*Appends an integer without going through printf*/
+void appendInt(int value){
 
-    return temp;
-}
+    char digits[12];
+    int count = 0;
+    unsigned int magnitude = value < 0 ? 0u - (unsigned int) value : (unsigned int) value;
 
-/*Function to check that a string is a double*/
-int doubleCheck(char *string){
+    do {
+        digits[count++] = '0' + magnitude % 10;
+        magnitude /= 10;
+    } while(magnitude > 0);
 
-    /*Temporary variable to hold counter for for loop*/
-    int i;
-    /*Variable to hold the result of the function*/
-    int success = 0;
-    /*Variable to hold the length of the inputted string*/
-    int length = strlen(string);
+    if(value < 0){
+        rowOutput.buffer[rowOutput.used++] = '-';
+    }
 
-    /*A counter used to keep track of the amount of decimal points in the string*/
-    int stopCount = 0;
+    while(count > 0){
+        rowOutput.buffer[rowOutput.used++] = digits[--count];
+    }
+}
 
-    /*Iterates over the string*/
-    for(i=0; i<length; i++){
-    
-        /*Checks that character is a digit or a decimal point*/
-        if((isdigit(string[i]) > 0) || (string[i] == '.')){
+/*Appends a real number the way sqlite prints it as text, whole numbers keep a trailing .0*/
+void appendDouble(double value){
 
-            success = 1;
-            if(string[i] == '.'){
-                /*Increments decimal point counter when detected*/
-                stopCount += 1;
-            }
+    /*JSON has no infinity or NaN, so they are written as null*/
+    if(!isfinite(value) && rowOutput.format == FORMAT_JSON){
+        appendText("null", 4);
+        return;
+    }
 
-            /*Checks that no more than one decimal point exists*/
-            if(stopCount > 1){
-                return 0;
-            }
-        } else {
-            return 0;
-        }
+    int length = snprintf(rowOutput.buffer + rowOutput.used, 32, "%.15g", value);
+
+    if(strpbrk(rowOutput.buffer + rowOutput.used, ".eni") == NULL){
+        rowOutput.buffer[rowOutput.used + length++] = '.';
+        rowOutput.buffer[rowOutput.used + length++] = '0';
     }
 
-    return success;
+    rowOutput.used += length;
 }
 
-/*Prints all categories out to the user from the showCategories query function*/
-int categoryCallback(void *unused, int numOfCols, char **fields, char **colNames){
+/*Appends a text field, quoting it for CSV when it holds a separator and escaping it for JSON*/
+void appendField(const char *text, int length){
 
     int i;
 
-    for(i=0; i<numOfCols; i++){
+    if(rowOutput.format == FORMAT_HUMAN){
+        appendText(text, length);
+        return;
+    }
 
-        /*Checks that the field is not empty*/
-       if(fields[i] != NULL){
-           /*Prints the fields name*/
-           printf("%s   ", fields[i]);
-       }
+    if(rowOutput.format == FORMAT_CSV){
+
+        /*The scan stops at length because a field need not be NUL terminated*/
+        for(i=0; i<length && text[i] != ',' && text[i] != '"' && text[i] != '\r' && text[i] != '\n'; i++);
+
+        if(i == length){
+            appendText(text, length);
+            return;
+        }
+
+        rowOutput.buffer[rowOutput.used++] = '"';
+        for(i=0; i<length; i++){
+            if(text[i] == '"'){
+                rowOutput.buffer[rowOutput.used++] = '"';
+            }
+            rowOutput.buffer[rowOutput.used++] = text[i];
+        }
+        rowOutput.buffer[rowOutput.used++] = '"';
+        return;
     }
-    printf("\n");
 
-    return 0;
+    rowOutput.buffer[rowOutput.used++] = '"';
+    for(i=0; i<length; i++){
+
+        unsigned char ch = text[i];
+
+        if(ch == '"' || ch == '\\'){
+            rowOutput.buffer[rowOutput.used++] = '\\';
+            rowOutput.buffer[rowOutput.used++] = ch;
+        } else if(ch < 0x20){
+            rowOutput.used += sprintf(rowOutput.buffer + rowOutput.used, "\\u%04x", ch);
+        } else {
+            rowOutput.buffer[rowOutput.used++] = ch;
+        }
+    }
+    rowOutput.buffer[rowOutput.used++] = '"';
 }
 
-/*Performs a query for all categories on the category table*/
-int showCategories(sqlite3 *db){
+#define APPEND_LITERAL(text) appendText(text, sizeof(text) - 1)
 
-    printf("Category options\n");
+/*Starts a listing, CSV output begins with a header row*/
+void beginListing(){
 
-    char *errMsg = 0;
+    if(rowOutput.format == FORMAT_CSV && reserveRowSpace(64) == 0){
+        APPEND_LITERAL("productID,name,quantity,price,category\n");
+    }
+}
 
-    /*Query to get */
-    char *query = "SELECT name FROM CATEGORY";
+/*Adds one product to the listing in the chosen format*/
+void writeProductRow(int productID, const char *name, int nameLength, double quantity, double price, const char *category){
 
-    /*Execution command for sqlite, uses the categoryCallback function to print results*/  
-    int rc = sqlite3_exec(db, query, categoryCallback, 0, &errMsg);
+    int categoryLength = strlen(category);
 
-    /*Catches error then clears error from dynamic memory*/
-    if(rc != SQLITE_OK){
-        printf("SQL error: %s\n", errMsg);
-        sqlite3_free(errMsg);
+    /*Worst case is every character of a JSON string becoming a six character escape*/
+    if(reserveRowSpace((nameLength + categoryLength) * 6 + 160) != 0){
+        return;
     }
 
-    return 0;
+    switch(rowOutput.format){
+
+        case FORMAT_HUMAN:
+            appendInt(productID);
+            APPEND_LITERAL("  Name:   ");
+            appendField(name, nameLength);
+            APPEND_LITERAL("  Quantity:   ");
+            appendDouble(quantity);
+            APPEND_LITERAL("  Price:  ");
+            appendDouble(price);
+            APPEND_LITERAL("  Category:   ");
+            appendField(category, categoryLength);
+            APPEND_LITERAL("  \n");
+            break;
+
+        case FORMAT_CSV:
+            appendInt(productID);
+            APPEND_LITERAL(",");
+            appendField(name, nameLength);
+            APPEND_LITERAL(",");
+            appendDouble(quantity);
+            APPEND_LITERAL(",");
+            appendDouble(price);
+            APPEND_LITERAL(",");
+            appendField(category, categoryLength);
+            APPEND_LITERAL("\n");
+            break;
+
+        case FORMAT_JSON:
+            APPEND_LITERAL("{\"productID\":");
+            appendInt(productID);
+            APPEND_LITERAL(",\"name\":");
+            appendField(name, nameLength);
+            APPEND_LITERAL(",\"quantity\":");
+            appendDouble(quantity);
+            APPEND_LITERAL(",\"price\":");
+            appendDouble(price);
+            APPEND_LITERAL(",\"category\":");
+            appendField(category, categoryLength);
+            APPEND_LITERAL("}\n");
+            break;
+    }
 }
 
-/*Gets the category id associated with a specific category name*/
-int getCategoryID(sqlite3 *db, char *categoryName){
-
-    char *errMsg = 0;
-    /*res refers to the result of the sqlite execution and is specified of type sqlite3_stmt*/
-    sqlite3_stmt *res;
+/*Finishes a listing by writing out whatever is left in the buffer*/
+void endListing(){
 
-    char *query = "SELECT * FROM CATEGORY";
+    flushRows();
+    fflush(outputStream());
+}
 
-    int rc = sqlite3_prepare_v2(db, query, -1, &res, 0);
+/*Room for the names of every category of one product*/
+#define CATEGORY_NAMES_LENGTH 512
 
-    if(rc != SQLITE_OK){
-        printf("SQL error: %s\n", errMsg);
-        sqlite3_free(errMsg);
-        
-        /*Returns 99 refers to no category being found*/
-        return 99;
+/*Names every category of the product an iterator is on, separated by | when it has more than one*/
+const char *describeCategories(struct productIterator *it, int categoryID, char *buffer, size_t size){
 
-    } else {
+    if(it->categoryList == NULL){
+        return getCategoryName(categoryID);
+    }
 
-        int done = 0;
-        int categoryID = 99;
+    const char *read = it->categoryList;
+    size_t used = 0;
 
-        /*Program will iterate over the query until a new row is no longer found in which case the query has been complete*/
-        while(!done){
+    buffer[0] = 0;
 
-            int step = sqlite3_step(res);
+    while(*read != 0 && used < size){
 
-            if(step == SQLITE_ROW){
-                /*compares category name from user with category name from query, matches associated categoryID*/
-                if(strcmp(categoryName, sqlite3_column_text(res, 1)) == 0){
-                    categoryID = sqlite3_column_int(res, 0);
-                }
-            } else {
+        char *end;
+        long id = strtol(read, &end, 10);
 
-                done = 1;
-            }
+        if(end == read){
+            break;
         }
 
-        /*Used when a command has been completely utilised, frees memory in particular*/
-        sqlite3_finalize(res);
+        used += snprintf(buffer + used, size - used, used > 0 ? "|%s" : "%s", getCategoryName(id));
+        read = *end == ',' ? end + 1 : end;
+    }
+
+    return buffer;
+}
+
+/*Writes every product an iterator returns in the chosen output format, then closes the iterator, returns 1 if the listing failed*/
+int writeListing(struct productIterator *it){
 
-        return categoryID;
+    struct product product;
+    char categoryNames[CATEGORY_NAMES_LENGTH];
 
+    beginListing();
 
+    /*The full name is taken from the iterator as the one in the struct is cut to fit*/
+    while(nextProduct(it, &product)){
+        writeProductRow(product.productID, it->name, it->nameLength, product.quantity, product.price, describeCategories(it, product.categoryID, categoryNames, sizeof(categoryNames)));
     }
 
+    endListing();
 
+    return closeProducts(it);
 }
 
-/*Use of structs, used when adding data to the database so only a single data structure needs to be passed through as a parameter*/
-struct product{
+/*Prints every stock item whose name matches exactly*/
+int findStockByName(sqlite3 *db, const char *name){
 
-    char name[20];
-    int productID;
-    int categoryID;
-    double price;
-    double quantity;
-};
+    struct productIterator it;
+
+    if(openProductsByName(db, name, &it) != 0){
+        return 1;
+    }
 
-/*Returns the category name of a product given its productID (primary key of product table)*/
-char * getCategory(sqlite3 *db, int productID){
+    return writeListing(&it);
+}
 
-    /*Allocates a block of memory for the category variable*/
-    char *category = malloc(sizeof(char) * 40);
+/*Prints every stock item linked to a category*/
+int findStockByCategory(sqlite3 *db, int categoryID){
 
-    char *errMsg = 0;
-    sqlite3_stmt *res;
+    struct productIterator it;
 
-    char query[300];
+    if(openProductsByCategory(db, categoryID, &it) != 0){
+        return 1;
+    }
 
-    /*copies the query command into the query variable*/
-    sprintf(query, "SELECT CATEGORY.name FROM CATEGORY, PRODUCT_CAT WHERE CATEGORY.categoryID = PRODUCT_CAT.categoryID AND PRODUCT_CAT.productID = ?");
+    return writeListing(&it);
+}
 
-    int rc = sqlite3_prepare_v2(db, query, -1, &res, 0);
+/*Lists the products at or below their reorder level, from every category when categoryID is CATEGORY_NOT_FOUND*/
+int findLowStock(sqlite3 *db, int categoryID){
 
-    if(rc != SQLITE_OK){
+    struct productIterator it;
 
-        printf("SQL error: %s\n", errMsg);
-        sqlite3_free(errMsg);
-    
-    } else {
+    if(openLowStock(db, categoryID, &it) != 0){
+        return 1;
+    }
 
-        /*Binding statement, uses question marks in the query statement to denote the locations where variables should be added, eg productID variable goes in the query at PRODUCT_CAT.productID = ?*/
-        sqlite3_bind_int(res, 1, productID);
+    return writeListing(&it);
+}
 
-        int done = 0;
+/*Lists the products in every category of allOf, at least one of anyOf and none of noneOf*/
+int findStockByCategories(sqlite3 *db, const int *allOf, int allCount, const int *anyOf, int anyCount, const int *noneOf, int noneCount){
 
-        while(!done){
+    struct productIterator it;
 
-            /*steps through the query row by row*/
-            int step = sqlite3_step(res);
+    if(openCategoryFilter(db, allOf, allCount, anyOf, anyCount, noneOf, noneCount, &it) != 0){
+        return 1;
+    }
 
-            if(step == SQLITE_ROW){
-                strncpy(category, sqlite3_column_text(res, 0), 40);
-            
-            } else {
-                done = 1;
-            }
-        }
+    return writeListing(&it);
+}
+
+/*Lists products whose name starts with or contains text, ignoring case, best matches first and at most limit of them*/
+int searchStock(sqlite3 *db, const char *text, enum searchMode mode, int limit, long *matches){
+
+    struct productIterator it;
+
+    if(matches != NULL){
+        *matches = 0;
+    }
+
+    if(openNameSearch(db, text, mode, limit, &it) != 0){
+        return 1;
+    }
+
+    int failed = writeListing(&it);
+
+    if(matches != NULL){
+        *matches = it.rows;
     }
 
-    return category;
+    return failed;
 }
 
 /*Gives a list of all of the stock that match a specific name inputted by the user*/
@@ -383,59 +560,35 @@ int readStockByName(sqlite3 *db){
 
     printf("You have chosen to search for %s\n\n", name);
 
-    char *errMsg = 0;
-    sqlite3_stmt *res;
-
-    char query[300];
-
-    /*DISTINCT is a command in sqlite which prevents duplications in queries*/
-    sprintf(query, "SELECT DISTINCT PRODUCT.productID, PRODUCT.name, PRODUCT.quantity, PRODUCT.price, PRODUCT_CAT.categoryID FROM PRODUCT, PRODUCT_CAT WHERE PRODUCT.productID = PRODUCT_CAT.productID AND PRODUCT.name = ?");
-
-    int rc = sqlite3_prepare_v2(db, query, -1, &res, 0);
-
-    if(rc != SQLITE_OK){
-
-        printf("SQL error: %s\n", errMsg);
-        sqlite3_free(errMsg);
-
-    } else {
-
-        /*Binds name to the first question mark location*/
-        sqlite3_bind_text(res, 1, name, -1, NULL);
-
-        int done = 0;
-
-        while(!done){
+    /*Text too short for the text index is matched against whole names*/
+    if(strlen(name) < SEARCH_MIN_LENGTH){
+        return findStockByName(db, name);
+    }
 
-            int step = sqlite3_step(res);
+    long matches = 0;
 
-            if(step == SQLITE_ROW){
+    if(searchStock(db, name, SEARCH_SUBSTRING, SEARCH_DEFAULT_LIMIT, &matches) != 0){
+        return 1;
+    }
 
-                /*sqlite3_column_text(result_variable, column_number)*/
-                printf("%s  ", sqlite3_column_text(res, 0));
-                printf("Name:   %s  ", sqlite3_column_text(res, 1));
-                printf("Quantity:   %s  ", sqlite3_column_text(res, 2));
-                printf("Price:  %s  ", sqlite3_column_text(res, 3));
-                printf("Category:   %s  ", getCategory(db, sqlite3_column_int(res, 0)));
-                printf("\n");
-            
-            } else {
-                
-                done = 1;
-            }
-        }
+    /*Nothing contains the text as typed, so the closest spellings are offered instead*/
+    if(matches == 0){
+        printf("No names contain %s, the closest matches are\n", name);
+        return searchStock(db, name, SEARCH_FUZZY, SEARCH_DEFAULT_LIMIT, NULL);
     }
 
     return 0;
-
 }
 
+int browseStock(sqlite3 *db, int categoryID, int choosing);
+
 /*Gives a list of all of the stock which match a specific category inputted by the user*/
 int readStockByCategory(sqlite3 *db){
 
     showCategories(db);
 
     char category[25];
+    int categoryID;
 
     do{
         printf("Please enter the category you wish to search for:   ");
@@ -455,401 +608,304 @@ int readStockByCategory(sqlite3 *db){
             } while(ch != '\n');
         }
 
+        categoryID = getCategoryID(category);
+
         /*Will inform the user of an incorrect category being chosen*/
-        if(getCategoryID(db, category) == 99){
+        if(categoryID == CATEGORY_NOT_FOUND){
             printf("Please make sure that you have chosen a listed category\n");
         } else {
             printf("You have chosen to search for %s\n\n", category);
         }
         
-    } while(getCategoryID(db, category) == 99);
-    
-    char *errMsg = 0;
-    sqlite3_stmt *res;
+    } while(categoryID == CATEGORY_NOT_FOUND);
 
-    char query[300];
+    browseStock(db, categoryID, 0);
 
-    int categoryID = getCategoryID(db, category);
+    return 0;
+}
 
-    sprintf(query, "SELECT DISTINCT PRODUCT.productID, PRODUCT.name, PRODUCT.quantity, PRODUCT.price FROM PRODUCT, PRODUCT_CAT WHERE PRODUCT.productID = PRODUCT_CAT.productID AND PRODUCT_CAT.categoryID = ?");
+/*Gives a list of the individual stock item which matches an identifier*/
+int readStockByID(sqlite3 *db, int id){
 
-    int rc = sqlite3_prepare_v2(db, query, -1, &res, 0);
+    struct productIterator it;
 
-    if(rc != SQLITE_OK){
+    if(openProductByID(db, id, &it) != 0){
+        return 1;
+    }
 
-        printf("SQL error:  %s\n", errMsg);
-        sqlite3_free(errMsg);
-    
-    } else {
+    return writeListing(&it);
+}
+
+/*Gives a list of all of the stock which resides in the database*/
+int readAllStock(sqlite3 *db){
+
+    struct productIterator it;
+
+    if(openAllProducts(db, &it) != 0){
+        return 1;
+    }
 
-        /*Binds the categoryID variable to the categoryID value in the category table*/
-        sqlite3_bind_int(res, 1, categoryID);
+    return writeListing(&it);
+}
 
-        int done = 0;
+/*Rows on a page when STOCK_PAGE_SIZE is not set*/
+#define DEFAULT_PAGE_SIZE 20
+/*Largest page that can be asked for*/
+#define MAX_PAGE_SIZE 10000
 
-        while(!done){
+/*First and last productID shown on a page, the next page starts after lastID and the previous one ends before firstID*/
+struct pageCursor{
 
-            int step = sqlite3_step(res);
+    int firstID;
+    int lastID;
+    int rows;
+    /*Set when at least one more row follows the page*/
+    int more;
+};
 
-            if(step == SQLITE_ROW){
+/*Rows per page for browsing and paged listings*/
+int getPageSize(){
 
-                printf("%s  ", sqlite3_column_text(res, 0));
-                printf("Name:   %s  ", sqlite3_column_text(res, 1));
-                printf("Quantity:   %s  ", sqlite3_column_text(res, 2));
-                printf("Price:  %s  ", sqlite3_column_text(res, 3));
-                printf("Category:   %s  ", getCategory(db, sqlite3_column_int(res, 0)));
-                printf("\n");
-            
-            } else {
+    int size = atoi(getDatabaseSettings()->pageSize);
 
-                done = 1;
-            }
-        }
+    if(size <= 0 || size > MAX_PAGE_SIZE){
+        return DEFAULT_PAGE_SIZE;
     }
 
-    return 0;
-
+    return size;
 }
 
-/*Gives a list of the individual stock item which matches an identifier*/
-int readStockByID(sqlite3 *db, int id){
+/*Lists up to pageSize products in productID order starting after afterID, all products when categoryID is CATEGORY_NOT_FOUND*/
+int readStockPage(sqlite3 *db, int categoryID, int afterID, int pageSize, struct pageCursor *cursor){
 
-    char *errMsg = 0;
-    sqlite3_stmt *res;
+    struct productIterator it;
+    struct product product;
+    char categoryNames[CATEGORY_NAMES_LENGTH];
 
-    char query[300];
+    cursor->firstID = afterID;
+    cursor->lastID = afterID;
+    cursor->rows = 0;
+    cursor->more = 0;
 
-    sprintf(query, "SELECT DISTINCT PRODUCT.productID, PRODUCT.name, PRODUCT.quantity, PRODUCT.price, PRODUCT_CAT.categoryID FROM PRODUCT, PRODUCT_CAT WHERE PRODUCT.productID = PRODUCT_CAT.productID AND PRODUCT.productID = ?");
+    if(openProductPage(db, categoryID, afterID, pageSize, &it) != 0){
+        return 1;
+    }
 
-    int rc = sqlite3_prepare_v2(db, query, -1, &res, 0);
+    beginListing();
 
-    if(rc != SQLITE_OK){
-
-        printf("SQL error: %s\n", errMsg);
-        sqlite3_free(errMsg);
-
-        return 1;
-
-    } else {
+    while(nextProduct(&it, &product)){
 
-        sqlite3_bind_int(res, 1, id);
-
-        int done = 0;
-
-        while(!done){
-
-            int step = sqlite3_step(res);
-
-            if(step == SQLITE_ROW){
-
-                printf("%s  ", sqlite3_column_text(res, 0));
-                printf("Name:   %s  ", sqlite3_column_text(res, 1));
-                printf("Quantity:   %s  ", sqlite3_column_text(res, 2));
-                printf("Price:  %s  ", sqlite3_column_text(res, 3));
-                printf("Category:   %s  ", getCategory(db, sqlite3_column_int(res, 0)));
-                printf("\n");
-            
-            } else {
-                
-                done = 1;
-            }
+        if(cursor->rows == 0){
+            cursor->firstID = product.productID;
         }
-    }
-
-    return 0;
+        cursor->lastID = product.productID;
+        cursor->rows += 1;
 
-}
-
-int checkStockByID(sqlite3 *db, int id){
+        writeProductRow(product.productID, it.name, it.nameLength, product.quantity, product.price, describeCategories(&it, product.categoryID, categoryNames, sizeof(categoryNames)));
+    }
 
-    int count = 0;
+    endListing();
 
-    char *errMsg = 0;
-    sqlite3_stmt *res;
+    cursor->more = it.more;
 
-    char query[300];
+    return closeProducts(&it);
+}
 
-    sprintf(query, "SELECT DISTINCT PRODUCT.productID, PRODUCT.name, PRODUCT.quantity, PRODUCT.price, PRODUCT_CAT.categoryID FROM PRODUCT, PRODUCT_CAT WHERE PRODUCT.productID = PRODUCT_CAT.productID AND PRODUCT.productID = ?");
+/*Shows a listing a page at a time, when choosing is set the user can type a productID to pick it, returns the productID picked or -1*/
+int browseStock(sqlite3 *db, int categoryID, int choosing){
 
-    int rc = sqlite3_prepare_v2(db, query, -1, &res, 0);
+    int pageSize = getPageSize();
+    struct pageCursor cursor;
+    int afterID = PAGE_FIRST;
+    char input[20];
 
-    if(rc != SQLITE_OK){
+    if(readStockPage(db, categoryID, afterID, pageSize, &cursor) != 0){
+        return -1;
+    }
 
-        printf("SQL error: %s\n", errMsg);
-        sqlite3_free(errMsg);
+    while(1){
 
-        return 99;
+        if(cursor.rows == 0){
+            printf("No stock items to show\n");
+        }
 
-    } else {
+        if(choosing){
+            printf("\nn = next page, p = previous page, q = back to the menu, or enter the ID of a stock item:   ");
+        } else {
+            printf("\nn = next page, p = previous page, q = back to the menu:   ");
+        }
 
-        sqlite3_bind_int(res, 1, id);
+        if(fgets(input, sizeof(input), stdin) == NULL){
+            return -1;
+        }
 
-        int done = 0;
-        
+        /*Anything past the buffer is thrown away so it is not read as the next answer*/
+        if(strchr(input, '\n') == NULL){
+            int ch;
+            do {
+                ch = getchar();
+            } while(ch != '\n' && ch != EOF);
+        }
 
-        while(!done){
+        input[strcspn(input, "\n")] = 0;
 
-            int step = sqlite3_step(res);
+        if(strcmp(input, "q") == 0 || strcmp(input, "Q") == 0){
+            return -1;
+        }
 
-            if(step == SQLITE_ROW){
+        if(strcmp(input, "n") == 0 || strcmp(input, "N") == 0 || input[0] == 0){
 
-                count += 1;
-            
-            } else {
-                
-                done = 1;
+            if(!cursor.more){
+                printf("This is the last page\n");
+                continue;
             }
-        }
-    }
 
-    return count;
-}
-
-/*Gives a list of all of the stock which resides in the database*/
-int readAllStock(sqlite3 *db){
+            afterID = cursor.lastID;
+            readStockPage(db, categoryID, afterID, pageSize, &cursor);
 
-    char *errMsg = 0;
-    sqlite3_stmt *res;
+        } else if(strcmp(input, "p") == 0 || strcmp(input, "P") == 0){
 
-    char *query = "SELECT * FROM PRODUCT";
+            /*An empty page has no first row, so the page before the end of the listing is shown*/
+            int beforeID = cursor.rows > 0 ? cursor.firstID : PAGE_LAST;
 
-    int rc = sqlite3_prepare_v2(db, query, -1, &res, 0);
+            if(afterID == PAGE_FIRST || findPreviousPage(db, categoryID, beforeID, pageSize, &afterID) != 0){
+                printf("This is the first page\n");
+                continue;
+            }
 
-    if(rc != SQLITE_OK){
+            readStockPage(db, categoryID, afterID, pageSize, &cursor);
 
-        printf("SQL error: %s\n", errMsg);
-        sqlite3_free(errMsg);
-    
-    } else {
+        } else if(choosing && intCheck(input)){
 
-        int done = 0;
+            int productID = strToInt(input);
 
-        while(!done){
+            if(productExists(db, productID) == 1){
+                return productID;
+            }
 
-            int step = sqlite3_step(res);
+            printf("No stock item has the id %d\n", productID);
 
-            if(step == SQLITE_ROW){
-                printf("%d   ", sqlite3_column_int(res, 0));
-                printf("Name %s   ", sqlite3_column_text(res, 1));
-                printf("Price %s    ", sqlite3_column_text(res, 2));
-                printf("Quantity %s    ", sqlite3_column_text(res, 3));
-                printf("Category %s    ", getCategory(db, sqlite3_column_int(res, 0)));
-                printf("\n");
-            } else {
-                done = 1;
-            }
+        } else {
+            printf("Please check your input\n");
         }
     }
-
-
-
-    return 0;
 }
 
-/*Function used to change the product name given the productID of the product*/
-int changeProductName(sqlite3 *db, int id, char *name){
-
-    char *errMsg = 0;
-
-    char query[300];
-
-    sprintf(query, "UPDATE PRODUCT SET name = '%s' WHERE productID = %d", name, id);
-
-    int rc = sqlite3_exec(db, query, 0, 0, &errMsg);
-
-    if(rc != SQLITE_OK){
-        
-        printf("SQL error: %s\n", errMsg);
-        sqlite3_free(errMsg);
-
-        return 1;
-    
-    } else {
 
-        printf("Name has been changed successfully\n");
-    }
+/*Where the report takes its figures from*/
+enum reportSource{
+    REPORT_CACHE,
+    REPORT_SQL,
+    REPORT_BOTH
+};
 
-    return 0;
-}
+/*Prints one line per category that holds stock followed by the totals, a product is counted once under its primary (lowest numbered) category so the lines add up to the totals*/
+void printCategoryTotals(struct categoryTotals *totals, int bucketCount){
 
-/*Function used to change the product price give the productID of the product*/
-int changeProductPrice(sqlite3 *db, int id, double price){
+    struct categoryTotals all;
+    int i;
 
-    char *errMsg = 0;
-    
-    char query[300];
+    clearCategoryTotals(&all, 1);
 
-    sprintf(query, "UPDATE PRODUCT SET price = '%lf' WHERE productID = %d", price, id);
+    reply("  %-20s %10s %14s %16s %10s %10s\n", "primary category", "products", "units", "value", "low", "high");
 
-    int rc = sqlite3_exec(db, query, 0, 0, &errMsg);
+    for(i=1; i<=bucketCount; i++){
 
-    if(rc != SQLITE_OK){
+        /*Bucket 0 is printed last as None*/
+        struct categoryTotals *bucket = &totals[i % bucketCount];
 
-        printf("SQL error: %s\n", errMsg);
-        sqlite3_free(errMsg);
+        if(bucket->products == 0){
+            continue;
+        }
 
-        return 1;
-    
-    } else {
+        reply("  %-20s %10ld %14.1f %16.2f %10.2f %10.2f\n", getCategoryName(i % bucketCount - 1), bucket->products, bucket->units, bucket->value, bucket->lowPrice, bucket->highPrice);
 
-        printf("Price has been changed successfully\n");
+        all.products += bucket->products;
+        all.units += bucket->units;
+        all.value += bucket->value;
+        all.lowPrice = bucket->lowPrice < all.lowPrice ? bucket->lowPrice : all.lowPrice;
+        all.highPrice = bucket->highPrice > all.highPrice ? bucket->highPrice : all.highPrice;
     }
 
-    return 0;
-}
-
-/*Function used to change the quantity of the stock item given the productID of the product*/
-int changeProductQuantity(sqlite3 *db, int id, double quantity){
-
-    char *errMsg = 0;
-
-    char query[300];
-
-    sprintf(query, "UPDATE PRODUCT SET quantity = '%lf' WHERE productId = %d", quantity, id);
-
-    int rc = sqlite3_exec(db, query, 0, 0, &errMsg);
-
-    if(rc != SQLITE_OK){
-
-        printf("SQL error: %s\n", errMsg);
-        sqlite3_free(errMsg);
-
-        return 1;
-    
-    } else {
-
-        printf("Quantity has been changed successfully\n");
-
+    if(all.products == 0){
+        reply("  No stock is held\n");
+        return;
     }
 
-    return 0;
+    reply("  %-20s %10ld %14.1f %16.2f %10.2f %10.2f\n", "Total", all.products, all.units, all.value, all.lowPrice, all.highPrice);
 }
 
-/*Function used to change the category of the product given the productID of the product*/
-int changeProductCategory(sqlite3 *db, int id, int categoryID){
-
-    char *errMsg = 0;
-
-    char query[300];
+/*Shows the stock value, units and price band of every category, taken from the product cache, from sqlite or from both with their timings*/
+int reportStock(sqlite3 *db, enum reportSource source){
 
-    sprintf(query, "UPDATE PRODUCT_CAT SET categoryID = %d WHERE productID = %d", categoryID, id);
-
-    int rc = sqlite3_exec(db, query, 0, 0, &errMsg);
-
-    if(rc != SQLITE_OK){
-
-        printf("SQL error: %s\n", errMsg);
-        sqlite3_free(errMsg);
-
-        return 1;
-    
-    } else {
+    struct timespec started = startMetric();
+    int bucketCount = getCategoryCount() + 1;
+    struct categoryTotals *totals = malloc(sizeof(struct categoryTotals) * bucketCount);
+    struct timespec start, end;
+    int failed = 0;
 
-        printf("Category has been changed sucessfully\n");
+    if(totals == NULL){
+        reply("The report could not be allocated\n");
+        return endMetric(METRIC_REPORT, &started, 0, 1);
     }
 
-    return 0;
-}
-
-/*Function will compare a given productID with the productId within the product table and the product_cat table, then the matching stock item */
-int deleteStock(sqlite3 *db, int id){
-
-
-    /*deleting from product table*/
-    char *errMsg = 0;
-
-    char query[300];
-
-    int success = 0;
-
-    sprintf(query, "DELETE FROM PRODUCT WHERE productID = %d", id);
-
-    int rc = sqlite3_exec(db, query, 0, 0, &errMsg);
-
-    if(rc != SQLITE_OK){
-
-        printf("SQL error:  %s\n", errMsg);
-        sqlite3_free(errMsg);
-
-        success = 0;
+    if(source != REPORT_SQL){
 
-        return 1;
-    
-    } else {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        int cacheOff = aggregateCachedProducts(totals, bucketCount);
+        clock_gettime(CLOCK_MONOTONIC, &end);
 
-        success = 1;
+        /*Without the cache only the report from the database is given, which is not a failure*/
+        if(cacheOff){
+            if(source == REPORT_CACHE){
+                reply("The product cache is switched off, the report is taken from the database\n");
+            }
+            source = REPORT_SQL;
+        } else {
+            reply("Stock report from the product cache (%.3f ms)\n", ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / 1e6);
+            printCategoryTotals(totals, bucketCount);
+        }
     }
 
-    /*product will exist in both the product and product_cat table and therefore must be deleted from both*/
-    sprintf(query, "DELETE FROM PRODUCT_CAT WHERE productID = %d", id);
-
-    rc = sqlite3_exec(db, query, 0, 0, &errMsg);
+    if(source != REPORT_CACHE){
 
-    if(rc != SQLITE_OK){
-
-        printf("SQL error:  %s\n", errMsg);
-        /*frees error message from dynamic memory*/
-        sqlite3_free(errMsg);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        failed = aggregateStoredProducts(db, totals, bucketCount);
+        clock_gettime(CLOCK_MONOTONIC, &end);
 
-        success = 0;
+        if(!failed){
+            reply("Stock report from sqlite GROUP BY (%.3f ms)\n", ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / 1e6);
+            printCategoryTotals(totals, bucketCount);
+        }
+    }
 
-        return 1;
-    
-    } else {
+    free(totals);
 
-        success = 1;
-    }
+    return endMetric(METRIC_REPORT, &started, bucketCount, failed);
+}
 
-    if(success == 1){
+/*Confirms a change to whoever asked for it, returns failed so it can wrap the call that made the change*/
+int replyOnSuccess(int failed, const char *message){
 
-        printf("Stock has been successfully deleted\n");
+    if(!failed){
+        reply("%s", message);
     }
 
-    return 0;
+    return failed;
 }
 
-
-
 /*Function that handles the user interaction when modifying an individual stock item*/
 int modifyStock(sqlite3 *db){
 
     printf("All stock items\n\n");
-    /*All stock items will be displayed alongside their ID's*/
-    readAllStock(db);
-    printf("\n");
+    /*Stock items are shown a page at a time alongside their ID's until one is chosen*/
+    long int userChoiceID = browseStock(db, CATEGORY_NOT_FOUND, 1);
 
-    /*Temporary user choice refers to the string variable, user choice refers to the long integer counterpart created using strToInt*/
-    long int userChoiceID;
-    char tempUserChoiceID[10];
+    if(userChoiceID < 0){
+        return 1;
+    }
 
     int input = 0;
-    do{
-        
-        printf("Please enter the number for the stock item you wish to modify:  ");
-        /*Algorithm will first check that the string is in fact an integer, then it will check that the integer relates to a valid stock item*/
-        fgets(tempUserChoiceID, 10, stdin);
-        tempUserChoiceID[strcspn(tempUserChoiceID, "\n")] = 0;
-        if(!(intCheck(tempUserChoiceID))){
-            input = 0;
-            printf("Please check your input\n");
-        } else {
-            input = 1;
-            userChoiceID = strToInt(tempUserChoiceID);
-            if((checkStockByID(db, userChoiceID) > 0) && (checkStockByID(db, userChoiceID)) != 99){
-                input = 1;
-            } else {
-                input = 0;
-            }
-        }
-        if(strlen(tempUserChoiceID) == 9){
-            int ch;
-            do {
-                ch = getchar();
-            } while(ch != '\n');
-        }
-        
-        
-    } while(input != 1);
 
     printf("You have chosen to modify:\n\n");
 
@@ -895,6 +951,7 @@ int modifyStock(sqlite3 *db){
     long double quantity;
     char tempQuantity[10];
     char category[25];
+    int categoryID;
     char delete[3];
 
     /*switch case statement to manange the submenu for modifying a stock*/
@@ -920,7 +977,7 @@ int modifyStock(sqlite3 *db){
                 return 1;
             }
 
-            changeProductName(db, userChoiceID, name);
+            replyOnSuccess(changeProductName(db, userChoiceID, name), "Name has been changed successfully\n");
 
             return 0;
 
@@ -952,7 +1009,7 @@ int modifyStock(sqlite3 *db){
             } while(input != 1);
             
 
-            changeProductPrice(db, userChoiceID, price);
+            replyOnSuccess(changeProductPrice(db, userChoiceID, price), "Price has been changed successfully\n");
 
             return 0;
 
@@ -983,7 +1040,7 @@ int modifyStock(sqlite3 *db){
             } while(input != 1);
             
 
-            changeProductQuantity(db, userChoiceID, quantity);
+            replyOnSuccess(changeProductQuantity(db, userChoiceID, quantity), "Quantity has been changed successfully\n");
 
             return 0;
 
@@ -1006,13 +1063,15 @@ int modifyStock(sqlite3 *db){
                     } while(ch != '\n');
                 }
 
-                if(getCategoryID(db, category) == 99){
+                categoryID = getCategoryID(category);
+
+                if(categoryID == CATEGORY_NOT_FOUND){
                     printf("Please make sure to choose an available category\n");
                 }
 
-            } while(getCategoryID(db, category) == 99);
+            } while(categoryID == CATEGORY_NOT_FOUND);
 
-            changeProductCategory(db, userChoiceID, getCategoryID(db, category));
+            replyOnSuccess(changeProductCategory(db, userChoiceID, categoryID), "Category has been changed sucessfully\n");
             
             return 0;
 
@@ -1032,7 +1091,7 @@ int modifyStock(sqlite3 *db){
                 if((strcmp(delete, "Y") == 0) || (strcmp(delete, "y") == 0)){
 
                     /*Delete function*/
-                    deleteStock(db, userChoiceID);
+                    replyOnSuccess(deleteStock(db, userChoiceID), "Stock has been successfully deleted\n");
                     input = 1;
 
                     return 0;
@@ -1058,67 +1117,23 @@ int modifyStock(sqlite3 *db){
     return 0; 
 }
 
-/*Takes the stock data structure passed from the addStock function and adds the data to the database*/
-int insertData(sqlite3 *db, struct product tempProduct){
-
-    printf("Name: %s, CategoryID: %d, Price: %g, Quantity: %g\n", tempProduct.name, tempProduct.categoryID, tempProduct.price, tempProduct.quantity);
-
-    char name[200];
-    int productID;
-    int categoryID;
-    double price;
-    double quantity;
-
-    strncpy(name, tempProduct.name, sizeof(name));
-    productID = tempProduct.productID;
-    categoryID = tempProduct.categoryID;
-    price = tempProduct.price;
-    quantity = tempProduct.quantity;
+/*Adds a product in its category and each of extraCategoryIDs and tells the user whether it was added*/
+int addProduct(sqlite3 *db, struct product tempProduct, const int *extraCategoryIDs, int extraCount){
 
-    char *errMsg = 0;
-    char data[300];
-
-    int success = 0;
-
-    /*Adding data to the product table*/
-    sprintf(data, "INSERT INTO PRODUCT VALUES('%d', '%s', '%lf', '%lf')", productID, name, price, quantity);
-
-    int rc = sqlite3_exec(db, data, 0, 0, &errMsg);
-
-    if(rc != SQLITE_OK){
-        printf("\n%s\n", sqlite3_errmsg(db));
-        sqlite3_free(errMsg);
-        success = 0;
-
-    } else {
-        success = 1;
+    if(!quietMode){
+        reply("Name: %s, CategoryID: %d, Price: %g, Quantity: %g\n", tempProduct.name, tempProduct.categoryID, tempProduct.price, tempProduct.quantity);
     }
 
-    /*Adding data to the productCat table*/
-    char productCatData[128];
-
-    sprintf(productCatData, "INSERT INTO PRODUCT_CAT VALUES('%d', '%d')", productID, categoryID);
-
-    rc = sqlite3_exec(db, productCatData, 0, 0, &errMsg);
-
-    if(rc != SQLITE_OK){
-        printf("\n%s\n", sqlite3_errmsg(db));
-        sqlite3_free(errMsg);
-        success = 0;
-
-    } else {
-        success = 1;
+    if(insertDataInCategories(db, tempProduct, extraCategoryIDs, extraCount) != 0){
+        reply("The stock item was not added\n");
+        return 1;
     }
 
-    if(success = 1){
-
-        printf("Data has been added successfully\n");
-    }
+    reply("Data has been added successfully\n");
 
     return 0;
 }
 
-
 /*Handles the user interaction for adding stock to the database*/
 int addStock(sqlite3 *db){
 
@@ -1157,17 +1172,17 @@ int addStock(sqlite3 *db){
         printf("Please enter the category of the product  ");
         fgets(category, 20, stdin);
         category[strcspn(category, "\n")] = 0;
-        categoryID = getCategoryID(db, category);
+        categoryID = getCategoryID(category);
         if(strlen(category) == 19){
             int ch;
             do {
                 ch = getchar();
             } while(ch != '\n');
         }
-        if(categoryID == 99){
+        if(categoryID == CATEGORY_NOT_FOUND){
             printf("Please check your input \n");
         }
-    } while(categoryID == 99);
+    } while(categoryID == CATEGORY_NOT_FOUND);
     
 
     input = 0;
@@ -1218,108 +1233,2212 @@ int addStock(sqlite3 *db){
 
     name[strcspn(name, "\n")] = 0;
 
-    strncpy(tempProduct.name, name, sizeof(tempProduct.name));
-    tempProduct.productID = getLastID(db) + 1;
+    snprintf(tempProduct.name, sizeof(tempProduct.name), "%s", name);
+    tempProduct.productID = AUTO_PRODUCT_ID;
     tempProduct.categoryID = categoryID;
     tempProduct.price = price;
     tempProduct.quantity = quantity;
 
-    insertData(db, tempProduct);
+    addProduct(db, tempProduct, NULL, 0);
 
     return 0;
     
 }
-/*A function to clear the Category table when the program starts up*/
-int clearCategories(sqlite3* db){
+/*Imports a file and reports how many rows were taken and how many were rejected*/
+int runImport(sqlite3 *db, const char *filename){
 
-    char *errMsg = 0;
-    char *query = "DELETE FROM CATEGORY";
+    struct importResult result;
 
-    int rc = sqlite3_exec(db, query, 0, 0, &errMsg);
+    int failed = importStock(db, filename, &result);
 
-    if(rc != SQLITE_OK){
-        printf("SQL error: %s\n", errMsg);
-        sqlite3_free(errMsg);
+    if(!result.opened){
+        return failed;
     }
 
-    return 0;
+    if(result.stopped){
+        reply("Import stopped at line %ld, the current batch was rolled back\n", result.lines);
+    }
 
+    reply("Imported %ld rows in %.3f seconds (%.0f rows/sec)\n", result.imported, result.seconds, result.seconds > 0 ? result.imported / result.seconds : 0.0);
+
+    if(result.rejected > 0){
+        reply("%ld rows were rejected and written to %s\n", result.rejected, result.rejectName);
+    }
 
+    return failed;
 }
 
-/*Function to add all the categories to the categories table along with their categoryID*/
-int setCategories(sqlite3* db){
+/*Handles the user interaction for importing stock from a file*/
+int importStockFromFile(sqlite3 *db){
 
-    clearCategories(db);
+    char filename[256];
 
-    char *filename = "categories.txt";
-    FILE *file = fopen(filename, "r");
+    printf("Each line of the file should hold name, category, price and quantity separated by commas or tabs\n");
+    printf("Please enter the path of the file to import:   ");
+    fgets(filename, sizeof(filename), stdin);
+    filename[strcspn(filename, "\n")] = 0;
 
-    if(file == NULL){
-        printf("Category file could not be found\n");
+    if(((strcmp(filename, "q")) == 0) || ((strcmp(filename, "Q")) == 0)){
         return 1;
     }
 
-    char buffer[256];
-    char *errMsg = 0;
-    int count = 0;
+    return runImport(db, filename);
+}
 
-    while(fgets(buffer, 256, file)){
-        buffer[strcspn(buffer, "\n")] = 0;
-        
+/*Opens the database through the data library and shows the settings in effect, returns NULL if the database could not be opened*/
+sqlite3 *startup(){
 
-        char data[512];
-        sprintf(data, "INSERT INTO CATEGORY VALUES('%d', '%s')", count, buffer);
+    sqlite3 *db = openStockDatabase();
 
-        int rc = sqlite3_exec(db, data, 0, 0, &errMsg);
+    if(db != NULL && !quietMode){
+        printDatabaseSettings(db);
+    }
 
-        if(rc != SQLITE_OK){
-            printf("\n%s\n", sqlite3_errmsg(db));
-            sqlite3_free(errMsg);
-        }
+    return db;
+}
 
-        count += 1;
-        
-    }
+/*Releases everything set up by startup*/
+void shutdownProgram(sqlite3 *db){
 
-    return 0;
+    freeRowWriter();
+    closeStockDatabase(db);
 }
 
-/*Main function which displays the menu that the user can use the navigate through the program*/
-void main(){
+/*Socket the server listens on when no --socket is given, STOCK_SOCKET overrides it*/
+#define SERVER_SOCKET "stock_management.sock"
+/*Number of reader threads, each with its own read only connection*/
+#define SERVER_READERS 4
+/*Most arguments accepted by a single command, including the command name*/
+#define MAX_COMMAND_ARGS 32
+/*Longest line accepted in a script file*/
+#define SCRIPT_LINE_LENGTH 1024
+/*A script commits after this many write operations or this many milliseconds, whichever comes first*/
+#define SCRIPT_GROUP_OPERATIONS 1000
+#define SCRIPT_GROUP_MILLIS 200
+
+/*Values given to a command through its --flag value pairs, NULL when a flag was not given*/
+struct commandOptions{
+
+    const char *id;
+    const char *name;
+    const char *category;
+    const char *price;
+    const char *quantity;
+    const char *format;
+    const char *source;
+    const char *mode;
+    const char *limit;
+    const char *after;
+    const char *before;
+    const char *pageSize;
+    const char *action;
+    const char *value;
+    const char *to;
+    const char *nameLike;
+    const char *minPrice;
+    const char *maxPrice;
+    const char *minQuantity;
+    const char *maxQuantity;
+    const char *chunkSize;
+    const char *days;
+    const char *level;
+    const char *directory;
+    const char *keep;
+    const char *addCategory;
+    const char *removeCategory;
+    const char *in;
+    const char *any;
+    const char *notIn;
+    /*The categories named by --category, which only add and modify accept more than one of*/
+    int categoryIDs[MAX_PRODUCT_CATEGORIES];
+    int categoryCount;
+};
 
-    /*initialises the database*/
-    sqlite3 *initialisation = initialiseDatabase();
-    /*creates all three tables within the database*/
-    createTable(initialisation);
-    /*Writes the categories from the 'categories.txt' file to the categories table*/
-    setCategories(initialisation);
-    
-    /*Variable to hold whether the user has exited the program or not*/
-    bool exited = false;
+/*Prints the commands accepted on the command line and in scripts*/
+void printUsage(){
+
+    reply("Usage: stock_management [command [options]]\n\n");
+    reply("Without a command the interactive menu is shown\n\n");
+    reply("  add --name NAME --category CATEGORY[,CATEGORY...] --price PRICE --quantity QUANTITY\n");
+    reply("  find-by-name --name NAME\n");
+    reply("  search --name TEXT [--mode prefix|substring|fuzzy] [--limit N]\n");
+    reply("                   finds names starting with or containing TEXT, fuzzy allows typos\n");
+    reply("  find-by-category --category CATEGORY [--page-size N] [--after ID | --before ID]\n");
+    reply("  find-by-categories [--in CATEGORY,...] [--any CATEGORY,...] [--not CATEGORY,...]\n");
+    reply("                   lists the products in every --in category, at least one --any category and no --not category\n");
+    reply("  modify --id ID [--name NAME] [--category CATEGORY[,CATEGORY...]] [--price PRICE] [--quantity QUANTITY]\n");
+    reply("         [--add-category CATEGORY,...] [--remove-category CATEGORY,...]\n");
+    reply("  delete --id ID\n");
+    reply("  receive --id ID --quantity QUANTITY\n");
+    reply("  sell --id ID --quantity QUANTITY\n");
+    reply("                   adds to or takes from the quantity held and records it in the stock movement ledger\n");
+    reply("  reorder-level --id ID | --category CATEGORY --level QUANTITY|none\n");
+    reply("                   sets the quantity at or below which a product, or every product in a category, is low on stock\n");
+    reply("  low-stock [--category CATEGORY]\n");
+    reply("                   lists the products at or below their reorder level\n");
+    reply("  movements --id ID [--limit N]\n");
+    reply("                   shows the newest entries in the ledger of one product\n");
+    reply("  compact-movements [--days N]\n");
+    reply("                   folds movements older than N days (default %d) into one snapshot per product\n", LEDGER_KEEP_DAYS);
+    reply("  bulk-modify --action set-price|scale-price|set-quantity|add-quantity|set-category|delete [--value N] [--to CATEGORY]\n");
+    reply("              [--category CATEGORY] [--name-like PATTERN] [--min-price P] [--max-price P] [--min-quantity Q] [--max-quantity Q] [--chunk-size N]\n");
+    reply("                   changes every product matching all the conditions given, scale-price takes a percentage\n");
+    reply("  list [--page-size N] [--after ID | --before ID]\n");
+    reply("  report [--source cache|sql|both]\n");
+    reply("                   shows stock value, units and price band per category, both sources are timed\n");
+    reply("  settings         shows the database path and tuning in effect\n");
+    reply("  metrics          shows operation counts and latencies and sqlite cache and statement statistics\n");
+    reply("  backup [--dir PATH] [--keep N]\n");
+    reply("                   copies the open database into a timestamped file and keeps the newest N backups\n");
+    reply("  import FILE\n");
+    reply("  export-snapshot FILE\n");
+    reply("                   writes every product and category into a binary snapshot for read only consumers\n");
+    reply("  snapshot FILE list | find-by-category --category CATEGORY | find-by-id --id ID\n");
+    reply("                   answers from a snapshot mapped into memory without opening the database\n");
+    reply("  script FILE      runs one command per line of FILE, - reads from standard input\n");
+    reply("  serve [--socket PATH] [--readers COUNT]\n");
+    reply("                   keeps the database open and answers commands sent over a unix socket\n");
+    reply("  client [--socket PATH] COMMAND [options]\n");
+    reply("                   sends one command to a running server\n");
+    reply("  benchmark [--database PATH [--force]] [--products N] [--skew S] [--operations N] [--mix add=W,...] [--seed N]\n");
+    reply("                   loads a synthetic catalog into a scratch database and times a mix of operations\n\n");
+    reply("find-by-name, search, find-by-category, find-by-categories, low-stock and list accept --format human, csv or json (one JSON object per line)\n");
+}
 
-    while(!exited){
-        printf("\nWelcome to the stock management program\n");
-        printf("---------------------------------------\n");
-        printf("\n\nMain Menu\n\n");
-        printf("1.  Add Stock\n");
-        printf("2.  Track Stock by Name\n");
-        printf("3.  Track Stock by Category\n");
-        printf("4.  Modify Stock\n");
-        printf("5.  View Entire Stock\n");
-        printf("6.  Exit the Program\n");
+/*Reads the --flag value pairs that follow a command, returns 1 if an unknown flag or a flag without a value is found*/
+int parseOptions(int argc, char *argv[], struct commandOptions *options){
 
-        printf("\n\nPlease choose the number for your perferred action: ");
-        int userInput;
-        scanf("%d", &userInput);
-        int ch;
-        do{
-            ch = getchar();
-        } while(ch != '\n');
+    int i;
 
-        printf("You have selected %d\n", userInput);
+    memset(options, 0, sizeof(struct commandOptions));
 
-        switch(userInput){
+    for(i=1; i<argc; i++){
+
+        if(i + 1 >= argc){
+            reply("Missing value for %s\n", argv[i]);
+            return 1;
+        }
+
+        if(strcmp(argv[i], "--id") == 0){
+            options->id = argv[++i];
+        } else if(strcmp(argv[i], "--name") == 0){
+            options->name = argv[++i];
+        } else if(strcmp(argv[i], "--category") == 0){
+            options->category = argv[++i];
+        } else if(strcmp(argv[i], "--price") == 0){
+            options->price = argv[++i];
+        } else if(strcmp(argv[i], "--quantity") == 0){
+            options->quantity = argv[++i];
+        } else if(strcmp(argv[i], "--format") == 0){
+            options->format = argv[++i];
+        } else if(strcmp(argv[i], "--source") == 0){
+            options->source = argv[++i];
+        } else if(strcmp(argv[i], "--mode") == 0){
+            options->mode = argv[++i];
+        } else if(strcmp(argv[i], "--limit") == 0){
+            options->limit = argv[++i];
+        } else if(strcmp(argv[i], "--after") == 0){
+            options->after = argv[++i];
+        } else if(strcmp(argv[i], "--before") == 0){
+            options->before = argv[++i];
+        } else if(strcmp(argv[i], "--page-size") == 0){
+            options->pageSize = argv[++i];
+        } else if(strcmp(argv[i], "--action") == 0){
+            options->action = argv[++i];
+        } else if(strcmp(argv[i], "--value") == 0){
+            options->value = argv[++i];
+        } else if(strcmp(argv[i], "--to") == 0){
+            options->to = argv[++i];
+        } else if(strcmp(argv[i], "--name-like") == 0){
+            options->nameLike = argv[++i];
+        } else if(strcmp(argv[i], "--min-price") == 0){
+            options->minPrice = argv[++i];
+        } else if(strcmp(argv[i], "--max-price") == 0){
+            options->maxPrice = argv[++i];
+        } else if(strcmp(argv[i], "--min-quantity") == 0){
+            options->minQuantity = argv[++i];
+        } else if(strcmp(argv[i], "--max-quantity") == 0){
+            options->maxQuantity = argv[++i];
+        } else if(strcmp(argv[i], "--chunk-size") == 0){
+            options->chunkSize = argv[++i];
+        } else if(strcmp(argv[i], "--days") == 0){
+            options->days = argv[++i];
+        } else if(strcmp(argv[i], "--level") == 0){
+            options->level = argv[++i];
+        } else if(strcmp(argv[i], "--dir") == 0){
+            options->directory = argv[++i];
+        } else if(strcmp(argv[i], "--keep") == 0){
+            options->keep = argv[++i];
+        } else if(strcmp(argv[i], "--add-category") == 0){
+            options->addCategory = argv[++i];
+        } else if(strcmp(argv[i], "--remove-category") == 0){
+            options->removeCategory = argv[++i];
+        } else if(strcmp(argv[i], "--in") == 0){
+            options->in = argv[++i];
+        } else if(strcmp(argv[i], "--any") == 0){
+            options->any = argv[++i];
+        } else if(strcmp(argv[i], "--not") == 0){
+            options->notIn = argv[++i];
+        } else {
+            reply("Unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/*Reads category names separated by commas into categoryIDs, an option that was not given is an empty list, returns how many were read or -1 after explaining the problem*/
+int parseCategoryList(const char *list, int *categoryIDs, int max){
+
+    char name[100];
+    int count = 0;
+
+    if(list == NULL){
+        return 0;
+    }
+
+    while(1){
+
+        size_t length = strcspn(list, ",");
+
+        if(length == 0 || length >= sizeof(name)){
+            reply("Categories are given as names separated by commas\n");
+            return -1;
+        }
+
+        if(count == max){
+            reply("At most %d categories can be given\n", max);
+            return -1;
+        }
+
+        memcpy(name, list, length);
+        name[length] = 0;
+
+        categoryIDs[count] = getCategoryID(name);
+
+        if(categoryIDs[count] == CATEGORY_NOT_FOUND){
+            reply("Unknown category %s\n", name);
+            return -1;
+        }
+
+        count += 1;
+
+        if(list[length] == 0){
+            return count;
+        }
+
+        list += length + 1;
+    }
+}
+
+/*Checks the values given to a command, any option left as NULL is skipped, returns 1 and explains the problem if a value is invalid*/
+int validateOptions(struct commandOptions *options, int *categoryID){
+
+    /*Each command starts from the human format so a format given on one script line does not carry over to the next*/
+    setOutputFormat("human");
+
+    if(options->format != NULL && setOutputFormat(options->format) != 0){
+        reply("The format must be human, csv or json\n");
+        return 1;
+    }
+
+    if(options->id != NULL && !intCheck((char *) options->id)){
+        reply("The id must be a whole number\n");
+        return 1;
+    }
+
+    if(options->name != NULL && (strlen(options->name) == 0 || strlen(options->name) > 19)){
+        reply("The name must be between 1 and 19 characters\n");
+        return 1;
+    }
+
+    if(options->category != NULL){
+
+        options->categoryCount = parseCategoryList(options->category, options->categoryIDs, MAX_PRODUCT_CATEGORIES);
+
+        if(options->categoryCount < 0){
+            return 1;
+        }
+
+        *categoryID = options->categoryIDs[0];
+    }
+
+    if(options->limit != NULL && (!intCheck((char *) options->limit) || atoi(options->limit) <= 0)){
+        reply("The limit must be a whole number above 0\n");
+        return 1;
+    }
+
+    if((options->after != NULL && !intCheck((char *) options->after)) || (options->before != NULL && !intCheck((char *) options->before))){
+        reply("--after and --before must be a productID\n");
+        return 1;
+    }
+
+    if(options->pageSize != NULL && (!intCheck((char *) options->pageSize) || atoi(options->pageSize) <= 0 || atoi(options->pageSize) > MAX_PAGE_SIZE)){
+        reply("The page size must be a whole number from 1 to %d\n", MAX_PAGE_SIZE);
+        return 1;
+    }
+
+    if(options->price != NULL && !doubleCheck((char *) options->price)){
+        reply("The price must be a number\n");
+        return 1;
+    }
+
+    if(options->quantity != NULL && !doubleCheck((char *) options->quantity)){
+        reply("The quantity must be a number\n");
+        return 1;
+    }
+
+    return 0;
+}
+
+/*Prints one page of a listing for the list and find-by-category commands, a human listing ends with the option that fetches the next page*/
+int runPagedListing(sqlite3 *db, int categoryID, struct commandOptions *options){
+
+    int pageSize = options->pageSize != NULL ? atoi(options->pageSize) : getPageSize();
+    int afterID = PAGE_FIRST;
+    struct pageCursor cursor;
+
+    if(options->after != NULL && options->before != NULL){
+        reply("Use either --after or --before\n");
+        return 1;
+    }
+
+    if(options->after != NULL){
+        afterID = strtol(options->after, NULL, 10);
+    }
+
+    if(options->before != NULL && findPreviousPage(db, categoryID, strtol(options->before, NULL, 10), pageSize, &afterID) != 0){
+        /*Nothing comes before the cursor so an empty page is shown*/
+        afterID = PAGE_LAST;
+    }
+
+    if(readStockPage(db, categoryID, afterID, pageSize, &cursor) != 0){
+        return 1;
+    }
+
+    /*Nothing comes before the first page, so it offers no previous page*/
+    if(isHumanFormat()){
+        if(cursor.rows == 0){
+            reply("No stock items on this page\n");
+        } else if(afterID == PAGE_FIRST && cursor.more){
+            reply("Next page: --after %d\n", cursor.lastID);
+        } else if(afterID == PAGE_FIRST){
+            reply("Last page\n");
+        } else if(cursor.more){
+            reply("Next page: --after %d, previous page: --before %d\n", cursor.lastID, cursor.firstID);
+        } else {
+            reply("Last page, previous page: --before %d\n", cursor.firstID);
+        }
+    }
+
+    return 0;
+}
+
+/*Checks a number that may start with a minus sign, for changes that can go either way*/
+int signedDoubleCheck(const char *string){
+
+    if(string[0] == '-'){
+        string++;
+    }
+
+    return doubleCheck((char *) string);
+}
+
+/*Runs the bulk-modify command, the filter options pick the products and --action says what happens to them*/
+int runBulkModify(sqlite3 *db, struct commandOptions *options, int categoryID){
+
+    struct productFilter filter;
+    enum bulkAction action;
+    double value = 0;
+    long affected = 0;
+
+    clearProductFilter(&filter);
+
+    if(options->action == NULL){
+        reply("bulk-modify needs --action set-price, scale-price, set-quantity, add-quantity, set-category or delete\n");
+        return 1;
+    }
+
+    if(strcmp(options->action, "set-price") == 0){
+        action = BULK_SET_PRICE;
+    } else if(strcmp(options->action, "scale-price") == 0){
+        action = BULK_SCALE_PRICE;
+    } else if(strcmp(options->action, "set-quantity") == 0){
+        action = BULK_SET_QUANTITY;
+    } else if(strcmp(options->action, "add-quantity") == 0){
+        action = BULK_ADJUST_QUANTITY;
+    } else if(strcmp(options->action, "set-category") == 0){
+        action = BULK_SET_CATEGORY;
+    } else if(strcmp(options->action, "delete") == 0){
+        action = BULK_DELETE;
+    } else {
+        reply("The action must be set-price, scale-price, set-quantity, add-quantity, set-category or delete\n");
+        return 1;
+    }
+
+    if(action == BULK_SET_CATEGORY){
+
+        if(options->to == NULL || getCategoryID(options->to) == CATEGORY_NOT_FOUND){
+            reply("set-category needs --to with a known category\n");
+            return 1;
+        }
+        value = getCategoryID(options->to);
+
+    } else if(action != BULK_DELETE){
+
+        /*Percentages and quantity changes can go down as well as up, prices and quantities are set to positive numbers*/
+        int isSigned = action == BULK_SCALE_PRICE || action == BULK_ADJUST_QUANTITY;
+
+        if(options->value == NULL || !(isSigned ? signedDoubleCheck(options->value) : doubleCheck((char *) options->value))){
+            reply("%s needs --value with a %snumber\n", options->action, isSigned ? "" : "positive ");
+            return 1;
+        }
+        value = strtod(options->value, NULL);
+    }
+
+    if(options->category != NULL){
+        filter.categoryID = categoryID;
+    }
+
+    filter.namePattern = options->nameLike;
+
+    const char *bounds[4] = {options->minPrice, options->maxPrice, options->minQuantity, options->maxQuantity};
+    double *fields[4] = {&filter.minPrice, &filter.maxPrice, &filter.minQuantity, &filter.maxQuantity};
+    int i;
+
+    for(i=0; i<4; i++){
+
+        if(bounds[i] == NULL){
+            continue;
+        }
+
+        if(!doubleCheck((char *) bounds[i])){
+            reply("--min-price, --max-price, --min-quantity and --max-quantity must be numbers\n");
+            return 1;
+        }
+        *fields[i] = strtod(bounds[i], NULL);
+    }
+
+    /*A mistyped command should not change the whole catalogue, so at least one condition is required*/
+    if(options->category == NULL && options->nameLike == NULL && bounds[0] == NULL && bounds[1] == NULL && bounds[2] == NULL && bounds[3] == NULL){
+        reply("bulk-modify needs at least one of --category, --name-like, --min-price, --max-price, --min-quantity or --max-quantity\n");
+        return 1;
+    }
+
+    int chunkSize = options->chunkSize != NULL ? atoi(options->chunkSize) : BULK_CHUNK_SIZE;
+
+    if(options->chunkSize != NULL && (!intCheck((char *) options->chunkSize) || chunkSize <= 0)){
+        reply("The chunk size must be a whole number above 0\n");
+        return 1;
+    }
+
+    if(bulkModify(db, &filter, action, value, chunkSize, &affected) != 0){
+        reply("Stopped after %ld products, the remaining products were not changed\n", affected);
+        return 1;
+    }
+
+    reply("%ld products %s\n", affected, action == BULK_DELETE ? "deleted" : "changed");
+
+    return 0;
+}
+
+/*Movements shown by the movements command when no --limit is given*/
+#define MOVEMENT_DEFAULT_LIMIT 20
+
+/*Prints the newest movements of a product, then the snapshot the older ones were folded into*/
+int showMovements(sqlite3 *db, int id, int limit){
+
+    struct stockMovement *movements = malloc(sizeof(struct stockMovement) * limit);
+    struct stockSnapshot snapshot;
+    int count = 0;
+    int i;
+
+    if(movements == NULL){
+        reply("Not enough memory for %d movements\n", limit);
+        return 1;
+    }
+
+    if(getMovements(db, id, movements, limit, &count) != 0){
+        free(movements);
+        return 1;
+    }
+
+    if(count == 0){
+        reply("No movements recorded since the last compaction\n");
+    }
+
+    for(i=0; i<count; i++){
+
+        char when[32];
+        time_t createdAt = movements[i].createdAt;
+
+        strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", localtime(&createdAt));
+        reply("%ld  %s  %-8s %+g\n", movements[i].movementID, when, movements[i].reason, movements[i].delta);
+    }
+
+    if(getSnapshot(db, id, &snapshot) == 0){
+        reply("Quantity was %g after movement %ld, older movements have been compacted\n", snapshot.quantity, snapshot.movementID);
+    }
+
+    free(movements);
+
+    return 0;
+}
+
+/*Writes the catalogue snapshot read by the snapshot command*/
+int runExportSnapshot(sqlite3 *db, const char *filename){
+
+    struct timespec start, end;
+    long products;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if(exportSnapshot(db, filename, &products) != 0){
+        reply("No snapshot was written\n");
+        return 1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    reply("Snapshot of %ld products written to %s in %.3f seconds\n", products, filename, (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9);
+
+    return 0;
+}
+
+/*Answers list, find-by-category and find-by-id from a mapped snapshot without opening the database, for read only consumers that need to start quickly*/
+int runSnapshot(const char *filename, int argc, char *argv[]){
+
+    struct catalogSnapshot snapshot;
+    struct commandOptions options;
+    struct productIterator it;
+    int categoryID = CATEGORY_NOT_FOUND;
+    int failed = 1;
+
+    if(argc == 0){
+        reply("snapshot expects a command: list, find-by-category or find-by-id\n");
+        return 1;
+    }
+
+    /*The snapshot is mapped first so the category names in the options can be checked against it*/
+    if(openCatalogSnapshot(filename, &snapshot) != 0){
+        return 1;
+    }
+
+    if(parseOptions(argc, argv, &options) != 0 || validateOptions(&options, &categoryID) != 0){
+        closeCatalogSnapshot(&snapshot);
+        return 1;
+    }
+
+    if(strcmp(argv[0], "list") == 0){
+        failed = openSnapshotProducts(&snapshot, &it) || writeListing(&it);
+    } else if(strcmp(argv[0], "find-by-category") == 0 && options.category != NULL){
+        failed = openSnapshotProductsByCategory(&snapshot, categoryID, &it) || writeListing(&it);
+    } else if(strcmp(argv[0], "find-by-id") == 0 && options.id != NULL){
+        failed = openSnapshotProductByID(&snapshot, strtol(options.id, NULL, 10), &it) || writeListing(&it);
+    } else {
+        reply("snapshot accepts list, find-by-category --category CATEGORY and find-by-id --id ID\n");
+    }
+
+    closeCatalogSnapshot(&snapshot);
+
+    return failed;
+}
+
+int runScript(sqlite3 *db, const char *filename);
+int runServer(sqlite3 *db, const char *socketPath, int readerCount);
+const char *defaultSocketPath();
+
+/*Runs a single command against an open database, argv[0] is the command name, returns 0 on success*/
+int runCommand(sqlite3 *db, int argc, char *argv[]){
+
+    const char *command = argv[0];
+    struct commandOptions options;
+    int categoryID = CATEGORY_NOT_FOUND;
+
+    if(strcmp(command, "help") == 0 || strcmp(command, "--help") == 0){
+        printUsage();
+        return 0;
+    }
+
+    if(strcmp(command, "serve") == 0){
+
+        const char *socketPath = defaultSocketPath();
+        int readers = SERVER_READERS;
+        int i;
+
+        for(i=1; i + 1 < argc; i += 2){
+            if(strcmp(argv[i], "--socket") == 0){
+                socketPath = argv[i + 1];
+            } else if(strcmp(argv[i], "--readers") == 0 && intCheck(argv[i + 1]) && atoi(argv[i + 1]) > 0){
+                readers = atoi(argv[i + 1]);
+            } else {
+                break;
+            }
+        }
+
+        if(i != argc){
+            reply("serve accepts --socket PATH and --readers COUNT\n");
+            return 1;
+        }
+
+        return runServer(db, socketPath, readers);
+    }
+
+    if(strcmp(command, "import") == 0 || strcmp(command, "script") == 0 || strcmp(command, "export-snapshot") == 0){
+
+        if(argc != 2){
+            reply("%s expects a single file name\n", command);
+            return 1;
+        }
+
+        if(strcmp(command, "import") == 0){
+            return runImport(db, argv[1]);
+        }
+
+        if(strcmp(command, "export-snapshot") == 0){
+            return runExportSnapshot(db, argv[1]);
+        }
+
+        return runScript(db, argv[1]);
+    }
+
+    if(parseOptions(argc, argv, &options) != 0 || validateOptions(&options, &categoryID) != 0){
+        return 1;
+    }
+
+    /*Only a product can be given several categories, every other command looks at one*/
+    if(options.categoryCount > 1 && strcmp(command, "add") != 0 && strcmp(command, "modify") != 0){
+        reply("%s takes a single category\n", command);
+        return 1;
+    }
+
+    if(strcmp(command, "add") == 0){
+
+        if(options.name == NULL || options.category == NULL || options.price == NULL || options.quantity == NULL){
+            reply("add needs --name, --category, --price and --quantity\n");
+            return 1;
+        }
+
+        struct product tempProduct;
+
+        /*validateOptions has already refused longer names, the copy is still bounded and terminated*/
+        snprintf(tempProduct.name, sizeof(tempProduct.name), "%s", options.name);
+        tempProduct.productID = AUTO_PRODUCT_ID;
+        tempProduct.categoryID = categoryID;
+        tempProduct.price = strtod(options.price, NULL);
+        tempProduct.quantity = strtod(options.quantity, NULL);
+
+        return addProduct(db, tempProduct, options.categoryIDs + 1, options.categoryCount - 1);
+    }
+
+    if(strcmp(command, "find-by-name") == 0){
+
+        if(options.name == NULL){
+            reply("find-by-name needs --name\n");
+            return 1;
+        }
+
+        return findStockByName(db, options.name);
+    }
+
+    if(strcmp(command, "search") == 0){
+
+        enum searchMode mode = SEARCH_SUBSTRING;
+
+        if(options.name == NULL){
+            reply("search needs --name\n");
+            return 1;
+        }
+
+        if(options.mode != NULL){
+
+            if(strcmp(options.mode, "prefix") == 0){
+                mode = SEARCH_PREFIX;
+            } else if(strcmp(options.mode, "substring") == 0){
+                mode = SEARCH_SUBSTRING;
+            } else if(strcmp(options.mode, "fuzzy") == 0){
+                mode = SEARCH_FUZZY;
+            } else {
+                reply("The mode must be prefix, substring or fuzzy\n");
+                return 1;
+            }
+        }
+
+        return searchStock(db, options.name, mode, options.limit != NULL ? atoi(options.limit) : SEARCH_DEFAULT_LIMIT, NULL);
+    }
+
+    if(strcmp(command, "find-by-category") == 0){
+
+        if(options.category == NULL){
+            reply("find-by-category needs --category\n");
+            return 1;
+        }
+
+        if(options.after != NULL || options.before != NULL || options.pageSize != NULL){
+            return runPagedListing(db, categoryID, &options);
+        }
+
+        return findStockByCategory(db, categoryID);
+    }
+
+    if(strcmp(command, "list") == 0){
+
+        if(options.after != NULL || options.before != NULL || options.pageSize != NULL){
+            return runPagedListing(db, CATEGORY_NOT_FOUND, &options);
+        }
+
+        return readAllStock(db);
+    }
+
+    if(strcmp(command, "settings") == 0){
+        return printDatabaseSettings(db);
+    }
+
+    if(strcmp(command, "report") == 0){
+
+        /*The cache is used when it is switched on, otherwise sqlite does the work*/
+        enum reportSource source = isProductCacheLoaded() ? REPORT_CACHE : REPORT_SQL;
+
+        if(options.source != NULL){
+
+            if(strcmp(options.source, "cache") == 0){
+                source = REPORT_CACHE;
+            } else if(strcmp(options.source, "sql") == 0){
+                source = REPORT_SQL;
+            } else if(strcmp(options.source, "both") == 0){
+                source = REPORT_BOTH;
+            } else {
+                reply("The source must be cache, sql or both\n");
+                return 1;
+            }
+        }
+
+        return reportStock(db, source);
+    }
+
+    if(strcmp(command, "backup") == 0){
+
+        const struct databaseSettings *settings = getDatabaseSettings();
+        struct backupResult result;
+
+        if(options.keep != NULL && !intCheck((char *) options.keep)){
+            reply("The number of backups to keep must be a whole number\n");
+            return 1;
+        }
+
+        if(backupDatabase(options.directory != NULL ? options.directory : settings->backupDirectory, atoi(options.keep != NULL ? options.keep : settings->backupKeep), &result) != 0){
+            reply("No backup was written\n");
+            return 1;
+        }
+
+        reply("Backup written to %s, %d pages in %.3f seconds\n", result.path, result.pages, result.seconds);
+
+        if(result.removed > 0){
+            reply("%d older backups removed\n", result.removed);
+        }
+
+        return 0;
+    }
+
+    if(strcmp(command, "metrics") == 0){
+        printMetrics(outputStream());
+        return 0;
+    }
+
+    if(strcmp(command, "receive") == 0 || strcmp(command, "sell") == 0){
+
+        if(options.id == NULL || options.quantity == NULL){
+            reply("%s needs --id and --quantity\n", command);
+            return 1;
+        }
+
+        int id = strtol(options.id, NULL, 10);
+        double delta = strtod(options.quantity, NULL);
+        double quantity;
+
+        if(productExists(db, id) != 1){
+            reply("No stock item has the id %d\n", id);
+            return 1;
+        }
+
+        if(adjustProductQuantity(db, id, strcmp(command, "sell") == 0 ? -delta : delta, command, &quantity) != 0){
+            reply("The quantity was not changed\n");
+            return 1;
+        }
+
+        reply("Quantity is now %g\n", quantity);
+
+        return 0;
+    }
+
+    if(strcmp(command, "reorder-level") == 0){
+
+        double level = NAN;
+
+        if(options.level == NULL || (options.id == NULL) == (options.category == NULL)){
+            reply("reorder-level needs --level and either --id or --category\n");
+            return 1;
+        }
+
+        if(strcmp(options.level, "none") != 0){
+
+            if(!doubleCheck((char *) options.level)){
+                reply("The level must be a number or none\n");
+                return 1;
+            }
+            level = strtod(options.level, NULL);
+        }
+
+        if(options.category != NULL){
+            return replyOnSuccess(setCategoryReorderLevel(db, categoryID, level), "Reorder level has been set for the category\n");
+        }
+
+        int id = strtol(options.id, NULL, 10);
+
+        if(productExists(db, id) != 1){
+            reply("No stock item has the id %d\n", id);
+            return 1;
+        }
+
+        return replyOnSuccess(setProductReorderLevel(db, id, level), "Reorder level has been set\n");
+    }
+
+    if(strcmp(command, "low-stock") == 0){
+        return findLowStock(db, categoryID);
+    }
+
+    if(strcmp(command, "find-by-categories") == 0){
+
+        int allOf[MAX_PRODUCT_CATEGORIES];
+        int anyOf[MAX_PRODUCT_CATEGORIES];
+        int noneOf[MAX_PRODUCT_CATEGORIES];
+        int allCount = parseCategoryList(options.in, allOf, MAX_PRODUCT_CATEGORIES);
+        int anyCount = allCount < 0 ? -1 : parseCategoryList(options.any, anyOf, MAX_PRODUCT_CATEGORIES);
+        int noneCount = anyCount < 0 ? -1 : parseCategoryList(options.notIn, noneOf, MAX_PRODUCT_CATEGORIES);
+
+        if(noneCount < 0){
+            return 1;
+        }
+
+        if(allCount + anyCount + noneCount == 0){
+            reply("find-by-categories needs at least one of --in, --any or --not\n");
+            return 1;
+        }
+
+        return findStockByCategories(db, allOf, allCount, anyOf, anyCount, noneOf, noneCount);
+    }
+
+    if(strcmp(command, "movements") == 0){
+
+        if(options.id == NULL){
+            reply("movements needs --id\n");
+            return 1;
+        }
+
+        return showMovements(db, strtol(options.id, NULL, 10), options.limit != NULL ? atoi(options.limit) : MOVEMENT_DEFAULT_LIMIT);
+    }
+
+    if(strcmp(command, "compact-movements") == 0){
+
+        long folded;
+        int days = options.days != NULL ? atoi(options.days) : LEDGER_KEEP_DAYS;
+
+        if(options.days != NULL && !intCheck((char *) options.days)){
+            reply("The number of days must be a whole number\n");
+            return 1;
+        }
+
+        if(compactMovements(db, time(NULL) - (time_t) days * 24 * 60 * 60, &folded) != 0){
+            reply("The ledger was not compacted\n");
+            return 1;
+        }
+
+        reply("%ld movements folded into snapshots\n", folded);
+
+        return 0;
+    }
+
+    if(strcmp(command, "bulk-modify") == 0){
+        return runBulkModify(db, &options, categoryID);
+    }
+
+    if(strcmp(command, "modify") == 0 || strcmp(command, "delete") == 0){
+
+        if(options.id == NULL){
+            reply("%s needs --id\n", command);
+            return 1;
+        }
+
+        int id = strtol(options.id, NULL, 10);
+
+        if(productExists(db, id) != 1){
+            reply("No stock item has the id %d\n", id);
+            return 1;
+        }
+
+        if(strcmp(command, "delete") == 0){
+            return replyOnSuccess(deleteStock(db, id), "Stock has been successfully deleted\n");
+        }
+
+        int added[MAX_PRODUCT_CATEGORIES];
+        int removed[MAX_PRODUCT_CATEGORIES];
+        int addCount = parseCategoryList(options.addCategory, added, MAX_PRODUCT_CATEGORIES);
+        int removeCount = addCount < 0 ? -1 : parseCategoryList(options.removeCategory, removed, MAX_PRODUCT_CATEGORIES);
+
+        if(removeCount < 0){
+            return 1;
+        }
+
+        if(options.name == NULL && options.category == NULL && options.price == NULL && options.quantity == NULL && addCount == 0 && removeCount == 0){
+            reply("modify needs at least one of --name, --category, --add-category, --remove-category, --price or --quantity\n");
+            return 1;
+        }
+
+        if(options.category != NULL && (addCount > 0 || removeCount > 0)){
+            reply("--category replaces every category, so it cannot be given with --add-category or --remove-category\n");
+            return 1;
+        }
+
+        /*All the requested changes are applied as one operation*/
+        if(beginWrite(db) != 0){
+            return 1;
+        }
+
+        /*The messages are only printed once the whole change has been committed, a later failure rolls back the earlier changes too*/
+        const char *done[4 + 2 * MAX_PRODUCT_CATEGORIES];
+        int doneCount = 0;
+        int failed = 0;
+        int i;
+
+        if(options.name != NULL && !(failed |= changeProductName(db, id, options.name))){
+            done[doneCount++] = "Name has been changed successfully\n";
+        }
+        if(options.category != NULL && !(failed |= setProductCategories(db, id, options.categoryIDs, options.categoryCount))){
+            done[doneCount++] = "Category has been changed sucessfully\n";
+        }
+        for(i=0; i<addCount; i++){
+            if(!(failed |= addProductCategory(db, id, added[i]))){
+                done[doneCount++] = "Category has been added successfully\n";
+            }
+        }
+        for(i=0; i<removeCount; i++){
+            if(!(failed |= removeProductCategory(db, id, removed[i]))){
+                done[doneCount++] = "Category has been removed successfully\n";
+            }
+        }
+        if(options.price != NULL && !(failed |= changeProductPrice(db, id, strtod(options.price, NULL)))){
+            done[doneCount++] = "Price has been changed successfully\n";
+        }
+        if(options.quantity != NULL && !(failed |= changeProductQuantity(db, id, strtod(options.quantity, NULL)))){
+            done[doneCount++] = "Quantity has been changed successfully\n";
+        }
+
+        failed = endWrite(db, failed);
+
+        for(i=0; i<doneCount; i++){
+            replyOnSuccess(failed, done[i]);
+        }
+
+        return failed;
+    }
+
+    reply("Unknown command %s\n", command);
+    printUsage();
+
+    return 1;
+}
+
+/*Splits a script line into arguments in place, arguments are separated by spaces and may be double quoted, returns the number of arguments*/
+int splitArguments(char *line, char *argv[], int maxArgs){
+
+    int argc = 0;
+    char *read = line;
+
+    while(*read){
+
+        while(*read && isspace((unsigned char) *read)){
+            read++;
+        }
+
+        if(*read == 0 || *read == '#'){
+            break;
+        }
+
+        if(argc == maxArgs){
+            return -1;
+        }
+
+        char *write = read;
+        argv[argc++] = write;
+
+        /*Quotes are removed as the argument is copied down over itself*/
+        int quoted = 0;
+
+        while(*read && (quoted || !isspace((unsigned char) *read))){
+            if(*read == '"'){
+                quoted = !quoted;
+                read++;
+            } else {
+                *write++ = *read++;
+            }
+        }
+
+        if(*read){
+            read++;
+        }
+        *write = 0;
+    }
+
+    return argc;
+}
+
+/*Runs a file of commands, one per line, against the already open database, blank lines and lines starting with # are skipped*/
+int runScript(sqlite3 *db, const char *filename){
+
+    FILE *file;
+
+    if(strcmp(filename, "-") == 0){
+        file = stdin;
+    } else {
+        file = fopen(filename, "r");
+    }
+
+    if(file == NULL){
+        printf("Script file could not be opened\n");
+        return 1;
+    }
+
+    char line[SCRIPT_LINE_LENGTH];
+    char *argv[MAX_COMMAND_ARGS];
+    long lineNumber = 0;
+    long failures = 0;
+
+    /*Writes from the script share commits, each line still succeeds or fails on its own*/
+    startGroupCommit(SCRIPT_GROUP_OPERATIONS, SCRIPT_GROUP_MILLIS);
+
+    while(fgets(line, sizeof(line), file)){
+
+        lineNumber += 1;
+        line[strcspn(line, "\r\n")] = 0;
+
+        int argc = splitArguments(line, argv, MAX_COMMAND_ARGS);
+
+        if(argc == 0){
+            continue;
+        }
+
+        /*A script may not start another script, which would otherwise allow a script to run itself forever, nor a server, which would never return to the script*/
+        if(argc < 0 || strcmp(argv[0], "script") == 0 || strcmp(argv[0], "serve") == 0 || runCommand(db, argc, argv) != 0){
+            printf("Script line %ld failed\n", lineNumber);
+            failures += 1;
+        }
+    }
+
+    if(file != stdin){
+        fclose(file);
+    }
+
+    if(finishGroupCommit(db) != 0){
+        printf("The final commit of the script failed\n");
+        failures += 1;
+    }
+
+    if(failures > 0){
+        printf("%ld of %ld script lines failed\n", failures, lineNumber);
+        return 1;
+    }
+
+    return 0;
+}
+
+/*Accepted clients waiting for a free reader thread*/
+#define SERVER_BACKLOG 64
+/*Most writes the writer thread applies before committing, a batch otherwise ends when the queue is empty*/
+#define SERVER_WRITE_BATCH 1000
+
+/*A change waiting for the writer thread, the reader thread that queued it waits until done is set*/
+struct writeJob{
+
+    int argc;
+    char **argv;
+    /*The writer prints into a memory stream which the reader then sends to the client*/
+    FILE *stream;
+    char *output;
+    size_t outputSize;
+    int result;
+    int done;
+    struct writeJob *next;
+};
+
+/*Changes queued for the writer thread*/
+struct writeQueue{
+
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    pthread_cond_t finished;
+    struct writeJob *head;
+    struct writeJob *tail;
+    int stopping;
+};
+
+static struct writeQueue writeQueue = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL, NULL, 0};
+
+/*Client sockets accepted by the main thread and waiting for a reader thread*/
+struct clientQueue{
+
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    int sockets[SERVER_BACKLOG];
+    int head;
+    int count;
+    /*Set once the server stops, reader threads then finish instead of taking another client*/
+    int stopping;
+};
+
+static struct clientQueue clientQueue = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, {0}, 0, 0, 0};
+
+/*A reader thread, its read only connection and the client it is answering, client is -1 while it waits and is guarded by the client queue's lock*/
+struct serverReader{
+
+    pthread_t thread;
+    sqlite3 *db;
+    int client;
+};
+
+/*Set by SIGINT or SIGTERM to stop the server*/
+static volatile sig_atomic_t serverStopping = 0;
+
+void stopServer(int signalNumber){
+
+    serverStopping = 1;
+}
+
+/*Takes a backup every interval minutes until the server stops, the backup reads through its own connection so readers and the writer carry on meanwhile*/
+void *backupThread(void *arg){
+
+    const struct databaseSettings *settings = getDatabaseSettings();
+    int interval = atoi(settings->backupInterval) * 60;
+    struct backupResult result;
+
+    while(!serverStopping){
+
+        int waited;
+
+        /*The wait is taken a second at a time so a stop is noticed quickly*/
+        for(waited = 0; waited < interval && !serverStopping; waited++){
+            sleep(1);
+        }
+
+        if(serverStopping){
+            break;
+        }
+
+        if(backupDatabase(settings->backupDirectory, atoi(settings->backupKeep), &result) == 0){
+            printf("Backup written to %s in %.3f seconds\n", result.path, result.seconds);
+        } else {
+            printf("Scheduled backup failed\n");
+        }
+        fflush(stdout);
+    }
+
+    return NULL;
+}
+
+/*Returns 1 for the commands that change the database and so must go through the writer thread*/
+int isWriteCommand(const char *command){
+
+    return strcmp(command, "add") == 0 || strcmp(command, "modify") == 0 || strcmp(command, "delete") == 0 || strcmp(command, "bulk-modify") == 0 || strcmp(command, "receive") == 0 || strcmp(command, "sell") == 0 || strcmp(command, "compact-movements") == 0 || strcmp(command, "reorder-level") == 0 || strcmp(command, "import") == 0;
+}
+
+/*Hands a change to the writer thread and waits until it has been committed, the writer's output is copied to out*/
+int submitWrite(int argc, char *argv[], FILE *out){
+
+    struct writeJob job;
+
+    memset(&job, 0, sizeof(job));
+    job.argc = argc;
+    job.argv = argv;
+    job.stream = open_memstream(&job.output, &job.outputSize);
+
+    if(job.stream == NULL){
+        fprintf(out, "The change could not be queued\n");
+        return 1;
+    }
+
+    pthread_mutex_lock(&writeQueue.lock);
+
+    if(writeQueue.tail == NULL){
+        writeQueue.head = &job;
+    } else {
+        writeQueue.tail->next = &job;
+    }
+    writeQueue.tail = &job;
+
+    pthread_cond_signal(&writeQueue.ready);
+
+    while(!job.done){
+        pthread_cond_wait(&writeQueue.finished, &writeQueue.lock);
+    }
+
+    pthread_mutex_unlock(&writeQueue.lock);
+
+    fwrite(job.output, 1, job.outputSize, out);
+    free(job.output);
+
+    return job.result;
+}
+
+/*Replaces what a job printed once its change has been lost with a failed commit, so it never claims success*/
+void loseWriteJob(struct writeJob *job){
+
+    if(job->result == 0){
+        rewind(job->stream);
+        fprintf(job->stream, "The change could not be committed\n");
+        job->result = 1;
+    }
+}
+
+/*Answers the jobs from first up to but not including last once the commit that covers them is over*/
+void finishWriteJobs(struct writeJob *first, struct writeJob *last, int commitFailed){
+
+    pthread_mutex_lock(&writeQueue.lock);
+
+    /*next is read before done is set, as the job belongs to the waiting thread from then on*/
+    while(first != last){
+
+        struct writeJob *next = first->next;
+
+        if(commitFailed){
+            loseWriteJob(first);
+        }
+
+        fclose(first->stream);
+        first->done = 1;
+        first = next;
+    }
+
+    pthread_cond_broadcast(&writeQueue.finished);
+    pthread_mutex_unlock(&writeQueue.lock);
+}
+
+/*Applies queued changes on the one read write connection, every change taken from the queue together shares a commit and its client is only answered once the commit holding its change is done*/
+void *writerThread(void *arg){
+
+    sqlite3 *db = arg;
+
+    startGroupCommit(SERVER_WRITE_BATCH, 1000);
+
+    while(1){
+
+        pthread_mutex_lock(&writeQueue.lock);
+
+        while(writeQueue.head == NULL && !writeQueue.stopping){
+            pthread_cond_wait(&writeQueue.ready, &writeQueue.lock);
+        }
+
+        struct writeJob *batch = writeQueue.head;
+        writeQueue.head = NULL;
+        writeQueue.tail = NULL;
+
+        pthread_mutex_unlock(&writeQueue.lock);
+
+        if(batch == NULL){
+            break;
+        }
+
+        /*Jobs from uncommitted onwards are waiting for the open group to be committed*/
+        struct writeJob *uncommitted = batch;
+        struct writeJob *job = batch;
+
+        while(job != NULL){
+
+            struct groupProgress before, after;
+            struct writeJob *next = job->next;
+
+            getGroupProgress(&before);
+
+            commandOutput = job->stream;
+            job->result = runCommand(db, job->argc, job->argv);
+            commandOutput = NULL;
+
+            getGroupProgress(&after);
+
+            /*A group that ended during this job held every job still waiting, and this one too unless it has changes in the group opened since*/
+            if(after.ended != before.ended){
+
+                int lost = after.failed != before.failed;
+
+                finishWriteJobs(uncommitted, job, lost);
+
+                if(after.pending == 0){
+                    finishWriteJobs(job, next, lost);
+                    uncommitted = next;
+                } else {
+                    if(lost){
+                        loseWriteJob(job);
+                    }
+                    uncommitted = job;
+                }
+            }
+
+            job = next;
+        }
+
+        finishWriteJobs(uncommitted, NULL, commitGroup(db));
+    }
+
+    finishGroupCommit(db);
+    freeRowWriter();
+
+    return NULL;
+}
+
+/*Answers one client, each line is a command and each answer ends with an END line holding the command's result*/
+void serveClient(sqlite3 *db, int client){
+
+    FILE *in = fdopen(client, "r");
+    FILE *out = fdopen(dup(client), "w");
+
+    if(in == NULL || out == NULL){
+        if(in != NULL){
+            fclose(in);
+        } else {
+            close(client);
+        }
+        if(out != NULL){
+            fclose(out);
+        }
+        return;
+    }
+
+    char line[SCRIPT_LINE_LENGTH];
+    char *argv[MAX_COMMAND_ARGS];
+
+    while(fgets(line, sizeof(line), in)){
+
+        line[strcspn(line, "\r\n")] = 0;
+
+        int argc = splitArguments(line, argv, MAX_COMMAND_ARGS);
+        int rc;
+
+        if(argc == 0){
+            continue;
+        }
+
+        if(argc < 0 || strcmp(argv[0], "script") == 0 || strcmp(argv[0], "serve") == 0){
+            fprintf(out, "Command is not available through the server\n");
+            rc = 1;
+        } else if(isWriteCommand(argv[0])){
+            rc = submitWrite(argc, argv, out);
+        } else {
+            commandOutput = out;
+            rc = runCommand(db, argc, argv);
+            commandOutput = NULL;
+        }
+
+        fprintf(out, "END %d\n", rc);
+
+        if(fflush(out) != 0){
+            break;
+        }
+    }
+
+    fclose(in);
+    fclose(out);
+}
+
+/*Takes clients from the queue and answers them using this thread's read only connection, until the server stops*/
+void *readerThread(void *arg){
+
+    struct serverReader *reader = arg;
+
+    while(1){
+
+        pthread_mutex_lock(&clientQueue.lock);
+
+        while(clientQueue.count == 0 && !clientQueue.stopping){
+            pthread_cond_wait(&clientQueue.ready, &clientQueue.lock);
+        }
+
+        if(clientQueue.stopping){
+            pthread_mutex_unlock(&clientQueue.lock);
+            break;
+        }
+
+        int client = clientQueue.sockets[clientQueue.head];
+        clientQueue.head = (clientQueue.head + 1) % SERVER_BACKLOG;
+        clientQueue.count -= 1;
+        reader->client = client;
+
+        pthread_mutex_unlock(&clientQueue.lock);
+
+        serveClient(reader->db, client);
+
+        pthread_mutex_lock(&clientQueue.lock);
+        reader->client = -1;
+        pthread_mutex_unlock(&clientQueue.lock);
+    }
+
+    /*The row buffer belongs to this thread*/
+    freeRowWriter();
+
+    return NULL;
+}
+
+/*Creates the listening unix domain socket, a stale socket file left by a previous server is replaced*/
+int openServerSocket(const char *socketPath){
+
+    struct sockaddr_un address;
+
+    if(strlen(socketPath) >= sizeof(address.sun_path)){
+        printf("Socket path is too long\n");
+        return -1;
+    }
+
+    int server = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if(server < 0){
+        printf("Socket could not be created: %s\n", strerror(errno));
+        return -1;
+    }
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, socketPath);
+
+    unlink(socketPath);
+
+    if(bind(server, (struct sockaddr *) &address, sizeof(address)) != 0 || listen(server, SERVER_BACKLOG) != 0){
+        printf("Socket could not be opened: %s\n", strerror(errno));
+        close(server);
+        return -1;
+    }
+
+    return server;
+}
+
+/*Keeps the database open and answers commands from clients over a unix domain socket until SIGINT or SIGTERM*/
+int runServer(sqlite3 *db, const char *socketPath, int readerCount){
+
+    pthread_t writer;
+    pthread_t backup;
+    struct serverReader readers[readerCount];
+    int backingUp = atoi(getDatabaseSettings()->backupInterval) > 0;
+    int i;
+
+    /*Every connection and its statements are set up before any thread starts, the statement registry is not changed after that*/
+    for(i=0; i<readerCount; i++){
+
+        readers[i].db = openStockReader();
+        readers[i].client = -1;
+
+        if(readers[i].db == NULL){
+            while(i-- > 0){
+                closeStockReader(readers[i].db);
+            }
+            return 1;
+        }
+    }
+
+    int server = openServerSocket(socketPath);
+
+    if(server < 0){
+        for(i=0; i<readerCount; i++){
+            closeStockReader(readers[i].db);
+        }
+        return 1;
+    }
+
+    /*SA_RESTART is left off so accept returns when a stop signal arrives*/
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = stopServer;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    /*A client that disconnects before reading its answer must not end the server*/
+    signal(SIGPIPE, SIG_IGN);
+
+    pthread_create(&writer, NULL, writerThread, db);
+
+    for(i=0; i<readerCount; i++){
+        pthread_create(&readers[i].thread, NULL, readerThread, &readers[i]);
+    }
+
+    if(backingUp){
+        pthread_create(&backup, NULL, backupThread, NULL);
+        printf("Backing up to %s every %s minutes\n", getDatabaseSettings()->backupDirectory, getDatabaseSettings()->backupInterval);
+    }
+
+    printf("Serving %s with %d readers\n", socketPath, readerCount);
+    fflush(stdout);
+
+    while(!serverStopping){
+
+        int client = accept(server, NULL, NULL);
+
+        if(client < 0){
+            if(errno != EINTR){
+                printf("Accept failed: %s\n", strerror(errno));
+            }
+            continue;
+        }
+
+        pthread_mutex_lock(&clientQueue.lock);
+
+        if(clientQueue.count == SERVER_BACKLOG){
+            pthread_mutex_unlock(&clientQueue.lock);
+            close(client);
+            continue;
+        }
+
+        clientQueue.sockets[(clientQueue.head + clientQueue.count) % SERVER_BACKLOG] = client;
+        clientQueue.count += 1;
+
+        pthread_cond_signal(&clientQueue.ready);
+        pthread_mutex_unlock(&clientQueue.lock);
+    }
+
+    close(server);
+    unlink(socketPath);
+
+    /*Every thread is joined before the caller frees the categories and the product cache they read. A reader's client socket is shut so a reader waiting on an idle or stalled client finishes straight away, and clients never taken by a reader are closed unanswered*/
+    pthread_mutex_lock(&clientQueue.lock);
+
+    clientQueue.stopping = 1;
+
+    for(i=0; i<readerCount; i++){
+        if(readers[i].client >= 0){
+            shutdown(readers[i].client, SHUT_RDWR);
+        }
+    }
+
+    while(clientQueue.count > 0){
+        close(clientQueue.sockets[clientQueue.head]);
+        clientQueue.head = (clientQueue.head + 1) % SERVER_BACKLOG;
+        clientQueue.count -= 1;
+    }
+
+    pthread_cond_broadcast(&clientQueue.ready);
+    pthread_mutex_unlock(&clientQueue.lock);
+
+    /*Readers are joined first, as one may still be waiting for the writer to apply its change*/
+    for(i=0; i<readerCount; i++){
+        pthread_join(readers[i].thread, NULL);
+        closeStockReader(readers[i].db);
+    }
+
+    if(backingUp){
+        pthread_join(backup, NULL);
+    }
+
+    /*The writer finishes the changes already queued before it stops*/
+    pthread_mutex_lock(&writeQueue.lock);
+    writeQueue.stopping = 1;
+    pthread_cond_signal(&writeQueue.ready);
+    pthread_mutex_unlock(&writeQueue.lock);
+
+    pthread_join(writer, NULL);
+
+    printf("Server stopped\n");
+
+    return 0;
+}
+
+/*Sends one command to a running server and prints its answer, returns the command's result*/
+int runClient(const char *socketPath, int argc, char *argv[]){
+
+    struct sockaddr_un address;
+
+    if(argc == 0){
+        printUsage();
+        return 1;
+    }
+
+    if(strlen(socketPath) >= sizeof(address.sun_path)){
+        printf("Socket path is too long\n");
+        return 1;
+    }
+
+    int server = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, socketPath);
+
+    if(server < 0 || connect(server, (struct sockaddr *) &address, sizeof(address)) != 0){
+        printf("Could not connect to %s: %s\n", socketPath, strerror(errno));
+        if(server >= 0){
+            close(server);
+        }
+        return 1;
+    }
+
+    FILE *stream = fdopen(server, "r+");
+    int i;
+
+    /*Arguments are quoted so ones holding spaces arrive as a single argument*/
+    for(i=0; i<argc; i++){
+        fprintf(stream, "%s\"%s\"", i > 0 ? " " : "", argv[i]);
+    }
+    fprintf(stream, "\n");
+    fflush(stream);
+
+    char line[SCRIPT_LINE_LENGTH];
+    int rc = 1;
+
+    while(fgets(line, sizeof(line), stream)){
+
+        if(strncmp(line, "END ", 4) == 0){
+            rc = atoi(line + 4);
+            break;
+        }
+
+        fputs(line, stdout);
+    }
+
+    fclose(stream);
+
+    return rc;
+}
+
+/*Returns the socket path from STOCK_SOCKET, or the default*/
+const char *defaultSocketPath(){
+
+    const char *path = getenv("STOCK_SOCKET");
+
+    return (path != NULL && *path != 0) ? path : SERVER_SOCKET;
+}
+
+/*Operations replayed by the benchmark, each goes through the same function the menu and the commands use*/
+enum benchmarkOperation{
+
+    BENCH_ADD,
+    BENCH_FIND_BY_NAME,
+    BENCH_FIND_BY_CATEGORY,
+    BENCH_MODIFY,
+    BENCH_LIST,
+    BENCH_OPERATION_COUNT
+};
+
+static const char *benchmarkOperationNames[BENCH_OPERATION_COUNT] = {"add", "find-by-name", "find-by-category", "modify", "list"};
+
+/*Scratch database used when --database is not given, it belongs to the benchmark so it is replaced without asking*/
+#define BENCHMARK_SCRATCH "benchmark_scratch.db"
+
+/*Settings for a benchmark run, given as --flag value pairs*/
+struct benchmarkOptions{
+
+    const char *database;
+    /*Set by --force, lets --database replace a file that already exists*/
+    int force;
+    /*Both stay within an int so every generated name fits in product.name*/
+    int products;
+    double skew;
+    int operations;
+    unsigned long long seed;
+    /*Relative share of each operation in the replayed mix*/
+    int weights[BENCH_OPERATION_COUNT];
+};
+
+/*Latency of every call of one operation in microseconds*/
+struct latencyLog{
+
+    double *micros;
+    long count;
+    long capacity;
+    double total;
+};
+
+/*State of the benchmark's random number generator, xorshift so runs with the same seed replay the same mix*/
+static unsigned long long benchmarkRandomState = 1;
+
+unsigned long long benchmarkRandom(){
+
+    benchmarkRandomState ^= benchmarkRandomState << 13;
+    benchmarkRandomState ^= benchmarkRandomState >> 7;
+    benchmarkRandomState ^= benchmarkRandomState << 17;
+
+    return benchmarkRandomState;
+}
+
+/*Returns a random number in [0, 1)*/
+double benchmarkUniform(){
+
+    return (benchmarkRandom() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/*Microseconds between two clock readings*/
+double elapsedMicros(struct timespec *start, struct timespec *end){
+
+    return (end->tv_sec - start->tv_sec) * 1e6 + (end->tv_nsec - start->tv_nsec) / 1e3;
+}
+
+/*Adds one latency to a log, growing it as needed*/
+void recordLatency(struct latencyLog *log, double micros){
+
+    if(log->count == log->capacity){
+
+        long capacity = log->capacity ? log->capacity * 2 : 1024;
+        double *grown = realloc(log->micros, sizeof(double) * capacity);
+
+        if(grown == NULL){
+            return;
+        }
+
+        log->micros = grown;
+        log->capacity = capacity;
+    }
+
+    log->micros[log->count++] = micros;
+    log->total += micros;
+}
+
+int compareDoubles(const void *a, const void *b){
+
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+
+    return (x > y) - (x < y);
+}
+
+/*Returns the latency below which the given fraction of calls fall, the log must already be sorted*/
+double percentile(struct latencyLog *log, double fraction){
+
+    if(log->count == 0){
+        return 0;
+    }
+
+    long index = (long) (fraction * log->count + 0.999999) - 1;
+
+    if(index < 0){
+        index = 0;
+    }
+
+    return log->micros[index];
+}
+
+/*Prints one operation's results as a JSON object on its own line*/
+void printLatencyReport(const char *phase, const char *operation, struct latencyLog *log){
+
+    qsort(log->micros, log->count, sizeof(double), compareDoubles);
+
+    printf("{\"phase\":\"%s\",\"operation\":\"%s\",\"count\":%ld,\"ops_per_sec\":%.1f,\"mean_us\":%.1f,\"p50_us\":%.1f,\"p99_us\":%.1f,\"p999_us\":%.1f}\n",
+        phase, operation, log->count,
+        log->total > 0 ? log->count / (log->total / 1e6) : 0.0,
+        log->count > 0 ? log->total / log->count : 0.0,
+        percentile(log, 0.5), percentile(log, 0.99), percentile(log, 0.999));
+}
+
+/*Reads the benchmark flags, returns 1 if a flag or value is not valid*/
+int parseBenchmarkOptions(int argc, char *argv[], struct benchmarkOptions *options){
+
+    int i;
+    int defaultWeights[BENCH_OPERATION_COUNT] = {10, 40, 20, 29, 1};
+
+    options->database = BENCHMARK_SCRATCH;
+    options->force = 0;
+    options->products = 100000;
+    options->skew = 1.0;
+    options->operations = 5000;
+    options->seed = 42;
+    memcpy(options->weights, defaultWeights, sizeof(defaultWeights));
+
+    for(i=1; i<argc; i+=2){
+
+        /*--force is the only flag without a value*/
+        if(strcmp(argv[i], "--force") == 0){
+            options->force = 1;
+            i--;
+            continue;
+        }
+
+        if(i + 1 >= argc){
+            printf("Missing value for %s\n", argv[i]);
+            return 1;
+        }
+
+        const char *value = argv[i + 1];
+
+        if(strcmp(argv[i], "--database") == 0){
+            options->database = value;
+        } else if(strcmp(argv[i], "--products") == 0 && intCheck((char *) value) && atol(value) <= INT_MAX){
+            options->products = atoi(value);
+        } else if(strcmp(argv[i], "--operations") == 0 && intCheck((char *) value) && atol(value) <= INT_MAX){
+            options->operations = atoi(value);
+        } else if(strcmp(argv[i], "--seed") == 0 && intCheck((char *) value)){
+            options->seed = strtoull(value, NULL, 10);
+        } else if(strcmp(argv[i], "--skew") == 0 && doubleCheck((char *) value)){
+            options->skew = strtod(value, NULL);
+        } else if(strcmp(argv[i], "--mix") == 0){
+
+            /*The mix is a list such as add=10,find-by-name=40, operations that are not listed get no share*/
+            char mix[256];
+            char *entry;
+            char *save;
+
+            memset(options->weights, 0, sizeof(options->weights));
+            snprintf(mix, sizeof(mix), "%s", value);
+
+            for(entry = strtok_r(mix, ",", &save); entry != NULL; entry = strtok_r(NULL, ",", &save)){
+
+                char *equals = strchr(entry, '=');
+                int operation;
+
+                if(equals == NULL || !intCheck(equals + 1)){
+                    printf("Mix entries must look like list=1\n");
+                    return 1;
+                }
+
+                *equals = 0;
+
+                for(operation=0; operation<BENCH_OPERATION_COUNT; operation++){
+                    if(strcmp(entry, benchmarkOperationNames[operation]) == 0){
+                        break;
+                    }
+                }
+
+                if(operation == BENCH_OPERATION_COUNT){
+                    printf("Unknown operation %s in mix\n", entry);
+                    return 1;
+                }
+
+                options->weights[operation] = atoi(equals + 1);
+            }
+        } else {
+            printf("Unknown or invalid option %s %s\n", argv[i], value);
+            return 1;
+        }
+    }
+
+    if(options->products < 1){
+        printf("The benchmark needs at least one product\n");
+        return 1;
+    }
+
+    return 0;
+}
+
+/*Checks that the scratch database may be deleted, the configured database never may and any other file that exists only with --force, returns 1 if it may not*/
+int checkBenchmarkDatabase(const struct benchmarkOptions *options){
+
+    /*The settings are only read from the environment once the database is opened, so the override is looked up here*/
+    const char *configured = getenv("STOCK_DB_PATH");
+    struct stat scratch, database;
+
+    if(configured == NULL || *configured == 0){
+        configured = getDatabaseSettings()->path;
+    }
+
+    if(stat(options->database, &scratch) != 0){
+        return 0;
+    }
+
+    /*The same file can be named by different paths, so the files themselves are compared*/
+    if(strcmp(options->database, configured) == 0 || (stat(configured, &database) == 0 && scratch.st_dev == database.st_dev && scratch.st_ino == database.st_ino)){
+        printf("%s is the stock database, the benchmark needs a scratch database of its own\n", options->database);
+        return 1;
+    }
+
+    if(!options->force && strcmp(options->database, BENCHMARK_SCRATCH) != 0){
+        printf("%s already exists, add --force to replace it\n", options->database);
+        return 1;
+    }
+
+    return 0;
+}
+
+/*Picks a category with a Zipf like skew, cumulative holds the running total of each category's weight*/
+int pickCategory(int *categoryIDs, double *cumulative, int count){
+
+    double target = benchmarkUniform() * cumulative[count - 1];
+    int i;
+
+    for(i=0; i<count - 1; i++){
+        if(target < cumulative[i]){
+            break;
+        }
+    }
+
+    return categoryIDs[i];
+}
+
+/*Fills a scratch database with a synthetic catalog and replays a mix of operations against it, printing throughput and latency percentiles as JSON lines*/
+int runBenchmark(sqlite3 *db, struct benchmarkOptions *options){
+
+    int categorySlots = getCategoryCount();
+    int categoryIDs[categorySlots > 0 ? categorySlots : 1];
+    double cumulative[categorySlots > 0 ? categorySlots : 1];
+    int categoryCount = 0;
+    int i;
+
+    /*Category k gets weight 1/(k+1)^skew, so a skew of 0 spreads products evenly*/
+    for(i=0; i<categorySlots; i++){
+
+        if(!hasCategory(i)){
+            continue;
+        }
+
+        double weight = 1.0 / pow(categoryCount + 1, options->skew);
+
+        categoryIDs[categoryCount] = i;
+        cumulative[categoryCount] = weight + (categoryCount > 0 ? cumulative[categoryCount - 1] : 0);
+        categoryCount += 1;
+    }
+
+    if(categoryCount == 0){
+        printf("The benchmark needs at least one category in categories.txt\n");
+        return 1;
+    }
+
+    /*Operation output is discarded, formatting it is still part of what is measured*/
+    FILE *discard = fopen("/dev/null", "w");
+
+    if(discard == NULL){
+        printf("/dev/null could not be opened\n");
+        return 1;
+    }
+
+    commandOutput = discard;
+    benchmarkRandomState = options->seed ? options->seed : 1;
+
+    struct latencyLog logs[BENCH_OPERATION_COUNT];
+    struct latencyLog generate;
+    struct timespec start, end;
+    struct product tempProduct;
+    int n;
+
+    memset(logs, 0, sizeof(logs));
+    memset(&generate, 0, sizeof(generate));
+
+    /*The catalog is loaded through insertData, as addStock does, with commits grouped so generation stays quick*/
+    startGroupCommit(10000, 60000);
+
+    for(n=0; n<options->products; n++){
+
+        snprintf(tempProduct.name, sizeof(tempProduct.name), "product%d", n);
+        tempProduct.productID = AUTO_PRODUCT_ID;
+        tempProduct.categoryID = pickCategory(categoryIDs, cumulative, categoryCount);
+        tempProduct.price = 0.5 + benchmarkUniform() * 200;
+        tempProduct.quantity = (double) (benchmarkRandom() % 1000);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        insertData(db, tempProduct);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        recordLatency(&generate, elapsedMicros(&start, &end));
+    }
+
+    finishGroupCommit(db);
+
+    int totalWeight = 0;
+
+    for(i=0; i<BENCH_OPERATION_COUNT; i++){
+        totalWeight += options->weights[i];
+    }
+
+    int added = 0;
+    struct timespec runStart, runEnd;
+
+    clock_gettime(CLOCK_MONOTONIC, &runStart);
+
+    for(n=0; n<options->operations && totalWeight > 0; n++){
+
+        int pick = benchmarkRandom() % totalWeight;
+        int operation = 0;
+
+        while(pick >= options->weights[operation]){
+            pick -= options->weights[operation];
+            operation += 1;
+        }
+
+        /*Products generated above have productIDs 1 to products and names product0 upwards*/
+        int target = benchmarkRandom() % options->products;
+        char name[20];
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        switch(operation){
+
+            case BENCH_ADD:
+                snprintf(tempProduct.name, sizeof(tempProduct.name), "added%d", added++);
+                tempProduct.productID = AUTO_PRODUCT_ID;
+                tempProduct.categoryID = pickCategory(categoryIDs, cumulative, categoryCount);
+                tempProduct.price = 0.5 + benchmarkUniform() * 200;
+                tempProduct.quantity = (double) (benchmarkRandom() % 1000);
+                insertData(db, tempProduct);
+                break;
+
+            case BENCH_FIND_BY_NAME:
+                snprintf(name, sizeof(name), "product%d", target);
+                findStockByName(db, name);
+                break;
+
+            case BENCH_FIND_BY_CATEGORY:
+                findStockByCategory(db, pickCategory(categoryIDs, cumulative, categoryCount));
+                break;
+
+            case BENCH_MODIFY:
+                /*Alternates between the four modifyStock options*/
+                switch(benchmarkRandom() % 4){
+                    case 0:
+                        changeProductPrice(db, target + 1, 0.5 + benchmarkUniform() * 200);
+                        break;
+                    case 1:
+                        changeProductQuantity(db, target + 1, (double) (benchmarkRandom() % 1000));
+                        break;
+                    case 2:
+                        snprintf(name, sizeof(name), "product%d", target);
+                        changeProductName(db, target + 1, name);
+                        break;
+                    default:
+                        changeProductCategory(db, target + 1, pickCategory(categoryIDs, cumulative, categoryCount));
+                        break;
+                }
+                break;
+
+            case BENCH_LIST:
+                readAllStock(db);
+                break;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        recordLatency(&logs[operation], elapsedMicros(&start, &end));
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &runEnd);
+
+    commandOutput = NULL;
+    fclose(discard);
+
+    double runSeconds = elapsedMicros(&runStart, &runEnd) / 1e6;
+
+    printLatencyReport("generate", "add", &generate);
+
+    for(i=0; i<BENCH_OPERATION_COUNT; i++){
+        if(logs[i].count > 0){
+            printLatencyReport("replay", benchmarkOperationNames[i], &logs[i]);
+        }
+    }
+
+    printf("{\"phase\":\"summary\",\"products\":%d,\"categories\":%d,\"skew\":%.2f,\"operations\":%d,\"seconds\":%.3f,\"ops_per_sec\":%.1f}\n",
+        options->products, categoryCount, options->skew, n, runSeconds, runSeconds > 0 ? n / runSeconds : 0.0);
+
+    free(generate.micros);
+    for(i=0; i<BENCH_OPERATION_COUNT; i++){
+        free(logs[i].micros);
+    }
+
+    return 0;
+}
+
+/*Main function which displays the menu that the user can use the navigate through the program, or runs a single command when one is given*/
+int main(int argc, char *argv[]){
+
+    /*Commands print only their results so their output can be used by other programs*/
+    if(argc > 1){
+        quietMode = true;
+    }
+
+    /*Messages from the data library are shown alongside the program's own output*/
+    setStockMessageHandler(showStockMessage);
+
+    /*The client only talks to a server, so it never opens the database itself*/
+    if(argc > 1 && strcmp(argv[1], "client") == 0){
+
+        if(argc > 3 && strcmp(argv[2], "--socket") == 0){
+            return runClient(argv[3], argc - 4, argv + 4);
+        }
+
+        return runClient(defaultSocketPath(), argc - 2, argv + 2);
+    }
+
+    /*A snapshot is read straight from its file, so the database is never opened*/
+    if(argc > 2 && strcmp(argv[1], "snapshot") == 0){
+        return runSnapshot(argv[2], argc - 3, argv + 3);
+    }
+
+    /*The benchmark works on its own scratch database, which is recreated each run*/
+    struct benchmarkOptions benchmark;
+    bool benchmarking = argc > 1 && strcmp(argv[1], "benchmark") == 0;
+
+    if(benchmarking){
+
+        if(parseBenchmarkOptions(argc - 1, argv + 1, &benchmark) != 0 || checkBenchmarkDatabase(&benchmark) != 0){
+            return 1;
+        }
+
+        char scratch[300];
+        const char *suffixes[] = {"", "-wal", "-shm", "-journal"};
+
+        for(int i=0; i<4; i++){
+            snprintf(scratch, sizeof(scratch), "%s%s", benchmark.database, suffixes[i]);
+            unlink(scratch);
+        }
+
+        setenv("STOCK_DB_PATH", benchmark.database, 1);
+    }
+
+    sqlite3 *initialisation = startup();
+
+    if(initialisation == NULL){
+        return 1;
+    }
+
+    if(benchmarking){
+
+        int rc = runBenchmark(initialisation, &benchmark);
+        shutdownProgram(initialisation);
+
+        return rc;
+    }
+
+    /*SIGUSR1 dumps the metrics to standard error at any time*/
+    startMetricsSignalThread();
+
+    if(argc > 1){
+
+        int rc = runCommand(initialisation, argc - 1, argv + 1);
+
+        /*Sessions that run many operations dump their metrics on exit, a single command does not so its output stays clean*/
+        if(strcmp(argv[1], "script") == 0 || strcmp(argv[1], "serve") == 0){
+            printMetrics(stderr);
+        }
+
+        shutdownProgram(initialisation);
+
+        return rc;
+    }
+    
+    /*Variable to hold whether the user has exited the program or not*/
+    bool exited = false;
+
+    while(!exited){
+        printf("\nWelcome to the stock management program\n");
+        printf("---------------------------------------\n");
+        printf("\n\nMain Menu\n\n");
+        printf("1.  Add Stock\n");
+        printf("2.  Track Stock by Name\n");
+        printf("3.  Track Stock by Category\n");
+        printf("4.  Modify Stock\n");
+        printf("5.  View Entire Stock\n");
+        printf("6.  Import Stock from File\n");
+        printf("7.  View Metrics\n");
+        printf("8.  Stock Report\n");
+        printf("9.  Exit the Program\n");
+
+        printf("\n\nPlease choose the number for your perferred action: ");
+        int userInput;
+        scanf("%d", &userInput);
+        int ch;
+        do{
+            ch = getchar();
+        } while(ch != '\n');
+
+        printf("You have selected %d\n", userInput);
+
+        switch(userInput){
             case 1:
                 printf("Add Stock\n");
                 printf("----------------------------------\n");
@@ -1343,18 +3462,36 @@ void main(){
             case 5:
                 printf("View Entire Stock\n");
                 printf("----------------------------------\n");
-                readAllStock(initialisation);
+                browseStock(initialisation, CATEGORY_NOT_FOUND, 0);
                 break;
             case 6:
+                printf("Import Stock from File\n");
+                printf("----------------------------------\n");
+                importStockFromFile(initialisation);
+                break;
+            case 7:
+                printf("View Metrics\n");
+                printf("----------------------------------\n");
+                printMetrics(stdout);
+                break;
+            case 8:
+                printf("Stock Report\n");
+                printf("----------------------------------\n");
+                reportStock(initialisation, REPORT_BOTH);
+                break;
+            case 9:
                 printf("Exit the Program\n");
                 printf("----------------------------------\n");
-                closeDB(initialisation);
+                printMetrics(stderr);
+                shutdownProgram(initialisation);
                 exit(0);
                 break;
             default:
                 printf("Please make sure to choose one of the displayed options\n");
         }
     }
+
+    return 0;
 }
 
 
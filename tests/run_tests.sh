@@ -0,0 +1,53 @@
+#!/bin/sh
+# Runs each tests/*.script through "stock_management script" against a fresh database and
+# compares what it prints with the matching .expected file. Every script is run twice, with
+# the product cache switched off and on, and both runs must give the same output.
+#
+# Usage: tests/run_tests.sh [path to stock_management]
+
+tests=$(cd "$(dirname "$0")" && pwd)
+binary=${1:-$tests/../stock_management}
+binary=$(cd "$(dirname "$binary")" && pwd)/$(basename "$binary")
+failures=0
+
+if [ ! -x "$binary" ]; then
+	echo "No stock_management binary at $binary, build it first or pass its path"
+	exit 1
+fi
+
+for script in "$tests"/*.script; do
+
+	name=$(basename "$script" .script)
+
+	for cache in OFF ON; do
+
+		work=$(mktemp -d)
+		cp "$tests/../categories.txt" "$work"
+		cp "$tests"/data/* "$work" 2>/dev/null
+
+		# Timings change from run to run and migrations are applied to every new database,
+		# so neither is part of the expected output
+		(cd "$work" && STOCK_DB_PATH="$work/test.db" STOCK_PRODUCT_CACHE=$cache "$binary" script "$script" 2>/dev/null) |
+			sed -e '/^Applied migration/d' -e 's/ in [0-9.]* seconds.*//' -e 's/ ([0-9.]* ms)//' > "$work/actual"
+
+		# Rows rejected by an import are checked along with the output
+		for rejected in "$work"/*.rejected; do
+			if [ -f "$rejected" ]; then
+				echo "== $(basename "$rejected")" >> "$work/actual"
+				cat "$rejected" >> "$work/actual"
+			fi
+		done
+
+		if diff -u "$tests/$name.expected" "$work/actual" > "$work/diff"; then
+			echo "PASS $name (cache $cache)"
+		else
+			echo "FAIL $name (cache $cache)"
+			cat "$work/diff"
+			failures=$((failures + 1))
+		fi
+
+		rm -rf "$work"
+	done
+done
+
+[ $failures -eq 0 ]